@@ -54,5 +54,8 @@ class MemArena {
 	vm_address_t vm_mem;  // same type as vm_address_t
 #else
 	int fd;
+	// Address space reserved by Find4GBBase, if any.
+	void *reservedWindow = nullptr;
+	size_t reservedWindowSize = 0;
 #endif
 };
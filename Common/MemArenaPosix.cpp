@@ -78,6 +78,12 @@ void MemArena::GrabLowMemSpace(size_t size) {
 
 void MemArena::ReleaseSpace() {
 	close(fd);
+#if PPSSPP_ARCH(AMD64) && !defined(USE_ADDRESS_SANITIZER)
+	if (reservedWindow) {
+		munmap(reservedWindow, reservedWindowSize);
+		reservedWindow = nullptr;
+	}
+#endif
 }
 
 void *MemArena::CreateView(s64 offset, size_t size, void *base)
@@ -102,7 +108,24 @@ void MemArena::ReleaseView(void* view, size_t size) {
 
 u8* MemArena::Find4GBBase() {
 	// Now, create views in high memory where there's plenty of space.
-#if PPSSPP_ARCH(64BIT) && !defined(USE_ADDRESS_SANITIZER)
+#if PPSSPP_ARCH(AMD64) && !defined(USE_ADDRESS_SANITIZER)
+	// Reserve the whole window (plus guard space for negative and large offsets), so that
+	// unchecked jit accesses outside the views fault instead of hitting some other mapping.
+	// The views are later mapped over it with MAP_FIXED.
+	const size_t guardSize = 0x10000;
+	u8 *hint = reinterpret_cast<u8 *>(0x2300000000ULL) - guardSize;
+	reservedWindowSize = 0x100000000ULL + guardSize * 2;
+	void *reserved = mmap(hint, reservedWindowSize, PROT_NONE, MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+	if (reserved == MAP_FAILED) {
+		// Very precarious - mmap cannot return an error when trying to map already used pages.
+		// So without a reservation, we will simply pray...
+		WARN_LOG(MEMMAP, "Failed to reserve memory window: %s", strerror(errno));
+		reservedWindow = nullptr;
+		return reinterpret_cast<u8*>(0x2300000000ULL);
+	}
+	reservedWindow = reserved;
+	return static_cast<u8 *>(reserved) + guardSize;
+#elif PPSSPP_ARCH(64BIT) && !defined(USE_ADDRESS_SANITIZER)
 	// Very precarious - mmap cannot return an error when trying to map already used pages.
 	// This makes the Windows approach above unusable on Linux, so we will simply pray...
 	return reinterpret_cast<u8*>(0x2300000000ULL);
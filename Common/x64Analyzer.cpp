@@ -15,6 +15,8 @@
 // Official SVN repository and contact information can be found at
 // http://code.google.com/p/dolphin-emu/
 
+#include <cstring>
+
 #include "x64Analyzer.h"
 
 bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int accessType)
@@ -23,31 +25,33 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 	u8 rex = 0;
 	u8 codeByte = 0;
 	u8 codeByte2 = 0;
-	
-	//Check for regular prefix
+	bool operandSizePrefix = false;
+	bool repPrefix = false;
+
 	info.operandSize = 4;
 	info.zeroExtend = false;
 	info.signExtend = false;
 	info.hasImmediate = false;
-	info.isMemoryWrite = false;
-
-	int addressSize = 8;
-	u8 modRMbyte = 0;
-	u8 sibByte = 0;
-    bool hasModRM = false;
-	bool hasSIBbyte = false;
-	bool hasDisplacement = false;
-
-	int displacementSize = 0;
-
-	if (*codePtr == 0x66)
+	info.isMemoryWrite = accessType == OP_ACCESS_WRITE;
+	info.isXmmOperand = false;
+	info.isHighByteReg = false;
+	info.otherReg = -1;
+	info.scaledReg = -1;
+	info.scale = 1;
+	info.immediate = 0;
+	info.displacement = 0;
+
+	//Check for regular prefixes, in any order
+	while (true)
 	{
-		info.operandSize = 2;
-		codePtr++;
-	} 
-	else if (*codePtr == 0x67)
-	{
-		addressSize = 4;
+		if (*codePtr == 0x66)
+			operandSizePrefix = true;
+		else if (*codePtr == 0xF3)
+			repPrefix = true;
+		else if (*codePtr == 0x67)
+			return false; // 32-bit addressing, not something we emit for memory accesses.
+		else
+			break;
 		codePtr++;
 	}
 
@@ -55,96 +59,89 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 	if ((*codePtr & 0xF0) == 0x40)
 	{
 		rex = *codePtr;
-		if (rex & 8) //REX.W
-		{
-			info.operandSize = 8;
-		}
 		codePtr++;
 	}
+	if (rex & 8) //REX.W
+		info.operandSize = 8;
+	else if (operandSizePrefix)
+		info.operandSize = 2;
+	info.regOperandSize = info.operandSize;
 
 	codeByte = *codePtr++;
-
-    // Skip two-byte opcode byte 
-    bool twoByte = false; 
-    if(codeByte == 0x0F) 
-    { 
-        twoByte = true; 
+	if (codeByte == 0x0F)
 		codeByte2 = *codePtr++;
-    } 
 
-	if (!twoByte)
+	// Everything handled below takes a mod R/M byte, and it must address memory.
+	ModRM mrm(*codePtr++, rex);
+	if (mrm.mod == 3)
+		return false;
+	info.regOperandReg = mrm.reg;
+
+	int displacementSize = 0;
+	if (mrm.mod == 1)
+		displacementSize = 1;
+	else if (mrm.mod == 2)
+		displacementSize = 4;
+
+	if (mrm.rm == 4)
 	{
-        if ((codeByte & 0xF0) == 0x80 || 
-            ((codeByte & 0xF8) == 0xC0 && (codeByte & 0x0E) != 0x02))
-		{
-			modRMbyte = *codePtr++;
-			hasModRM = true;
-		}
+		//SIB byte
+		u8 sibByte = *codePtr++;
+		int index = ((sibByte >> 3) & 7) | ((rex & 2) ? 8 : 0);
+		int base = (sibByte & 7) | ((rex & 1) ? 8 : 0);
+		info.scale = 1 << (sibByte >> 6);
+		// An index of rsp means no index (r12 is fine.)
+		if (index != 4)
+			info.scaledReg = index;
+		if ((sibByte & 7) == 5 && mrm.mod == 0)
+			displacementSize = 4;
+		else
+			info.otherReg = base;
 	}
-	else
+	else if (mrm.rm == 5 && mrm.mod == 0)
 	{
-        if (((codeByte2 & 0xF0) == 0x00 && (codeByte2 & 0x0F) >= 0x04 && (codeByte2 & 0x0D) != 0x0D) || 
-            (codeByte2 & 0xF0) == 0x30 || 
-            codeByte2 == 0x77 || 
-            (codeByte2 & 0xF0) == 0x80 || 
-            ((codeByte2 & 0xF0) == 0xA0 && (codeByte2 & 0x07) <= 0x02) || 
-            (codeByte2 & 0xF8) == 0xC8) 
-        { 
-            // No mod R/M byte 
-        } 
-        else 
-        { 
-			modRMbyte = *codePtr++;
-			hasModRM = true;
-        } 
+		// RIP relative.
+		return false;
 	}
-
-	if (hasModRM)
+	else
 	{
-		ModRM mrm(modRMbyte, rex);
-		info.regOperandReg = mrm.reg;
-		if (mrm.mod < 3)
-		{
-			if (mrm.rm == 4)
-			{
-				//SIB byte
-				sibByte = *codePtr++;
-				info.scaledReg = (sibByte >> 3) & 7;
-				info.otherReg = (sibByte & 7);
-				if (rex & 2) info.scaledReg += 8;
-				if (rex & 1) info.otherReg += 8;
-				hasSIBbyte = true;
-			}
-			else
-			{
-				//info.scaledReg = 
-			}
-		}
-		if (mrm.mod == 1 || mrm.mod == 2)
-		{
-			hasDisplacement = true;
-			if (mrm.mod == 1)
-				displacementSize = 1;
-			else
-				displacementSize = 4;
-		}
+		info.otherReg = mrm.rm | ((rex & 1) ? 8 : 0);
 	}
 
 	if (displacementSize == 1)
 		info.displacement = (s32)(s8)*codePtr;
-	else
-		info.displacement = *((s32 *)codePtr);
+	else if (displacementSize == 4)
+		memcpy(&info.displacement, codePtr, sizeof(s32));
 	codePtr += displacementSize;
 
-	
-	if (accessType == 1)
+	if (codeByte == 0x0F && (codeByte2 == MOVUPS_LOAD || codeByte2 == MOVUPS_STORE || codeByte2 == MOVAPS_LOAD || codeByte2 == MOVAPS_STORE))
+	{
+		bool isStore = codeByte2 == MOVUPS_STORE || codeByte2 == MOVAPS_STORE;
+		if (isStore != info.isMemoryWrite || (rex & 8))
+			return false;
+		bool isScalar = repPrefix && (codeByte2 == MOVUPS_LOAD || codeByte2 == MOVUPS_STORE);
+		if (repPrefix && !isScalar)
+			return false;
+		info.isXmmOperand = true;
+		info.operandSize = isScalar ? 4 : 16;
+		info.regOperandSize = 16;
+		// movss from memory clears the rest of the register.
+		info.zeroExtend = isScalar && !isStore;
+	}
+	else if (repPrefix)
+	{
+		return false;
+	}
+	else if (info.isMemoryWrite)
 	{
-		info.isMemoryWrite = true;
 		//Write access
 		switch (codeByte)
 		{
 		case MOVE_8BIT: //move 8-bit immediate
 			{
+				if ((mrm.reg & 7) != 0)
+					return false;
+				info.operandSize = 1;
 				info.hasImmediate = true;
 				info.immediate = *codePtr;
 				codePtr++; //move past immediate
@@ -153,31 +150,42 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 
 		case MOVE_16_32BIT: //move 16 or 32-bit immediate, easiest case for writes
 			{
+				if ((mrm.reg & 7) != 0)
+					return false;
+				info.hasImmediate = true;
 				if (info.operandSize == 2)
 				{
-					info.hasImmediate = true;
-					info.immediate = *(u16*)codePtr;
+					u16 imm16;
+					memcpy(&imm16, codePtr, sizeof(imm16));
+					info.immediate = imm16;
 					codePtr += 2;
 				}
-				else if (info.operandSize == 4)
+				else
 				{
-					info.hasImmediate = true;
-					info.immediate = *(u32*)codePtr;
-					codePtr += 4;
-				}
-				else if (info.operandSize == 8)
-				{
-					info.zeroExtend = true;
-					info.immediate = *(u32*)codePtr;
+					s32 imm32;
+					memcpy(&imm32, codePtr, sizeof(imm32));
+					// For 64-bit, the immediate is sign extended.
+					info.immediate = info.operandSize == 8 ? (u64)(s64)imm32 : (u32)imm32;
 					codePtr += 4;
 				}
 			}
 			break;
+
+		case MOVE_REG8_TO_MEM:
+			info.operandSize = 1;
+			info.regOperandSize = 1;
+			// Without REX, registers 4-7 are the legacy high byte registers.
+			if (rex == 0 && info.regOperandReg >= 4)
+			{
+				info.isHighByteReg = true;
+				info.regOperandReg -= 4;
+			}
+			break;
+
 		case MOVE_REG_TO_MEM: //move reg to memory
 			break;
 
 		default:
-			PanicAlert("Unhandled disasm case in write handler!\n\nPlease implement or avoid.");
 			return false;
 		}
 	}
@@ -211,15 +219,16 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 				return false;
 			}
 			break;
-		case 0x8a: 
-			if (info.operandSize == 4)
+		case MOVE_MEM_TO_REG8:
+			info.operandSize = 1;
+			info.regOperandSize = 1;
+			if (rex == 0 && info.regOperandReg >= 4)
 			{
-				info.operandSize = 1;
-				break;
+				info.isHighByteReg = true;
+				info.regOperandReg -= 4;
 			}
-			else 
-				return false;
-		case 0x8b: 
+			break;
+		case MOVE_MEM_TO_REG:
 			break; //it's OK don't need to do anything
 		default:
 			return false;
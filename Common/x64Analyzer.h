@@ -21,15 +21,19 @@
 
 struct InstructionInfo
 {
-	int operandSize; //8, 16, 32, 64
+	int operandSize; // Memory operand size in bytes: 1, 2, 4, 8, 16
+	int regOperandSize; // Can be larger than operandSize for movzx/movsx
 	int instructionSize;
 	int regOperandReg;
-	int otherReg;
-	int scaledReg;
+	int otherReg; // Base register, -1 if none
+	int scaledReg; // Index register, -1 if none
+	int scale;
 	bool zeroExtend;
 	bool signExtend;
 	bool hasImmediate;
 	bool isMemoryWrite;
+	bool isXmmOperand; // regOperandReg is an xmm register
+	bool isHighByteReg; // regOperandReg is ah, ch, dh, or bh (numbered as rax-rbx)
 	u64 immediate;
 	s32 displacement;
 };
@@ -53,6 +57,13 @@ enum {
 	MOVE_8BIT	    = 0xC6, //move 8-bit immediate
 	MOVE_16_32BIT   = 0xC7, //move 16 or 32-bit immediate
 	MOVE_REG_TO_MEM = 0x89, //move reg to memory
+	MOVE_REG8_TO_MEM = 0x88, //move 8-bit reg to memory
+	MOVE_MEM_TO_REG8 = 0x8A, //move memory to 8-bit reg
+	MOVE_MEM_TO_REG = 0x8B, //move memory to reg
+	MOVUPS_LOAD     = 0x10, //movups, or movss with F3 prefix
+	MOVUPS_STORE    = 0x11,
+	MOVAPS_LOAD     = 0x28,
+	MOVAPS_STORE    = 0x29,
 };
 
 enum AccessType {
@@ -60,4 +71,6 @@ enum AccessType {
 	OP_ACCESS_WRITE = 1
 };
 
+// Decodes the mov-style memory access at codePtr. Returns false for anything not understood,
+// including RIP-relative and 32-bit addressing, which never target emulated memory.
 bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int accessType);
@@ -1876,6 +1876,13 @@ void XEmitter::VPANDN(X64Reg regOp1, X64Reg regOp2, OpArg arg)   { WriteAVXOp(0x
 void XEmitter::VPOR(X64Reg regOp1, X64Reg regOp2, OpArg arg)     { WriteAVXOp(0x66, 0xEB, regOp1, regOp2, arg); }
 void XEmitter::VPXOR(X64Reg regOp1, X64Reg regOp2, OpArg arg)    { WriteAVXOp(0x66, 0xEF, regOp1, regOp2, arg); }
 
+void XEmitter::VBROADCASTSS(X64Reg regOp, OpArg arg) {
+	if (arg.IsSimpleReg() && !cpu_info.bAVX2)
+		PanicAlert("VBROADCASTSS from a register requires AVX2");
+	WriteAVXOp(0x66, 0x3818, regOp, arg);
+}
+void XEmitter::VPERMILPS(X64Reg regOp, OpArg arg, u8 shuffle) {WriteAVXOp(0x66, 0x3A04, regOp, arg, 1); Write8(shuffle);}
+
 void XEmitter::VFMADD132PS(X64Reg regOp1, X64Reg regOp2, OpArg arg)    { WriteAVXOp(0x66, 0x3898, regOp1, regOp2, arg); }
 void XEmitter::VFMADD213PS(X64Reg regOp1, X64Reg regOp2, OpArg arg)    { WriteAVXOp(0x66, 0x38A8, regOp1, regOp2, arg); }
 void XEmitter::VFMADD231PS(X64Reg regOp1, X64Reg regOp2, OpArg arg)    { WriteAVXOp(0x66, 0x38B8, regOp1, regOp2, arg); }
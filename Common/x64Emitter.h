@@ -915,6 +915,10 @@ class XEmitter
 	void VPOR(X64Reg regOp1, X64Reg regOp2, OpArg arg);
 	void VPXOR(X64Reg regOp1, X64Reg regOp2, OpArg arg);
 
+	// Without AVX2, the source must be memory.
+	void VBROADCASTSS(X64Reg regOp, OpArg arg);
+	void VPERMILPS(X64Reg regOp, OpArg arg, u8 shuffle);
+
 	// FMA3
 	void VFMADD132PS(X64Reg regOp1, X64Reg regOp2, OpArg arg);
 	void VFMADD213PS(X64Reg regOp1, X64Reg regOp2, OpArg arg);
@@ -93,10 +93,15 @@ struct Config {
 	bool bHideSlowWarnings;
 	bool bHideStateWarnings;
 	bool bPreloadFunctions;
+	bool bFuncAnalysisCache;
+	bool bJitTiering;
 	uint32_t uJitDisableFlags;
+	// Counts entries and time per jit block, for the debugger and headless.  Slow, never saved.
+	bool bJitBlockProfile;
 
 	bool bSeparateSASThread;
 	bool bSeparateIOThread;
+	int iMpegDecodeAhead;  // Number of video frames to decode ahead on a separate thread, 0 = decode on demand.
 	int iIOTimingMethod;
 	int iLockedCPUSpeed;
 	bool bAutoSaveSymbolMap;
@@ -132,6 +137,7 @@ struct Config {
 	bool bSoftwareRendering;
 	bool bHardwareTransform; // only used in the GLES backend
 	bool bSoftwareSkinning;  // may speed up some games
+	bool bGeThread;  // process display lists on a separate thread, not deterministic
 	bool bVendorBugChecksEnabled;
 
 	int iRenderingMode; // 0 = non-buffered rendering 1 = buffered rendering
@@ -200,6 +206,7 @@ struct Config {
 	int iAudioBackend;
 	int iGlobalVolume;
 	bool bExtraAudioBuffering;  // For bluetooth
+	bool bAtracLoopCache;  // Decode looping ATRAC3 segments once on a worker and replay them from memory (up to 64MB.)
 
 	// Audio Hack
 	bool bSoundSpeedHack;
@@ -16,6 +16,8 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <cstdio>
 #include <mutex>
@@ -25,6 +27,7 @@
 
 #include "Common/MsgHandler.h"
 #include "Common/Atomics.h"
+#include "Common/Hashmaps.h"
 #include "Core/CoreTiming.h"
 #include "Core/Core.h"
 #include "Core/Config.h"
@@ -67,12 +70,63 @@ struct BaseEvent
 
 typedef LinkedListItem<BaseEvent> Event;
 
-Event *first;
+// Events are kept in a 4-ary min heap, ordered by time and then by when they were
+// scheduled, so that events at the same time still run in the order they were added.
+struct QueuedEvent : public BaseEvent
+{
+	u64 order;
+	int heapIndex;
+	// Other events with the same type and userdata, for unscheduling.
+	QueuedEvent *keyPrev;
+	QueuedEvent *keyNext;
+};
+
+struct EventKey
+{
+	u64 userdata;
+	int type;
+	int pad;
+};
+
+static inline EventKey MakeEventKey(int type, u64 userdata)
+{
+	EventKey key;
+	key.userdata = userdata;
+	key.type = type;
+	key.pad = 0;
+	return key;
+}
+
+static std::vector<QueuedEvent *> eventHeap;
+static DenseHashMap<EventKey, QueuedEvent *, nullptr> eventsByKey(64);
+// Number of queued events per event type, for IsScheduled.
+static std::vector<int> eventTypeCounts;
+static u64 nextEventOrder = 0;
+
+// Threadsafe events are normally pushed into this ring without taking a lock.
+// Each slot's sequence says whether it is free for the producer at that position,
+// or ready for the consumer (always holding externalEventLock.)
+struct TsEventSlot
+{
+	std::atomic<u32> sequence;
+	s64 time;
+	u64 userdata;
+	int type;
+};
+
+static const u32 TS_RING_SIZE = 512;
+static TsEventSlot tsRing[TS_RING_SIZE];
+static std::atomic<u32> tsRingHead;
+static u32 tsRingTail;
+// Set when the ring filled up, which makes producers use the locked list until drained.
+static std::atomic<bool> tsOverflowing;
+
+// Overflow and savestate list, only touched while holding externalEventLock.
 Event *tsFirst;
 Event *tsLast;
 
 // event pools
-Event *eventPool = 0;
+static std::vector<QueuedEvent *> eventPool;
 Event *eventTsPool = 0;
 int allocatedTsEvents = 0;
 // Optimization to skip MoveEvents when possible.
@@ -132,13 +186,13 @@ u64 GetGlobalTimeUs()
 	return lastGlobalTimeUs + usSinceLast;
 }
 
-Event* GetNewEvent()
+static QueuedEvent *GetNewEvent()
 {
-	if(!eventPool)
-		return new Event;
+	if (eventPool.empty())
+		return new QueuedEvent;
 
-	Event* ev = eventPool;
-	eventPool = ev->next;
+	QueuedEvent *ev = eventPool.back();
+	eventPool.pop_back();
 	return ev;
 }
 
@@ -154,10 +208,146 @@ Event* GetNewTsEvent()
 	return ev;
 }
 
-void FreeEvent(Event* ev)
+static void FreeEvent(QueuedEvent *ev)
+{
+	eventPool.push_back(ev);
+}
+
+// These are only used to convert the queue to the linked list format in save states.
+static Event *GetNewStateEvent()
+{
+	return new Event;
+}
+
+static void FreeStateEvent(Event *ev)
+{
+	delete ev;
+}
+
+static inline bool EventBefore(const QueuedEvent *a, const QueuedEvent *b)
+{
+	return a->time < b->time || (a->time == b->time && a->order < b->order);
+}
+
+static inline QueuedEvent *FirstEvent()
+{
+	return eventHeap.empty() ? nullptr : eventHeap[0];
+}
+
+static void HeapSiftUp(int index)
+{
+	QueuedEvent *ev = eventHeap[index];
+	while (index > 0)
+	{
+		int parent = (index - 1) / 4;
+		if (!EventBefore(ev, eventHeap[parent]))
+			break;
+		eventHeap[index] = eventHeap[parent];
+		eventHeap[index]->heapIndex = index;
+		index = parent;
+	}
+	eventHeap[index] = ev;
+	ev->heapIndex = index;
+}
+
+static void HeapSiftDown(int index)
+{
+	const int size = (int)eventHeap.size();
+	QueuedEvent *ev = eventHeap[index];
+	while (true)
+	{
+		int firstChild = index * 4 + 1;
+		if (firstChild >= size)
+			break;
+		int best = firstChild;
+		int lastChild = std::min(firstChild + 4, size);
+		for (int child = firstChild + 1; child < lastChild; ++child)
+		{
+			if (EventBefore(eventHeap[child], eventHeap[best]))
+				best = child;
+		}
+		if (!EventBefore(eventHeap[best], ev))
+			break;
+		eventHeap[index] = eventHeap[best];
+		eventHeap[index]->heapIndex = index;
+		index = best;
+	}
+	eventHeap[index] = ev;
+	ev->heapIndex = index;
+}
+
+static void LinkEventKey(QueuedEvent *ev)
+{
+	EventKey key = MakeEventKey(ev->type, ev->userdata);
+	QueuedEvent *head = eventsByKey.Get(key);
+	ev->keyPrev = head;
+	if (head)
+	{
+		ev->keyNext = head->keyNext;
+		if (head->keyNext)
+			head->keyNext->keyPrev = ev;
+		head->keyNext = ev;
+	}
+	else
+	{
+		ev->keyNext = nullptr;
+		eventsByKey.Insert(key, ev);
+	}
+}
+
+static void UnlinkEventKey(QueuedEvent *ev)
+{
+	if (ev->keyPrev)
+	{
+		ev->keyPrev->keyNext = ev->keyNext;
+		if (ev->keyNext)
+			ev->keyNext->keyPrev = ev->keyPrev;
+		return;
+	}
+
+	EventKey key = MakeEventKey(ev->type, ev->userdata);
+	eventsByKey.Remove(key);
+	if (ev->keyNext)
+	{
+		ev->keyNext->keyPrev = nullptr;
+		eventsByKey.Insert(key, ev->keyNext);
+	}
+	eventsByKey.Maintain();
+}
+
+// Takes the event out of the queue, but doesn't free it.
+static void RemoveEventFromQueue(QueuedEvent *ev)
+{
+	UnlinkEventKey(ev);
+	eventTypeCounts[ev->type]--;
+
+	int index = ev->heapIndex;
+	QueuedEvent *last = eventHeap.back();
+	eventHeap.pop_back();
+	if (last != ev)
+	{
+		eventHeap[index] = last;
+		last->heapIndex = index;
+		if (index > 0 && EventBefore(last, eventHeap[(index - 1) / 4]))
+			HeapSiftUp(index);
+		else
+			HeapSiftDown(index);
+	}
+}
+
+static QueuedEvent *PopFirstEvent()
+{
+	QueuedEvent *ev = eventHeap[0];
+	RemoveEventFromQueue(ev);
+	return ev;
+}
+
+// Returns the queued events in the order they will run.
+static std::vector<QueuedEvent *> SortedEvents()
 {
-	ev->next = eventPool;
-	eventPool = ev;
+	std::vector<QueuedEvent *> sorted = eventHeap;
+	std::sort(sorted.begin(), sorted.end(), &EventBefore);
+	return sorted;
 }
 
 void FreeTsEvent(Event* ev)
@@ -190,11 +380,87 @@ void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callba
 
 void UnregisterAllEvents()
 {
-	if (first)
+	if (!eventHeap.empty())
 		PanicAlert("Cannot unregister events with events pending");
 	event_types.clear();
 }
 
+static void ResetTsRing()
+{
+	for (u32 i = 0; i < TS_RING_SIZE; ++i)
+		tsRing[i].sequence.store(i, std::memory_order_relaxed);
+	tsRingTail = 0;
+	tsRingHead.store(0, std::memory_order_relaxed);
+	tsOverflowing.store(false, std::memory_order_release);
+}
+
+// Returns false if the ring is full.
+static bool PushTsRing(s64 time, int event_type, u64 userdata)
+{
+	u32 pos = tsRingHead.load(std::memory_order_relaxed);
+	while (true)
+	{
+		TsEventSlot &slot = tsRing[pos & (TS_RING_SIZE - 1)];
+		u32 seq = slot.sequence.load(std::memory_order_acquire);
+		s32 diff = (s32)(seq - pos);
+		if (diff == 0)
+		{
+			if (tsRingHead.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+			{
+				slot.time = time;
+				slot.userdata = userdata;
+				slot.type = event_type;
+				slot.sequence.store(pos + 1, std::memory_order_release);
+				return true;
+			}
+		}
+		else if (diff < 0)
+		{
+			return false;
+		}
+		else
+		{
+			pos = tsRingHead.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+// Must hold externalEventLock, which makes the caller the only consumer.
+template <typename F>
+static void DrainTsRing(F func)
+{
+	while (true)
+	{
+		TsEventSlot &slot = tsRing[tsRingTail & (TS_RING_SIZE - 1)];
+		u32 seq = slot.sequence.load(std::memory_order_acquire);
+		if ((s32)(seq - (tsRingTail + 1)) < 0)
+			break;
+		func(slot.time, slot.type, slot.userdata);
+		slot.sequence.store(tsRingTail + TS_RING_SIZE, std::memory_order_release);
+		tsRingTail++;
+	}
+}
+
+static void AppendTsEvent(s64 time, int event_type, u64 userdata)
+{
+	Event *ne = GetNewTsEvent();
+	ne->time = time;
+	ne->type = event_type;
+	ne->next = 0;
+	ne->userdata = userdata;
+	if(!tsFirst)
+		tsFirst = ne;
+	if(tsLast)
+		tsLast->next = ne;
+	tsLast = ne;
+}
+
+// Moves anything in the ring to the end of the locked list.  Must hold externalEventLock.
+static void DrainTsRingToList()
+{
+	DrainTsRing(&AppendTsEvent);
+}
+
 void Init()
 {
 	currentMIPS->downcount = INITIAL_SLICE_LENGTH;
@@ -204,6 +470,7 @@ void Init()
 	lastGlobalTimeTicks = 0;
 	lastGlobalTimeUs = 0;
 	hasTsEvents = 0;
+	ResetTsRing();
 	mhzChangeCallbacks.clear();
 	CPU_HZ = initialHz;
 }
@@ -214,12 +481,9 @@ void Shutdown()
 	ClearPendingEvents();
 	UnregisterAllEvents();
 
-	while(eventPool)
-	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
+	for (QueuedEvent *ev : eventPool)
 		delete ev;
-	}
+	eventPool.clear();
 
 	std::lock_guard<std::mutex> lk(externalEventLock);
 	while(eventTsPool)
@@ -245,17 +509,19 @@ u64 GetIdleTicks()
 // schedule things to be executed on the main thread.
 void ScheduleEvent_Threadsafe(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
+	s64 time = GetTicks() + cyclesIntoFuture;
+	if (!tsOverflowing.load(std::memory_order_acquire) && PushTsRing(time, event_type, userdata))
+	{
+		Common::AtomicStoreRelease(hasTsEvents, 1);
+		return;
+	}
+
+	// The ring is full, so fall back to the list.  Draining the ring first keeps our own
+	// earlier events ahead of this one.
 	std::lock_guard<std::mutex> lk(externalEventLock);
-	Event *ne = GetNewTsEvent();
-	ne->time = GetTicks() + cyclesIntoFuture;
-	ne->type = event_type;
-	ne->next = 0;
-	ne->userdata = userdata;
-	if(!tsFirst)
-		tsFirst = ne;
-	if(tsLast)
-		tsLast->next = ne;
-	tsLast = ne;
+	tsOverflowing.store(true, std::memory_order_release);
+	DrainTsRingToList();
+	AppendTsEvent(time, event_type, userdata);
 
 	Common::AtomicStoreRelease(hasTsEvents, 1);
 }
@@ -275,30 +541,23 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 
 void ClearPendingEvents()
 {
-	while (first)
-	{
-		Event *e = first->next;
-		FreeEvent(first);
-		first = e;
-	}
+	for (QueuedEvent *ev : eventHeap)
+		FreeEvent(ev);
+	eventHeap.clear();
+	eventsByKey.Clear();
+	std::fill(eventTypeCounts.begin(), eventTypeCounts.end(), 0);
 }
 
-void AddEventToQueue(Event* ne)
+void AddEventToQueue(QueuedEvent *ne)
 {
-	Event* prev = NULL;
-	Event** pNext = &first;
-	for(;;)
-	{
-		Event*& next = *pNext;
-		if(!next || ne->time < next->time)
-		{
-			ne->next = next;
-			next = ne;
-			break;
-		}
-		prev = next;
-		pNext = &prev->next;
-	}
+	ne->order = nextEventOrder++;
+	if (ne->type >= (int)eventTypeCounts.size())
+		eventTypeCounts.resize(ne->type + 1, 0);
+	eventTypeCounts[ne->type]++;
+	LinkEventKey(ne);
+
+	eventHeap.push_back(ne);
+	HeapSiftUp((int)eventHeap.size() - 1);
 }
 
 // This must be run ONLY from within the cpu thread
@@ -306,7 +565,7 @@ void AddEventToQueue(Event* ne)
 // than Advance
 void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	Event *ne = GetNewEvent();
+	QueuedEvent *ne = GetNewEvent();
 	ne->userdata = userdata;
 	ne->type = event_type;
 	ne->time = GetTicks() + cyclesIntoFuture;
@@ -317,44 +576,25 @@ void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 s64 UnscheduleEvent(int event_type, u64 userdata)
 {
 	s64 result = 0;
-	if (!first)
-		return result;
-	while(first)
+	QueuedEvent *ev = eventsByKey.Get(MakeEventKey(event_type, userdata));
+	// With duplicates, report the one that would've run last.
+	QueuedEvent *latest = nullptr;
+	while (ev)
 	{
-		if (first->type == event_type && first->userdata == userdata)
-		{
-			result = first->time - GetTicks();
-
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
+		QueuedEvent *next = ev->keyNext;
+		if (!latest || EventBefore(latest, ev))
+			latest = ev;
+		RemoveEventFromQueue(ev);
+		if (ev != latest)
+			FreeEvent(ev);
+		ev = next;
 	}
-	if (!first)
-		return result;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
-	{
-		if (ptr->type == event_type && ptr->userdata == userdata)
-		{
-			result = ptr->time - GetTicks();
 
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+	if (latest)
+	{
+		result = latest->time - GetTicks();
+		FreeEvent(latest);
 	}
-
 	return result;
 }
 
@@ -362,6 +602,7 @@ s64 UnscheduleThreadsafeEvent(int event_type, u64 userdata)
 {
 	s64 result = 0;
 	std::lock_guard<std::mutex> lk(externalEventLock);
+	DrainTsRingToList();
 	if (!tsFirst)
 		return result;
 	while(tsFirst)
@@ -415,57 +656,31 @@ void RegisterMHzChangeCallback(MHzChangeCallback callback) {
 
 bool IsScheduled(int event_type)
 {
-	if (!first)
-		return false;
-	Event *e = first;
-	while (e) {
-		if (e->type == event_type)
-			return true;
-		e = e->next;
-	}
-	return false;
+	return event_type >= 0 && event_type < (int)eventTypeCounts.size() && eventTypeCounts[event_type] > 0;
 }
 
 void RemoveEvent(int event_type)
 {
-	if (!first)
+	if (!IsScheduled(event_type))
 		return;
-	while(first)
+
+	std::vector<QueuedEvent *> matches;
+	for (QueuedEvent *ev : eventHeap)
 	{
-		if (first->type == event_type)
-		{
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
+		if (ev->type == event_type)
+			matches.push_back(ev);
 	}
-	if (!first)
-		return;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
+	for (QueuedEvent *ev : matches)
 	{
-		if (ptr->type == event_type)
-		{
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+		RemoveEventFromQueue(ev);
+		FreeEvent(ev);
 	}
 }
 
 void RemoveThreadsafeEvent(int event_type)
 {
 	std::lock_guard<std::mutex> lk(externalEventLock);
+	DrainTsRingToList();
 	if (!tsFirst)
 	{
 		return;
@@ -517,14 +732,13 @@ void RemoveAllEvents(int event_type)
 //This raise only the events required while the fifo is processing data
 void ProcessFifoWaitEvents()
 {
-	while (first)
+	while (!eventHeap.empty())
 	{
-		if (first->time <= (s64)GetTicks())
+		if (eventHeap[0]->time <= (s64)GetTicks())
 		{
 //			LOG(CPU, "[Scheduler] %s		 (%lld, %lld) ",
 //				first->name ? first->name : "?", (u64)GetTicks(), (u64)first->time);
-			Event* evt = first;
-			first = first->next;
+			QueuedEvent *evt = PopFirstEvent();
 			event_types[evt->type].callback(evt->userdata, (int)(GetTicks() - evt->time));
 			FreeEvent(evt);
 		}
@@ -540,24 +754,29 @@ void MoveEvents()
 	Common::AtomicStoreRelease(hasTsEvents, 0);
 
 	std::lock_guard<std::mutex> lk(externalEventLock);
-	// Move events from async queue into main queue
+	// Move events from async queue into main queue.  The list only holds events that
+	// were queued before anything still in the ring.
 	while (tsFirst)
 	{
 		Event *next = tsFirst->next;
-		AddEventToQueue(tsFirst);
+		QueuedEvent *ne = GetNewEvent();
+		ne->time = tsFirst->time;
+		ne->userdata = tsFirst->userdata;
+		ne->type = tsFirst->type;
+		AddEventToQueue(ne);
+		FreeTsEvent(tsFirst);
 		tsFirst = next;
 	}
 	tsLast = NULL;
 
-	// Move free events to threadsafe pool
-	while(allocatedTsEvents > 0 && eventPool)
-	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		ev->next = eventTsPool;
-		eventTsPool = ev;
-		allocatedTsEvents--;
-	}
+	DrainTsRing([](s64 time, int event_type, u64 userdata) {
+		QueuedEvent *ne = GetNewEvent();
+		ne->time = time;
+		ne->userdata = userdata;
+		ne->type = event_type;
+		AddEventToQueue(ne);
+	});
+	tsOverflowing.store(false, std::memory_order_release);
 }
 
 void ForceCheck()
@@ -585,6 +804,7 @@ void Advance()
 		MoveEvents();
 	ProcessFifoWaitEvents();
 
+	const QueuedEvent *first = FirstEvent();
 	if (!first)
 	{
 		// This should never happen in PPSSPP.
@@ -609,11 +829,9 @@ void Advance()
 
 void LogPendingEvents()
 {
-	Event *ptr = first;
-	while (ptr)
+	for (const QueuedEvent *ptr : SortedEvents())
 	{
-		//INFO_LOG(CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
-		ptr = ptr->next;
+		INFO_LOG(CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
 	}
 }
 
@@ -623,6 +841,7 @@ void Idle(int maxIdle)
 	if (maxIdle != 0 && cyclesDown > maxIdle)
 		cyclesDown = maxIdle;
 
+	const QueuedEvent *first = FirstEvent();
 	if (first && cyclesDown > 0)
 	{
 		int cyclesExecuted = slicelength - currentMIPS->downcount;
@@ -647,10 +866,9 @@ void Idle(int maxIdle)
 
 std::string GetScheduledEventsSummary()
 {
-	Event *ptr = first;
 	std::string text = "Scheduled events\n";
 	text.reserve(1000);
-	while (ptr)
+	for (const QueuedEvent *ptr : SortedEvents())
 	{
 		unsigned int t = ptr->type;
 		if (t >= event_types.size())
@@ -661,7 +879,6 @@ std::string GetScheduledEventsSummary()
 		char temp[512];
 		sprintf(temp, "%s : %i %08x%08x\n", name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
 		text += temp;
-		ptr = ptr->next;
 	}
 	return text;
 }
@@ -682,6 +899,8 @@ void Event_DoStateOld(PointerWrap &p, BaseEvent *ev)
 void DoState(PointerWrap &p)
 {
 	std::lock_guard<std::mutex> lk(externalEventLock);
+	// Threadsafe events are saved in the list format.
+	DrainTsRingToList();
 
 	auto s = p.Section("CoreTiming", 1, 3);
 	if (!s)
@@ -692,14 +911,47 @@ void DoState(PointerWrap &p)
 	// These (should) be filled in later by the modules.
 	event_types.resize(n, EventType(AntiCrashCallback, "INVALID EVENT"));
 
+	// The queue is saved as a linked list in run order, as it used to be one.
+	Event *first = nullptr;
+	if (p.mode != p.MODE_READ) {
+		Event *last = nullptr;
+		for (const QueuedEvent *ev : SortedEvents()) {
+			Event *item = GetNewStateEvent();
+			item->time = ev->time;
+			item->userdata = ev->userdata;
+			item->type = ev->type;
+			item->next = nullptr;
+			if (last)
+				last->next = item;
+			else
+				first = item;
+			last = item;
+		}
+	}
+
 	if (s >= 3) {
-		p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(first, (Event **) NULL);
+		p.DoLinkedList<BaseEvent, GetNewStateEvent, FreeStateEvent, Event_DoState>(first, (Event **) NULL);
 		p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoState>(tsFirst, &tsLast);
 	} else {
-		p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoStateOld>(first, (Event **) NULL);
+		p.DoLinkedList<BaseEvent, GetNewStateEvent, FreeStateEvent, Event_DoStateOld>(first, (Event **) NULL);
 		p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoStateOld>(tsFirst, &tsLast);
 	}
 
+	if (p.mode == p.MODE_READ)
+		ClearPendingEvents();
+	while (first) {
+		if (p.mode == p.MODE_READ) {
+			QueuedEvent *ne = GetNewEvent();
+			ne->time = first->time;
+			ne->userdata = first->userdata;
+			ne->type = first->type;
+			AddEventToQueue(ne);
+		}
+		Event *next = first->next;
+		FreeStateEvent(first);
+		first = next;
+	}
+
 	p.Do(CPU_HZ);
 	p.Do(slicelength);
 	p.Do(globalTimer);
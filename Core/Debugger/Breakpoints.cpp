@@ -15,7 +15,9 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
 #include <mutex>
 
 #include "Common/Log.h"
@@ -36,6 +38,38 @@ static std::mutex memCheckMutex_;
 std::vector<MemCheck> CBreakPoints::memChecks_;
 std::vector<MemCheck *> CBreakPoints::cleanupMemChecks_;
 
+// Indexes memChecks_, addresses are without the cached bit.
+struct MemCheckRangeIndex {
+	u32 start;
+	u32 end;
+	// Largest end of this and all previous entries (sorted by start.)
+	u32 maxEnd;
+	size_t index;
+};
+static std::vector<MemCheckRangeIndex> memCheckRanges_;
+// Checks without an end, which match only their start address.
+static std::vector<std::pair<u32, size_t>> memCheckExact_;
+
+static const int MEMCHECK_PAGE_SHIFT = 12;
+static const u32 MEMCHECK_PAGE_WORDS = (1 << (32 - MEMCHECK_PAGE_SHIFT)) / 32;
+// Widen the watched pages so any access that overlaps a check starts in a marked page.
+static const u32 MEMCHECK_MAX_ACCESS_SIZE = 16;
+static u32 memCheckReadPages_[MEMCHECK_PAGE_WORDS];
+static u32 memCheckWritePages_[MEMCHECK_PAGE_WORDS];
+static bool anyReadMemChecks_ = false;
+static bool anyWriteMemChecks_ = false;
+
+static inline u32 NotCached(u32 val)
+{
+	// Remove the cached part of the address.
+	return val & ~0x40000000;
+}
+
+static void MarkMemCheckPages(u32 *pages, u32 start, u32 last) {
+	for (u64 page = start >> MEMCHECK_PAGE_SHIFT; page <= (last >> MEMCHECK_PAGE_SHIFT); ++page)
+		pages[page >> 5] |= 1 << (page & 31);
+}
+
 void MemCheck::Log(u32 addr, bool write, int size, u32 pc) {
 	if (result & BREAK_ACTION_LOG) {
 		if (logFormat.empty()) {
@@ -388,6 +422,7 @@ void CBreakPoints::AddMemCheck(u32 start, u32 end, MemCheckCondition cond, Break
 		check.result = result;
 
 		memChecks_.push_back(check);
+		RebuildMemCheckIndex();
 		guard.unlock();
 		Update();
 	}
@@ -395,6 +430,7 @@ void CBreakPoints::AddMemCheck(u32 start, u32 end, MemCheckCondition cond, Break
 	{
 		memChecks_[mc].cond = (MemCheckCondition)(memChecks_[mc].cond | cond);
 		memChecks_[mc].result = (BreakAction)(memChecks_[mc].result | result);
+		RebuildMemCheckIndex();
 		guard.unlock();
 		Update();
 	}
@@ -410,6 +446,7 @@ void CBreakPoints::RemoveMemCheck(u32 start, u32 end)
 	if (mc != INVALID_MEMCHECK)
 	{
 		memChecks_.erase(memChecks_.begin() + mc);
+		RebuildMemCheckIndex();
 		guard.unlock();
 		Update();
 	}
@@ -423,6 +460,7 @@ void CBreakPoints::ChangeMemCheck(u32 start, u32 end, MemCheckCondition cond, Br
 	{
 		memChecks_[mc].cond = cond;
 		memChecks_[mc].result = result;
+		RebuildMemCheckIndex();
 		guard.unlock();
 		Update();
 	}
@@ -437,6 +475,7 @@ void CBreakPoints::ClearAllMemChecks()
 	if (!memChecks_.empty())
 	{
 		memChecks_.clear();
+		RebuildMemCheckIndex();
 		guard.unlock();
 		Update();
 	}
@@ -462,12 +501,6 @@ bool CBreakPoints::GetMemCheck(u32 start, u32 end, MemCheck *check) {
 	return false;
 }
 
-static inline u32 NotCached(u32 val)
-{
-	// Remove the cached part of the address.
-	return val & ~0x40000000;
-}
-
 bool CBreakPoints::GetMemCheckInRange(u32 address, int size, MemCheck *check) {
 	std::lock_guard<std::mutex> guard(memCheckMutex_);
 	auto result = GetMemCheckLocked(address, size);
@@ -477,24 +510,89 @@ bool CBreakPoints::GetMemCheckInRange(u32 address, int size, MemCheck *check) {
 }
 
 MemCheck *CBreakPoints::GetMemCheckLocked(u32 address, int size) {
-	std::vector<MemCheck>::iterator iter;
-	for (iter = memChecks_.begin(); iter != memChecks_.end(); ++iter)
-	{
-		MemCheck &check = *iter;
-		if (check.end != 0)
-		{
-			if (NotCached(address + size) > NotCached(check.start) && NotCached(address) < NotCached(check.end))
-				return &check;
+	// Like a linear scan, this returns the first matching check in memChecks_.
+	size_t found = INVALID_MEMCHECK;
+	const u32 lo = NotCached(address);
+	const u32 hi = NotCached(address + size);
+
+	auto exact = std::lower_bound(memCheckExact_.begin(), memCheckExact_.end(), std::make_pair(lo, (size_t)0));
+	if (exact != memCheckExact_.end() && exact->first == lo)
+		found = exact->second;
+
+	// Only ranges starting before hi can match, and we stop once no earlier range ends after lo.
+	auto first = std::lower_bound(memCheckRanges_.begin(), memCheckRanges_.end(), hi, [](const MemCheckRangeIndex &range, u32 v) {
+		return range.start < v;
+	});
+	for (size_t i = first - memCheckRanges_.begin(); i > 0; --i) {
+		const MemCheckRangeIndex &range = memCheckRanges_[i - 1];
+		if (range.maxEnd <= lo)
+			break;
+		if (range.end > lo && range.index < found)
+			found = range.index;
+	}
+
+	return found == INVALID_MEMCHECK ? nullptr : &memChecks_[found];
+}
+
+void CBreakPoints::RebuildMemCheckIndex() {
+	memCheckRanges_.clear();
+	memCheckExact_.clear();
+	memset(memCheckReadPages_, 0, sizeof(memCheckReadPages_));
+	memset(memCheckWritePages_, 0, sizeof(memCheckWritePages_));
+	anyReadMemChecks_ = false;
+	anyWriteMemChecks_ = false;
+
+	for (size_t i = 0; i < memChecks_.size(); ++i) {
+		const MemCheck &check = memChecks_[i];
+		const u32 start = NotCached(check.start);
+		u32 first = start;
+		u32 last = start;
+		if (check.end != 0) {
+			const u32 end = NotCached(check.end);
+			memCheckRanges_.push_back({ start, end, end, i });
+			// A range whose end wrapped can still match a large range, so be conservative.
+			first = std::min(start, end);
+			last = std::max(start, end);
+			if (last > first)
+				last--;
+		} else {
+			memCheckExact_.push_back(std::make_pair(start, i));
 		}
-		else
-		{
-			if (NotCached(check.start) == NotCached(address))
-				return &check;
+		first = first >= MEMCHECK_MAX_ACCESS_SIZE - 1 ? first - (MEMCHECK_MAX_ACCESS_SIZE - 1) : 0;
+
+		if (check.cond & MEMCHECK_READ) {
+			MarkMemCheckPages(memCheckReadPages_, first, last);
+			anyReadMemChecks_ = true;
+		}
+		if (check.cond & MEMCHECK_WRITE) {
+			MarkMemCheckPages(memCheckWritePages_, first, last);
+			anyWriteMemChecks_ = true;
 		}
 	}
 
-	//none found
-	return 0;
+	std::sort(memCheckExact_.begin(), memCheckExact_.end());
+	std::sort(memCheckRanges_.begin(), memCheckRanges_.end(), [](const MemCheckRangeIndex &a, const MemCheckRangeIndex &b) {
+		return a.start < b.start;
+	});
+	u32 maxEnd = 0;
+	for (MemCheckRangeIndex &range : memCheckRanges_) {
+		maxEnd = std::max(maxEnd, range.end);
+		range.maxEnd = maxEnd;
+	}
+}
+
+const u32 *CBreakPoints::GetMemCheckPageBits(bool write) {
+	if (write)
+		return anyWriteMemChecks_ ? memCheckWritePages_ : nullptr;
+	return anyReadMemChecks_ ? memCheckReadPages_ : nullptr;
+}
+
+bool CBreakPoints::IsMemCheckPage(u32 address, bool write) {
+	const u32 *pages = GetMemCheckPageBits(write);
+	if (!pages)
+		return false;
+	const u32 page = NotCached(address) >> MEMCHECK_PAGE_SHIFT;
+	return (pages[page >> 5] & (1 << (page & 31))) != 0;
 }
 
 BreakAction CBreakPoints::ExecMemCheck(u32 address, bool write, int size, u32 pc)
@@ -522,6 +620,9 @@ BreakAction CBreakPoints::ExecOpMemCheck(u32 address, u32 pc)
 	}
 
 	bool write = MIPSAnalyst::IsOpMemoryWrite(pc);
+	if (!IsMemCheckPage(address, write))
+		return BREAK_ACTION_IGNORE;
+
 	std::unique_lock<std::mutex> guard(memCheckMutex_);
 	auto check = GetMemCheckLocked(address, size);
 	if (check) {
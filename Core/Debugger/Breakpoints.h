@@ -169,6 +169,11 @@ class CBreakPoints
 
 	static bool HasMemChecks();
 
+	// Bitmap with one bit per 4KB page (of the address without the cached bit), set where a read
+	// or write might trigger a memcheck. Null when none could. Read by jit code without locking.
+	static const u32 *GetMemCheckPageBits(bool write);
+	static bool IsMemCheckPage(u32 address, bool write);
+
 	static void Update(u32 addr = 0);
 
 	static bool ValidateLogFormat(DebugInterface *cpu, const std::string &fmt);
@@ -179,6 +184,8 @@ class CBreakPoints
 	// Finds exactly, not using a range check.
 	static size_t FindMemCheck(u32 start, u32 end);
 	static MemCheck *GetMemCheckLocked(u32 address, int size);
+	// Must be called (locked) whenever memChecks_ or their conditions change.
+	static void RebuildMemCheckIndex();
 
 	static std::vector<BreakPoint> breakPoints_;
 	static u32 breakSkipFirstAt_;
@@ -15,15 +15,21 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <vector>
+
 #include "Common/StringUtils.h"
+#include "Core/Config.h"
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
 #include "Core/Debugger/Breakpoints.h"
+#include "Core/Debugger/SymbolMap.h"
 #include "Core/Debugger/WebSocket/CPUCoreSubscriber.h"
 #include "Core/Debugger/WebSocket/WebSocketUtils.h"
 #include "Core/HLE/sceKernelThread.h"
 #include "Core/MIPS/MIPS.h"
 #include "Core/MIPS/MIPSDebugInterface.h"
+#include "Core/MIPS/JitCommon/JitBlockCache.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
 
 DebuggerSubscriber *WebSocketCPUCoreInit(DebuggerEventHandlerMap &map) {
 	// No need to bind or alloc state, these are all global.
@@ -34,6 +40,9 @@ DebuggerSubscriber *WebSocketCPUCoreInit(DebuggerEventHandlerMap &map) {
 	map["cpu.getReg"] = &WebSocketCPUGetReg;
 	map["cpu.setReg"] = &WebSocketCPUSetReg;
 	map["cpu.evaluate"] = &WebSocketCPUEvaluate;
+	map["cpu.blockProfile.enable"] = &WebSocketCPUBlockProfileEnable;
+	map["cpu.blockProfile.list"] = &WebSocketCPUBlockProfileList;
+	map["cpu.blockProfile.reset"] = &WebSocketCPUBlockProfileReset;
 
 	return nullptr;
 }
@@ -410,3 +419,109 @@ void WebSocketCPUEvaluate(DebuggerRequest &req) {
 	json.writeUint("uintValue", val);
 	json.writeString("floatValue", RegValueAsFloat(val));
 }
+
+// Turn the jit block profiler on or off (cpu.blockProfile.enable)
+//
+// Parameters:
+//  - enabled: boolean, whether to count block entries and time.
+//
+// Response (same event name) with no extra data.
+//
+// Note: CPU must be stepping.  Clears the jit cache, so blocks are recompiled with or without counters.
+void WebSocketCPUBlockProfileEnable(DebuggerRequest &req) {
+	if (!currentDebugMIPS->isAlive()) {
+		return req.Fail("CPU not started");
+	}
+	if (!Core_IsStepping()) {
+		return req.Fail("CPU currently running (cpu.stepping first)");
+	}
+
+	bool enabled;
+	if (!req.ParamBool("enabled", &enabled))
+		return;
+
+	if (g_Config.bJitBlockProfile != enabled) {
+		g_Config.bJitBlockProfile = enabled;
+		if (MIPSComp::jit)
+			MIPSComp::jit->ClearCache();
+	}
+	req.Respond();
+}
+
+// List the hottest blocks seen by the jit block profiler (cpu.blockProfile.list)
+//
+// Parameters:
+//  - count: optional number of blocks to list, default 50.
+//
+// Response (same event name):
+//  - blocks: array of objects, hottest first, each with properties:
+//     - address: unsigned integer address of the start of the block.
+//     - size: unsigned integer size of the block in bytes.
+//     - entries: number of times the block was entered.
+//     - cycles: number of emulated cycles spent in the block (estimated for native jits.)
+//     - hostMs: estimated milliseconds of host time, or null if not sampled (native jits.)
+//     - function: unsigned integer address of the function containing the block, or null if unknown.
+//     - functionName: string name of that function, or null if unknown.
+//
+// Note: CPU must be stepping.  Blocks are ordered by hostMs where sampled, otherwise by cycles.
+void WebSocketCPUBlockProfileList(DebuggerRequest &req) {
+	if (!currentDebugMIPS->isAlive()) {
+		return req.Fail("CPU not started");
+	}
+	if (!Core_IsStepping()) {
+		return req.Fail("CPU currently running (cpu.stepping first)");
+	}
+
+	uint32_t count = 50;
+	if (!req.ParamU32("count", &count, false, DebuggerParamType::OPTIONAL))
+		return;
+
+	std::vector<JitBlockProfileInfo> profile;
+	MIPSComp::GetHotBlockProfile(profile, count);
+
+	JsonWriter &json = req.Respond();
+	json.pushArray("blocks");
+	for (const JitBlockProfileInfo &info : profile) {
+		json.pushDict();
+		json.writeUint("address", info.originalAddress);
+		json.writeUint("size", info.originalBytes);
+		json.writeFloat("entries", (double)info.profile.entries);
+		json.writeFloat("cycles", (double)info.profile.cycles);
+		if (info.profile.sampledSeconds > 0.0)
+			json.writeFloat("hostMs", info.profile.EstimatedSeconds() * 1000.0);
+		else
+			json.writeNull("hostMs");
+
+		u32 funcStart = g_symbolMap->GetFunctionStart(info.originalAddress);
+		if (funcStart != SymbolMap::INVALID_ADDRESS) {
+			json.writeUint("function", funcStart);
+			json.writeString("functionName", g_symbolMap->GetLabelString(funcStart));
+		} else {
+			json.writeNull("function");
+			json.writeNull("functionName");
+		}
+		json.pop();
+	}
+	json.pop();
+}
+
+// Forget all counts from the jit block profiler (cpu.blockProfile.reset)
+//
+// No parameters.
+//
+// Response (same event name) with no extra data.
+//
+// Note: CPU must be stepping.
+void WebSocketCPUBlockProfileReset(DebuggerRequest &req) {
+	if (!currentDebugMIPS->isAlive()) {
+		return req.Fail("CPU not started");
+	}
+	if (!Core_IsStepping()) {
+		return req.Fail("CPU currently running (cpu.stepping first)");
+	}
+
+	JitBlockCacheDebugInterface *blocks = MIPSComp::jit ? MIPSComp::jit->GetBlockCacheDebugInterface() : nullptr;
+	if (blocks)
+		blocks->ResetBlockProfile();
+	req.Respond();
+}
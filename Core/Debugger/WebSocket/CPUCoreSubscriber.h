@@ -28,3 +28,6 @@ void WebSocketCPUGetAllRegs(DebuggerRequest &req);
 void WebSocketCPUGetReg(DebuggerRequest &req);
 void WebSocketCPUSetReg(DebuggerRequest &req);
 void WebSocketCPUEvaluate(DebuggerRequest &req);
+void WebSocketCPUBlockProfileEnable(DebuggerRequest &req);
+void WebSocketCPUBlockProfileList(DebuggerRequest &req);
+void WebSocketCPUBlockProfileReset(DebuggerRequest &req);
@@ -23,6 +23,7 @@
 #include "base/logging.h"
 #include "base/timeutil.h"
 #include "profiler/profiler.h"
+#include "util/random/rng.h"
 
 #include "Core/Config.h"
 #include "Core/CoreTiming.h"
@@ -42,6 +43,8 @@
 #include "Core/HLE/sceKernelThread.h"
 #include "Core/HLE/sceKernelInterrupt.h"
 #include "Core/HLE/HLE.h"
+#include "GPU/GPU.h"
+#include "GPU/GPUInterface.h"
 
 enum
 {
@@ -66,6 +69,12 @@ static int delayedResultEvent = -1;
 static int hleAfterSyscall = HLE_AFTER_NOTHING;
 static const char *hleAfterSyscallReschedReason;
 static const HLEFunction *latestSyscall = nullptr;
+
+// Timer reads are slow, so when collecting stats only one in this many syscalls is timed, on average.
+// The gap is random so a game calling syscalls in a fixed cycle doesn't always get the same one timed.
+static const int SYSCALL_STATS_SAMPLE_RATE = 16;
+static int syscallStatsCountdown = 0;
+static GMRng syscallStatsRng;
 static int idleOp;
 
 void hleDelayResultFinish(u64 userdata, int cycleslate)
@@ -401,9 +410,9 @@ inline void hleFinishSyscall(const HLEFunction &info)
 	hleAfterSyscallReschedReason = 0;
 }
 
-static void updateSyscallStats(int modulenum, int funcnum, double total)
+static void updateSyscallStats(const HLEFunction *info, double total)
 {
-	const char *name = moduleDB[modulenum].funcTable[funcnum].name;
+	const char *name = info->name;
 	// Ignore this one, especially for msInSyscalls (although that ignores CoreTiming events.)
 	if (0 == strcmp(name, "_sceKernelIdle"))
 		return;
@@ -413,13 +422,14 @@ static void updateSyscallStats(int modulenum, int funcnum, double total)
 		kernelStats.slowestSyscallTime = total;
 		kernelStats.slowestSyscallName = name;
 	}
+	// Only some calls are timed, so scale up to estimate the rest.
+	total *= SYSCALL_STATS_SAMPLE_RATE;
 	kernelStats.msInSyscalls += total;
 
-	KernelStatsSyscall statCall(modulenum, funcnum);
-	auto summedStat = kernelStats.summedMsInSyscalls.find(statCall);
+	auto summedStat = kernelStats.summedMsInSyscalls.find(info);
 	if (summedStat == kernelStats.summedMsInSyscalls.end())
 	{
-		kernelStats.summedMsInSyscalls[statCall] = total;
+		kernelStats.summedMsInSyscalls[info] = total;
 		if (total > kernelStats.summedSlowestSyscallTime)
 		{
 			kernelStats.summedSlowestSyscallTime = total;
@@ -428,7 +438,7 @@ static void updateSyscallStats(int modulenum, int funcnum, double total)
 	}
 	else
 	{
-		double newTotal = kernelStats.summedMsInSyscalls[statCall] += total;
+		double newTotal = summedStat->second += total;
 		if (newTotal > kernelStats.summedSlowestSyscallTime)
 		{
 			kernelStats.summedSlowestSyscallTime = newTotal;
@@ -441,6 +451,9 @@ inline void CallSyscallWithFlags(const HLEFunction *info)
 {
 	latestSyscall = info;
 	const u32 flags = info->flags;
+	// Syscalls may read anything the GE thread writes, so let it catch up.
+	if (gpu && gpu->IsThreaded())
+		gpu->SyncThread();
 
 	if (flags & HLE_CLEAR_STACK_BYTES) {
 		u32 stackStart = __KernelGetCurThreadStackStart();
@@ -466,6 +479,8 @@ inline void CallSyscallWithFlags(const HLEFunction *info)
 inline void CallSyscallWithoutFlags(const HLEFunction *info)
 {
 	latestSyscall = info;
+	if (gpu && gpu->IsThreaded())
+		gpu->SyncThread();
 	info->func();
 
 	if (hleAfterSyscall != HLE_AFTER_NOTHING)
@@ -474,6 +489,35 @@ inline void CallSyscallWithoutFlags(const HLEFunction *info)
 		SetDeadbeefRegs();
 }
 
+static double hleSteppingTime = 0.0;
+void hleSetSteppingTime(double t)
+{
+	hleSteppingTime += t;
+}
+
+// Times about one in every SYSCALL_STATS_SAMPLE_RATE calls, so stats don't need a timer read per syscall.
+template <void (*callFunc)(const HLEFunction *)>
+static void CallSyscallSampled(const HLEFunction *info)
+{
+	if (--syscallStatsCountdown > 0) {
+		callFunc(info);
+		return;
+	}
+
+	// Uniform in [1, 2 * rate - 1], which averages to the rate the totals are scaled by.
+	syscallStatsCountdown = 1 + (int)(syscallStatsRng.R32() % (2 * SYSCALL_STATS_SAMPLE_RATE - 1));
+	time_update();
+	double start = time_now_d();
+	hleSteppingTime = 0.0;
+
+	callFunc(info);
+
+	time_update();
+	double total = time_now_d() - start - hleSteppingTime;
+	hleSteppingTime = 0.0;
+	updateSyscallStats(info, total);
+}
+
 const HLEFunction *GetSyscallFuncPointer(MIPSOpcode op)
 {
 	u32 callno = (op >> 6) & 0xFFFFF; //20 bits
@@ -495,9 +539,6 @@ const HLEFunction *GetSyscallFuncPointer(MIPSOpcode op)
 }
 
 void *GetQuickSyscallFunc(MIPSOpcode op) {
-	if (coreCollectDebugStats)
-		return nullptr;
-
 	const HLEFunction *info = GetSyscallFuncPointer(op);
 	if (!info || !info->func)
 		return nullptr;
@@ -506,26 +547,20 @@ void *GetQuickSyscallFunc(MIPSOpcode op) {
 	// TODO: Do this with a flag?
 	if (op == idleOp)
 		return (void *)info->func;
+	// The jit cache is cleared when stats are toggled, so we can pick the sampled versions here.
+	if (coreCollectDebugStats) {
+		if (info->flags != 0)
+			return (void *)&CallSyscallSampled<&CallSyscallWithFlags>;
+		return (void *)&CallSyscallSampled<&CallSyscallWithoutFlags>;
+	}
 	if (info->flags != 0)
 		return (void *)&CallSyscallWithFlags;
 	return (void *)&CallSyscallWithoutFlags;
 }
 
-static double hleSteppingTime = 0.0;
-void hleSetSteppingTime(double t)
-{
-	hleSteppingTime += t;
-}
-
 void CallSyscall(MIPSOpcode op)
 {
 	PROFILE_THIS_SCOPE("syscall");
-	double start = 0.0;  // need to initialize to fix the race condition where coreCollectDebugStats is enabled in the middle of this func.
-	if (coreCollectDebugStats) {
-		time_update();
-		start = time_now_d();
-	}
-
 	const HLEFunction *info = GetSyscallFuncPointer(op);
 	if (!info) {
 		RETURN(SCE_KERNEL_ERROR_LIBRARY_NOT_YET_LINKED);
@@ -535,6 +570,10 @@ void CallSyscall(MIPSOpcode op)
 	if (info->func) {
 		if (op == idleOp)
 			info->func();
+		else if (coreCollectDebugStats && info->flags != 0)
+			CallSyscallSampled<&CallSyscallWithFlags>(info);
+		else if (coreCollectDebugStats)
+			CallSyscallSampled<&CallSyscallWithoutFlags>(info);
 		else if (info->flags != 0)
 			CallSyscallWithFlags(info);
 		else
@@ -544,16 +583,6 @@ void CallSyscall(MIPSOpcode op)
 		RETURN(SCE_KERNEL_ERROR_LIBRARY_NOT_YET_LINKED);
 		ERROR_LOG_REPORT(HLE, "Unimplemented HLE function %s", info->name ? info->name : "(\?\?\?)");
 	}
-
-	if (coreCollectDebugStats) {
-		time_update();
-		u32 callno = (op >> 6) & 0xFFFFF; //20 bits
-		int funcnum = callno & 0xFFF;
-		int modulenum = (callno & 0xFF000) >> 12;
-		double total = time_now_d() - start - hleSteppingTime;
-		hleSteppingTime = 0.0;
-		updateSyscallStats(modulenum, funcnum, total);
-	}
 }
 
 size_t hleFormatLogArgs(char *message, size_t sz, const char *argmask) {
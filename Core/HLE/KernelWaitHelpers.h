@@ -288,6 +288,12 @@ inline bool ResumeFromWait(SceUID threadID, WaitType waitType, SceUID uid, T res
 	return false;
 }
 
+// Note: waitingThreads are plain vectors of ids (or wait info structs), not intrusive nodes on
+// the Thread, on purpose.  A thread that times out or is released stays listed until the object
+// cleans up (see WaitExecTimeout), because a delete before it runs must still report
+// SCE_KERNEL_ERROR_WAIT_DELETE.  A thread also sits in pausedWaits, not here, during callbacks, and
+// the lists (with per-wait data) are saved as is in each object's state.
+
 // Removes threads that are not waiting anymore from a waitingThreads list.
 template <typename T>
 inline void CleanupWaitingThreads(WaitType waitType, SceUID uid, std::vector<T> &waitingThreads) {
@@ -310,4 +316,42 @@ inline void RemoveWaitingThread(std::vector<T> &waitingThreads, const SceUID thr
 	waitingThreads.erase(std::remove(waitingThreads.begin(), waitingThreads.end(), threadID), waitingThreads.end());
 }
 
+// Get the thread id from a waiting thread info struct.
+template <typename T>
+inline SceUID WaitingThreadID(const T &waitInfo) {
+	return waitInfo.threadID;
+}
+
+template <>
+inline SceUID WaitingThreadID(const SceUID &threadID) {
+	return threadID;
+}
+
+template <typename T>
+inline bool WaitingThreadPriorityLess(const T &a, const T &b) {
+	return __KernelThreadSortPriority(WaitingThreadID(a), WaitingThreadID(b));
+}
+
+// Adds a thread to a waiting list kept in priority order, after any threads of the same priority.
+// This gives the same order as appending and stable sorting, without sorting on every wake.
+// If priorities changed since the list was sorted, this just appends (it'll be sorted before use.)
+template <typename T>
+inline void AddWaitingThreadByPriority(std::vector<T> &waitingThreads, const T &waitInfo) {
+	if (!std::is_sorted(waitingThreads.begin(), waitingThreads.end(), WaitingThreadPriorityLess<T>)) {
+		waitingThreads.push_back(waitInfo);
+		return;
+	}
+	auto pos = std::upper_bound(waitingThreads.begin(), waitingThreads.end(), waitInfo, WaitingThreadPriorityLess<T>);
+	waitingThreads.insert(pos, waitInfo);
+}
+
+// Sorts a waiting list by priority, keeping FIFO order within a priority.
+// Usually the list is already in order (see AddWaitingThreadByPriority), so this is just a check.
+template <typename T>
+inline void SortWaitingThreadsByPriority(std::vector<T> &waitingThreads) {
+	if (!std::is_sorted(waitingThreads.begin(), waitingThreads.end(), WaitingThreadPriorityLess<T>)) {
+		std::stable_sort(waitingThreads.begin(), waitingThreads.end(), WaitingThreadPriorityLess<T>);
+	}
+}
+
 };
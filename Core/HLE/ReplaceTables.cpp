@@ -115,13 +115,9 @@ static int Replace_ceilf() {
 
 // Should probably do JIT versions of this, possibly ones that only delegate
 // large copies to a C function.
-static int Replace_memcpy() {
-	u32 destPtr = PARAM(0);
-	u32 srcPtr = PARAM(1);
-	u32 bytes = PARAM(2);
+int Replacement_Memcpy(u32 destPtr, u32 srcPtr, u32 bytes) {
 	bool skip = false;
 	if (!bytes) {
-		RETURN(destPtr);
 		return 10;
 	}
 
@@ -151,7 +147,6 @@ static int Replace_memcpy() {
 			memmove(dst, src, bytes);
 		}
 	}
-	RETURN(destPtr);
 
 	CBreakPoints::ExecMemCheck(srcPtr, false, bytes, currentMIPS->pc);
 	CBreakPoints::ExecMemCheck(destPtr, true, bytes, currentMIPS->pc);
@@ -159,6 +154,13 @@ static int Replace_memcpy() {
 	return 10 + bytes / 4;  // approximation
 }
 
+static int Replace_memcpy() {
+	u32 destPtr = PARAM(0);
+	int cycles = Replacement_Memcpy(destPtr, PARAM(1), PARAM(2));
+	RETURN(destPtr);
+	return cycles;
+}
+
 static int Replace_memcpy_jak() {
 	u32 destPtr = PARAM(0);
 	u32 srcPtr = PARAM(1);
@@ -295,10 +297,7 @@ static int Replace_memmove() {
 	return 10 + bytes / 4;  // approximation
 }
 
-static int Replace_memset() {
-	u32 destPtr = PARAM(0);
-	u8 value = PARAM(1);
-	u32 bytes = PARAM(2);
+int Replacement_Memset(u32 destPtr, u8 value, u32 bytes) {
 	bool skip = false;
 	if (Memory::IsVRAMAddress(destPtr) && (skipGPUReplacements & (int)GPUReplacementSkip::MEMSET) == 0) {
 		skip = gpu->PerformMemorySet(destPtr, value, bytes);
@@ -309,13 +308,19 @@ static int Replace_memset() {
 			memset(dst, value, bytes);
 		}
 	}
-	RETURN(destPtr);
 
 	CBreakPoints::ExecMemCheck(destPtr, true, bytes, currentMIPS->pc);
 
 	return 10 + bytes / 4;  // approximation
 }
 
+static int Replace_memset() {
+	u32 destPtr = PARAM(0);
+	int cycles = Replacement_Memset(destPtr, PARAM(1), PARAM(2));
+	RETURN(destPtr);
+	return cycles;
+}
+
 static int Replace_memset_jak() {
 	u32 destPtr = PARAM(0);
 	u8 value = PARAM(1);
@@ -1386,6 +1391,14 @@ const ReplacementTableEntry *GetReplacementFunc(int i) {
 	return &entries[i];
 }
 
+ReplacementExpansion GetReplacementExpansion(const ReplacementTableEntry *entry) {
+	if (entry->replaceFunc == &Replace_memcpy)
+		return ReplacementExpansion::MEMCPY;
+	if (entry->replaceFunc == &Replace_memset)
+		return ReplacementExpansion::MEMSET;
+	return ReplacementExpansion::NONE;
+}
+
 static bool WriteReplaceInstruction(u32 address, int index) {
 	u32 prevInstr = Memory::Read_Instruction(address, false).encoding;
 	if (MIPS_IS_REPLACEMENT(prevInstr)) {
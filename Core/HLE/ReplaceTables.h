@@ -66,6 +66,18 @@ int GetNumReplacementFuncs();
 std::vector<int> GetReplacementFuncIndexes(u64 hash, int funcSize);
 const ReplacementTableEntry *GetReplacementFunc(int index);
 
+// A few replacements are simple enough that the IR emits them as ops, so its passes can see
+// which registers they use.  These tell it which ones, and do the work (returning cycles.)
+enum class ReplacementExpansion {
+	NONE,
+	MEMCPY,
+	MEMSET,
+};
+
+ReplacementExpansion GetReplacementExpansion(const ReplacementTableEntry *entry);
+int Replacement_Memcpy(u32 destPtr, u32 srcPtr, u32 bytes);
+int Replacement_Memset(u32 destPtr, u8 value, u32 bytes);
+
 void WriteReplaceInstructions(u32 address, u64 hash, int size);
 void RestoreReplacedInstruction(u32 address);
 void RestoreReplacedInstructions(u32 startAddr, u32 endAddr);
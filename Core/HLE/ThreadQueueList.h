@@ -17,154 +17,164 @@
 
 #pragma once
 
-#include "Core/HLE/sceKernel.h"
+#include <vector>
+
+#include "Common/BitSet.h"
 #include "Common/ChunkFile.h"
+#include "Common/Hashmaps.h"
+#include "Core/HLE/sceKernel.h"
 
 struct ThreadQueueList {
 	// Number of queues (number of priority levels starting at 0.)
 	static const int NUM_QUEUES = 128;
-	// Initial number of threads a single queue can handle.
+	// Initial capacity reported for a queue in savestates.
 	static const int INITIAL_CAPACITY = 32;
 
+	struct Node {
+		SceUID threadID;
+		u32 priority;
+		Node *prev;
+		Node *next;
+		// Other nodes for the same thread.  Normally a thread is only queued once.
+		Node *sameNext;
+	};
+
 	struct Queue {
-		// Next ever-been-used queue (worse priority.)
-		Queue *next;
-		// First valid item in data.
-		int first;
-		// One after last valid item in data.
-		int end;
-		// A too-large array with room on the front and end.
-		SceUID *data;
-		// Size of data array.
+		Node *head;
+		Node *tail;
+		int count;
+		// Zero until the priority level is prepared.  Only kept for the savestate format,
+		// which used to store the size of an array here.
 		int capacity;
 
 		inline int size() const {
-			return end - first;
+			return count;
 		}
 		inline bool empty() const {
-			return first == end;
-		}
-		inline int full() const {
-			return end == capacity;
+			return count == 0;
 		}
 	};
 
-	ThreadQueueList() {
+	ThreadQueueList() : nodes(64) {
 		memset(queues, 0, sizeof(queues));
-		first = invalid();
+		memset(nonEmpty, 0, sizeof(nonEmpty));
 	}
 
 	~ThreadQueueList() {
 		clear();
+		for (Node *node : freeNodes)
+			delete node;
+		freeNodes.clear();
 	}
 
 	// Only for debugging, returns priority level.
 	int contains(const SceUID uid) {
-		for (int i = 0; i < NUM_QUEUES; ++i) {
-			if (queues[i].data == nullptr)
-				continue;
-
-			Queue *cur = &queues[i];
-			for (int j = cur->first; j < cur->end; ++j) {
-				if (cur->data[j] == uid)
-					return i;
-			}
+		int best = -1;
+		for (Node *node = nodes.Get(uid); node != nullptr; node = node->sameNext) {
+			if (best == -1 || (int)node->priority < best)
+				best = (int)node->priority;
 		}
-
-		return -1;
+		return best;
 	}
 
 	inline SceUID pop_first() {
-		Queue *cur = first;
-		while (cur != invalid()) {
-			if (cur->size() > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
-		}
+		int priority = firstNonEmpty(NUM_QUEUES);
+		if (priority >= 0)
+			return popFrom(priority);
 
 		_dbg_assert_msg_(SCEKERNEL, false, "ThreadQueueList should not be empty.");
 		return 0;
 	}
 
 	inline SceUID pop_first_better(u32 priority) {
-		Queue *cur = first;
 		// Don't bother looking past (worse than) this priority.
-		Queue *stop = &queues[priority];
-		while (cur < stop) {
-			if (cur->size() > 0)
-				return cur->data[cur->first++];
-			cur = cur->next;
-		}
-
+		int best = firstNonEmpty(priority);
+		if (best >= 0)
+			return popFrom(best);
 		return 0;
 	}
 
 	inline SceUID peek_first() {
-		Queue *cur = first;
-		while (cur != invalid()) {
-			if (cur->size() > 0)
-				return cur->data[cur->first];
-			cur = cur->next;
-		}
-
+		int priority = firstNonEmpty(NUM_QUEUES);
+		if (priority >= 0)
+			return queues[priority].head->threadID;
 		return 0;
 	}
 
 	inline void push_front(u32 priority, const SceUID threadID) {
+		Node *node = newNode(priority, threadID);
 		Queue *cur = &queues[priority];
-		cur->data[--cur->first] = threadID;
-		// If we ran out of room toward the front, add more room for next time.
-		if (cur->first == 0)
-			rebalance(priority);
+		node->prev = nullptr;
+		node->next = cur->head;
+		if (cur->head)
+			cur->head->prev = node;
+		else
+			cur->tail = node;
+		cur->head = node;
+		added(priority);
 	}
 
 	inline void push_back(u32 priority, const SceUID threadID) {
+		Node *node = newNode(priority, threadID);
 		Queue *cur = &queues[priority];
-		cur->data[cur->end++] = threadID;
-		if (cur->full())
-			rebalance(priority);
+		node->next = nullptr;
+		node->prev = cur->tail;
+		if (cur->tail)
+			cur->tail->next = node;
+		else
+			cur->head = node;
+		cur->tail = node;
+		added(priority);
 	}
 
 	inline void remove(u32 priority, const SceUID threadID) {
-		Queue *cur = &queues[priority];
-		_dbg_assert_msg_(SCEKERNEL, cur->next != nullptr, "ThreadQueueList::Queue should already be linked up.");
-
-		for (int i = cur->first; i < cur->end; ++i) {
-			if (cur->data[i] == threadID) {
-				// How many more after this one?
-				int remaining = cur->end - i;
-				// If there are more, move them into place.
-				if (remaining > 0)
-					memmove(&cur->data[i], &cur->data[i + 1], remaining * sizeof(SceUID));
-
-				// Now we're one shorter.
-				--cur->end;
-				return;
-			}
+		_dbg_assert_msg_(SCEKERNEL, queues[priority].capacity != 0, "ThreadQueueList::Queue should already be linked up.");
+
+		Node *node = nodes.Get(threadID);
+		if (node != nullptr && node->sameNext != nullptr) {
+			// Queued more than once, so remove the first one at this priority, like before.
+			node = queues[priority].head;
+			while (node != nullptr && node->threadID != threadID)
+				node = node->next;
+		} else if (node != nullptr && node->priority != priority) {
+			node = nullptr;
 		}
-
 		// Wasn't there.
+		if (!node)
+			return;
+
+		unlink(node);
+		freeNode(node);
 	}
 
 	inline void rotate(u32 priority) {
 		Queue *cur = &queues[priority];
-		_dbg_assert_msg_(SCEKERNEL, cur->next != nullptr, "ThreadQueueList::Queue should already be linked up.");
+		_dbg_assert_msg_(SCEKERNEL, cur->capacity != 0, "ThreadQueueList::Queue should already be linked up.");
 
 		if (cur->size() > 1) {
 			// Grab the front and push it on the end.
-			cur->data[cur->end++] = cur->data[cur->first++];
-			if (cur->full())
-				rebalance(priority);
+			Node *node = cur->head;
+			cur->head = node->next;
+			cur->head->prev = nullptr;
+			node->prev = cur->tail;
+			node->next = nullptr;
+			cur->tail->next = node;
+			cur->tail = node;
 		}
 	}
 
 	inline void clear() {
 		for (int i = 0; i < NUM_QUEUES; ++i) {
-			if (queues[i].data != nullptr)
-				free(queues[i].data);
+			Node *node = queues[i].head;
+			while (node != nullptr) {
+				Node *next = node->next;
+				freeNodes.push_back(node);
+				node = next;
+			}
 		}
+		nodes.Clear();
 		memset(queues, 0, sizeof(queues));
-		first = invalid();
+		memset(nonEmpty, 0, sizeof(nonEmpty));
 	}
 
 	inline bool empty(u32 priority) const {
@@ -174,8 +184,8 @@ struct ThreadQueueList {
 
 	inline void prepare(u32 priority) {
 		Queue *cur = &queues[priority];
-		if (cur->next == nullptr)
-			link(priority, INITIAL_CAPACITY);
+		if (cur->capacity == 0)
+			cur->capacity = INITIAL_CAPACITY;
 	}
 
 	void DoState(PointerWrap &p) {
@@ -194,6 +204,7 @@ struct ThreadQueueList {
 		if (p.mode == p.MODE_READ)
 			clear();
 
+		std::vector<SceUID> threadIDs;
 		for (int i = 0; i < NUM_QUEUES; ++i) {
 			Queue *cur = &queues[i];
 			int size = cur->size();
@@ -204,86 +215,122 @@ struct ThreadQueueList {
 			if (capacity == 0)
 				continue;
 
-			if (p.mode == p.MODE_READ) {
-				link(i, capacity);
-				cur->first = (cur->capacity - size) / 2;
-				cur->end = cur->first + size;
+			threadIDs.resize(size);
+			if (p.mode != p.MODE_READ) {
+				int n = 0;
+				for (Node *node = cur->head; node != nullptr; node = node->next)
+					threadIDs[n++] = node->threadID;
 			}
 
 			if (size != 0)
-				p.DoArray(&cur->data[cur->first], size);
+				p.DoArray(&threadIDs[0], size);
+
+			if (p.mode == p.MODE_READ) {
+				cur->capacity = capacity;
+				for (int j = 0; j < size; ++j)
+					push_back(i, threadIDs[j]);
+			}
 		}
 	}
 
 private:
-	Queue *invalid() const {
-		return (Queue *)-1;
+	// Returns the best non-empty priority level better than limit, or -1 if none.
+	int firstNonEmpty(u32 limit) const {
+		for (int i = 0; i < NUM_QUEUES / 64; ++i) {
+			u64 bits = nonEmpty[i];
+			int base = i * 64;
+			if ((u32)base >= limit)
+				break;
+			if (limit < (u32)base + 64)
+				bits &= (1ULL << (limit - base)) - 1;
+			if (bits != 0)
+				return base + LeastSignificantSetBit(bits);
+		}
+		return -1;
 	}
 
-	// Initialize a priority level and link to other queues.
-	void link(u32 priority, int size) {
-		_dbg_assert_msg_(SCEKERNEL, queues[priority].data == nullptr, "ThreadQueueList::Queue should only be initialized once.");
-
-		// Make sure we stay a multiple of INITIAL_CAPACITY.
-		if (size <= INITIAL_CAPACITY)
-			size = INITIAL_CAPACITY;
-		else {
-			int goal = size;
-			size = INITIAL_CAPACITY;
-			while (size < goal)
-				size *= 2;
-		}
+	SceUID popFrom(int priority) {
+		Node *node = queues[priority].head;
+		SceUID threadID = node->threadID;
+		unlink(node);
+		freeNode(node);
+		return threadID;
+	}
 
-		// Allocate the queue.
-		Queue *cur = &queues[priority];
-		cur->data = (SceUID *)malloc(sizeof(SceUID) * size);
-		cur->capacity = size;
-		// Start smack in the middle so it can move both directions.
-		cur->first = size / 2;
-		cur->end = size / 2;
-
-		for (int i = (int)priority - 1; i >= 0; --i) {
-			// This queue is before ours, and points past us.
-			// We'll have it point to our new queue, inserting into the chain.
-			if (queues[i].next != nullptr) {
-				cur->next = queues[i].next;
-				queues[i].next = cur;
-				return;
-			}
+	Node *newNode(u32 priority, SceUID threadID) {
+		_dbg_assert_msg_(SCEKERNEL, queues[priority].capacity != 0, "ThreadQueueList::Queue should already be linked up.");
+
+		Node *node;
+		if (!freeNodes.empty()) {
+			node = freeNodes.back();
+			freeNodes.pop_back();
+		} else {
+			node = new Node;
 		}
+		node->threadID = threadID;
+		node->priority = priority;
+
+		// The old arrays allowed the same thread more than once, so this still does.
+		Node *first = nodes.Get(threadID);
+		if (first != nullptr) {
+			node->sameNext = first->sameNext;
+			first->sameNext = node;
+		} else {
+			node->sameNext = nullptr;
+			nodes.Insert(threadID, node);
+		}
+		return node;
+	}
 
-		// Never found above - that means there's no better queue yet.
-		// The new one is now first, and whoever was first is after it.
-		cur->next = first;
-		first = cur;
+	void freeNode(Node *node) {
+		Node *first = nodes.Get(node->threadID);
+		if (first == node) {
+			nodes.Remove(node->threadID);
+			if (node->sameNext != nullptr)
+				nodes.Insert(node->threadID, node->sameNext);
+			else
+				nodes.Maintain();
+		} else {
+			Node *prev = first;
+			while (prev->sameNext != node)
+				prev = prev->sameNext;
+			prev->sameNext = node->sameNext;
+		}
+		freeNodes.push_back(node);
 	}
 
-	// Move or allocate as necessary to maintain free space on both sides.
-	void rebalance(u32 priority) {
+	void added(u32 priority) {
 		Queue *cur = &queues[priority];
-		int size = cur->size();
-		// Basically full.  Time for a larger queue?
-		if (size >= cur->capacity - 2) {
-			int new_capacity = cur->capacity * 2;
-			SceUID *new_data = (SceUID *)realloc(cur->data, new_capacity * sizeof(SceUID));
-			if (new_data != nullptr) {
-				// Success, it's bigger now.
-				cur->capacity = new_capacity;
-				cur->data = new_data;
-			}
-		}
+		cur->count++;
+		if (cur->capacity == 0)
+			cur->capacity = INITIAL_CAPACITY;
+		// Grow like the old array did, so older versions can load our states.
+		while (cur->count >= cur->capacity - 2)
+			cur->capacity *= 2;
+		nonEmpty[priority / 64] |= 1ULL << (priority & 63);
+	}
 
-		// If we center all the items, it should start here.
-		int newFirst = (cur->capacity - size) / 2;
-		if (newFirst != cur->first) {
-			memmove(&cur->data[newFirst], &cur->data[cur->first], size * sizeof(SceUID));
-			cur->first = newFirst;
-			cur->end = newFirst + size;
-		}
+	// Takes the node out of its queue, but keeps it in the thread index.
+	void unlink(Node *node) {
+		Queue *cur = &queues[node->priority];
+		if (node->prev)
+			node->prev->next = node->next;
+		else
+			cur->head = node->next;
+		if (node->next)
+			node->next->prev = node->prev;
+		else
+			cur->tail = node->prev;
+
+		if (--cur->count == 0)
+			nonEmpty[node->priority / 64] &= ~(1ULL << (node->priority & 63));
 	}
 
-	// The first queue that's ever been used.
-	Queue *first;
-	// The priority level queues of thread ids.
+	// The priority level queues of threads.
 	Queue queues[NUM_QUEUES];
+	// One bit per priority level with any threads queued.
+	u64 nonEmpty[NUM_QUEUES / 64];
+	// Finds the queued node for a thread.
+	DenseHashMap<SceUID, Node *, nullptr> nodes;
+	std::vector<Node *> freeNodes;
 };
@@ -16,7 +16,14 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <algorithm>
-
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "thread/threadutil.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/FunctionWrappers.h"
 #include "Core/MIPS/MIPS.h"
@@ -28,6 +35,7 @@
 #include "Core/HW/MediaEngine.h"
 #include "Core/HW/BufferQueue.h"
 #include "Common/ChunkFile.h"
+#include "ext/xxhash.h"
 
 #include "Core/HLE/sceKernel.h"
 #include "Core/HLE/sceUtility.h"
@@ -153,6 +161,7 @@ struct InputBuffer {
 struct Atrac;
 int __AtracSetContext(Atrac *atrac);
 void _AtracGenerateContext(Atrac *atrac, SceAtracId *context);
+static void __AtracCacheShutdown();
 
 struct AtracLoopInfo {
 	int cuePointID;
@@ -171,6 +180,46 @@ struct AVPacket {
 };
 #endif
 
+#ifdef USE_FFMPEG
+// What the decoder produced for one packet, as kept by the loop cache.
+struct AtracCachedPacket {
+	u32 offset;
+	AtracDecodeResult result;
+	int samples;
+	// Start of the converted samples in AtracCachedSegment::pcm.
+	size_t pcmOffset;
+};
+
+// A loop segment decoded by the cache thread, from the loop start onward.
+struct AtracCachedSegment {
+	std::vector<AtracCachedPacket> packets;
+	std::vector<s16> pcm;
+	// Packets decoded before packets[0], same as Atrac::PrefillDecoder().
+	u32 prefillStart;
+	u32 prefillEnd;
+	int outputChannels;
+	size_t reservedBytes;
+	u64 lastUse;
+	bool done;
+	bool failed;
+};
+
+static void __AtracFreeCodecContext(AVCodecContext **codecCtx) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55, 52, 0)
+	// If necessary, extradata is automatically freed.
+	avcodec_free_context(codecCtx);
+#else
+	// Future versions may add other things to free, but avcodec_free_context didn't exist yet here.
+	// Some old versions crash when we try to free extradata and subtitle_header, so let's not. A minor
+	// leak is better than a segfualt.
+	// av_freep(&codecCtx_->extradata);
+	// av_freep(&codecCtx_->subtitle_header);
+	avcodec_close(*codecCtx);
+	av_freep(codecCtx);
+#endif
+}
+#endif // USE_FFMPEG
+
 struct Atrac {
 	Atrac() : atracID_(-1), dataBuf_(0), decodePos_(0), bufferPos_(0),
 		channels_(0), outputChannels_(2), bitrate_(64), bytesPerFrame_(0), bufferMaxSize_(0), jointStereo_(0),
@@ -438,6 +487,12 @@ struct Atrac {
 	SwrContext      *swrCtx_ = nullptr;
 	AVFrame         *frame_ = nullptr;
 	AVPacket        *packet_ = nullptr;
+
+	// Set while a loop plays back from the cache, rather than the decoder.
+	std::shared_ptr<AtracCachedSegment> cachedSegment_;
+	size_t cachedPacketIndex_ = 0;
+	// Set when the last decoded packet came from the cache.
+	const AtracCachedPacket *cachedPacket_ = nullptr;
 #endif // USE_FFMPEG
 
 #ifdef USE_FFMPEG
@@ -445,18 +500,8 @@ struct Atrac {
 		// All of these allow null pointers.
 		av_freep(&frame_);
 		swr_free(&swrCtx_);
-#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(55, 52, 0)
-		// If necessary, extradata is automatically freed.
-		avcodec_free_context(&codecCtx_);
-#else
-		// Future versions may add other things to free, but avcodec_free_context didn't exist yet here.
-		// Some old versions crash when we try to free extradata and subtitle_header, so let's not. A minor
-		// leak is better than a segfualt.
-		// av_freep(&codecCtx_->extradata);
-		// av_freep(&codecCtx_->subtitle_header);
-		avcodec_close(codecCtx_);
-		av_freep(&codecCtx_);
-#endif
+		__AtracFreeCodecContext(&codecCtx_);
+		EndCachedRun();
 #if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 12, 100)
 		av_packet_free(&packet_);
 #else
@@ -470,6 +515,7 @@ struct Atrac {
 	void ForceSeekToSample(int sample) {
 #ifdef USE_FFMPEG
 		avcodec_flush_buffers(codecCtx_);
+		EndCachedRun();
 
 		// Discard any pending packet data.
 		packet_->size = 0;
@@ -487,38 +533,58 @@ struct Atrac {
 		// Discard any pending packet data.
 		packet_->size = 0;
 
-		// It seems like the PSP aligns the sample position to 0x800...?
-		const u32 offsetSamples = firstSampleOffset_ + FirstOffsetExtra();
-		const u32 unalignedSamples = (offsetSamples + sample) % SamplesPerFrame();
-		int seekFrame = sample + offsetSamples - unalignedSamples;
-
 		if ((sample != currentSample_ || sample == 0) && codecCtx_ != nullptr) {
-			// Prefill the decode buffer with packets before the first sample offset.
-			avcodec_flush_buffers(codecCtx_);
-
-			int adjust = 0;
-			if (sample == 0) {
-				int offsetSamples = firstSampleOffset_ + FirstOffsetExtra();
-				adjust = -(int)(offsetSamples % SamplesPerFrame());
-			}
-			const u32 off = FileOffsetBySample(sample + adjust);
-			const u32 backfill = bytesPerFrame_ * 2;
-			const u32 start = off - dataOff_ < backfill ? dataOff_ : off - backfill;
-			for (u32 pos = start; pos < off; pos += bytesPerFrame_) {
-				av_init_packet(packet_);
-				packet_->data = BufferStart() + pos;
-				packet_->size = bytesPerFrame_;
-				packet_->pos = pos;
-
-				// Process the packet, we don't care about success.
-				DecodePacket();
-			}
+			PrefillDecoder(sample);
+			StartCachedRun(sample);
 		}
 #endif // USE_FFMPEG
 
 		currentSample_ = sample;
 	}
 
+	// Range of packets fed to the decoder before decoding from sample.
+	void PrefillRange(int sample, u32 *start, u32 *end) const {
+		int adjust = 0;
+		if (sample == 0) {
+			int offsetSamples = firstSampleOffset_ + FirstOffsetExtra();
+			adjust = -(int)(offsetSamples % SamplesPerFrame());
+		}
+		const u32 off = FileOffsetBySample(sample + adjust);
+		const u32 backfill = bytesPerFrame_ * 2;
+		*start = off - dataOff_ < backfill ? dataOff_ : off - backfill;
+		*end = off;
+	}
+
+#ifdef USE_FFMPEG
+	void PrefillDecoder(int sample) {
+		// Prefill the decode buffer with packets before the first sample offset.
+		u32 start, end;
+		PrefillRange(sample, &start, &end);
+		PrefillPackets(start, end);
+	}
+
+	void PrefillPackets(u32 start, u32 end) {
+		avcodec_flush_buffers(codecCtx_);
+		for (u32 pos = start; pos < end; pos += bytesPerFrame_) {
+			av_init_packet(packet_);
+			packet_->data = BufferStart() + pos;
+			packet_->size = bytesPerFrame_;
+			packet_->pos = pos;
+
+			// Process the packet, we don't care about success.
+			DecodePacket();
+		}
+	}
+
+	void StartCachedRun(int sample);
+	void EndCachedRun() {
+		cachedSegment_.reset();
+		cachedPacketIndex_ = 0;
+		cachedPacket_ = nullptr;
+	}
+	void ResyncFromCache();
+#endif // USE_FFMPEG
+
 	bool FillPacket(int adjust = 0) {
 		u32 off = FileOffsetBySample(currentSample_ + adjust);
 		if (off < first_.size) {
@@ -578,6 +644,9 @@ struct Atrac {
 #endif // USE_FFMPEG
 	}
 
+	// Like DecodePacket(), but uses the loop cache when it has this packet.
+	AtracDecodeResult DecodeNextPacket();
+
 	void CalculateStreamInfo(u32 *readOffset);
 
 	u32 StreamBufferEnd() const {
@@ -664,6 +733,7 @@ void __AtracShutdown() {
 		delete atracIDs[i];
 		atracIDs[i] = NULL;
 	}
+	__AtracCacheShutdown();
 }
 
 static Atrac *getAtrac(int atracID) {
@@ -1183,7 +1253,7 @@ u32 _AtracDecodeData(int atracID, u8 *outbuf, u32 outbufPtr, u32 *SamplesNum, u3
 
 				AtracDecodeResult res = ATDECODE_FEEDME;
 				while (atrac->FillPacket(-skipSamples)) {
-					res = atrac->DecodePacket();
+					res = atrac->DecodeNextPacket();
 					if (res == ATDECODE_FAILED) {
 						*SamplesNum = 0;
 						*finish = 1;
@@ -1193,9 +1263,11 @@ u32 _AtracDecodeData(int atracID, u8 *outbuf, u32 outbufPtr, u32 *SamplesNum, u3
 					if (res == ATDECODE_GOTFRAME) {
 #ifdef USE_FFMPEG
 						// got a frame
-						int skipped = std::min(skipSamples, atrac->frame_->nb_samples);
+						const AtracCachedPacket *cached = atrac->cachedPacket_;
+						int frameSamples = cached ? cached->samples : atrac->frame_->nb_samples;
+						int skipped = std::min(skipSamples, frameSamples);
 						skipSamples -= skipped;
-						numSamples = atrac->frame_->nb_samples - skipped;
+						numSamples = frameSamples - skipped;
 
 						// If we're at the end, clamp to samples we want.  It always returns a full chunk.
 						numSamples = std::min(maxSamples, numSamples);
@@ -1205,7 +1277,15 @@ u32 _AtracDecodeData(int atracID, u8 *outbuf, u32 outbufPtr, u32 *SamplesNum, u3
 							res = ATDECODE_FEEDME;
 						}
 
-						if (outbuf != NULL && numSamples != 0) {
+						if (outbuf != NULL && numSamples != 0 && cached) {
+							// Already converted, just copy out the part we want.
+							const s16 *pcm = &atrac->cachedSegment_->pcm[cached->pcmOffset + skipped * atrac->outputChannels_];
+							u32 outBytes = numSamples * atrac->outputChannels_ * sizeof(s16);
+							memcpy(outbuf, pcm, outBytes);
+							if (outbufPtr != 0) {
+								CBreakPoints::ExecMemCheck(outbufPtr, true, outBytes, currentMIPS->pc);
+							}
+						} else if (outbuf != NULL && numSamples != 0) {
 							int inbufOffset = 0;
 							if (skipped != 0) {
 								AVSampleFormat fmt = (AVSampleFormat)atrac->frame_->format;
@@ -1752,89 +1832,415 @@ static u32 sceAtracResetPlayPosition(int atracID, int sample, int bytesWrittenFi
 }
 
 #ifdef USE_FFMPEG
-static int __AtracUpdateOutputMode(Atrac *atrac, int wanted_channels) {
-	if (atrac->swrCtx_ && atrac->outputChannels_ == wanted_channels)
-		return 0;
-	atrac->outputChannels_ = wanted_channels;
+static int __AtracInitResampler(SwrContext **swrCtx, int wanted_channels, int channels, const AVCodecContext *codecCtx) {
 	int64_t wanted_channel_layout = av_get_default_channel_layout(wanted_channels);
-	int64_t dec_channel_layout = av_get_default_channel_layout(atrac->channels_);
+	int64_t dec_channel_layout = av_get_default_channel_layout(channels);
 
-	atrac->swrCtx_ =
+	*swrCtx =
 		swr_alloc_set_opts
 		(
-			atrac->swrCtx_,
+			*swrCtx,
 			wanted_channel_layout,
 			AV_SAMPLE_FMT_S16,
-			atrac->codecCtx_->sample_rate,
+			codecCtx->sample_rate,
 			dec_channel_layout,
-			atrac->codecCtx_->sample_fmt,
-			atrac->codecCtx_->sample_rate,
+			codecCtx->sample_fmt,
+			codecCtx->sample_rate,
 			0,
 			NULL
 		);
-	if (!atrac->swrCtx_) {
+	if (!*swrCtx) {
 		ERROR_LOG(ME, "swr_alloc_set_opts: Could not allocate resampler context");
 		return -1;
 	}
-	if (swr_init(atrac->swrCtx_) < 0) {
+	if (swr_init(*swrCtx) < 0) {
 		ERROR_LOG(ME, "swr_init: Failed to initialize the resampling context");
 		return -1;
 	}
 	return 0;
 }
-#endif // USE_FFMPEG
-
-int __AtracSetContext(Atrac *atrac) {
-#ifdef USE_FFMPEG
-	InitFFmpeg();
 
-	AVCodecID ff_codec;
-	if (atrac->codecType_ == PSP_MODE_AT_3) {
-		ff_codec = AV_CODEC_ID_ATRAC3;
-	} else if (atrac->codecType_ == PSP_MODE_AT_3_PLUS) {
-		ff_codec = AV_CODEC_ID_ATRAC3P;
-	} else {
-		return hleReportError(ME, ATRAC_ERROR_UNKNOWN_FORMAT, "unknown codec type in set context");
-	}
+static int __AtracUpdateOutputMode(Atrac *atrac, int wanted_channels) {
+	if (atrac->swrCtx_ && atrac->outputChannels_ == wanted_channels)
+		return 0;
+	atrac->outputChannels_ = wanted_channels;
+	return __AtracInitResampler(&atrac->swrCtx_, wanted_channels, atrac->channels_, atrac->codecCtx_);
+}
 
+// Expects a valid codec type and 1 or 2 channels.
+static int __AtracOpenCodec(AVCodecContext **codecCtx, u32 codecType, int channels, int jointStereo, u16 bytesPerFrame) {
+	AVCodecID ff_codec = codecType == PSP_MODE_AT_3 ? AV_CODEC_ID_ATRAC3 : AV_CODEC_ID_ATRAC3P;
 	const AVCodec *codec = avcodec_find_decoder(ff_codec);
-	atrac->codecCtx_ = avcodec_alloc_context3(codec);
+	AVCodecContext *ctx = avcodec_alloc_context3(codec);
+	*codecCtx = ctx;
 
-	if (atrac->codecType_ == PSP_MODE_AT_3) {
+	if (codecType == PSP_MODE_AT_3) {
 		// For ATRAC3, we need the "extradata" in the RIFF header.
-		atrac->codecCtx_->extradata = (uint8_t *)av_mallocz(14);
-		atrac->codecCtx_->extradata_size = 14;
+		ctx->extradata = (uint8_t *)av_mallocz(14);
+		ctx->extradata_size = 14;
 
 		// We don't pull this from the RIFF so that we can support OMA also.
 		// The only thing that changes are the jointStereo_ values.
-		atrac->codecCtx_->extradata[0] = 1;
-		atrac->codecCtx_->extradata[3] = atrac->channels_ << 3;
-		atrac->codecCtx_->extradata[6] = atrac->jointStereo_;
-		atrac->codecCtx_->extradata[8] = atrac->jointStereo_;
-		atrac->codecCtx_->extradata[10] = 1;
+		ctx->extradata[0] = 1;
+		ctx->extradata[3] = channels << 3;
+		ctx->extradata[6] = jointStereo;
+		ctx->extradata[8] = jointStereo;
+		ctx->extradata[10] = 1;
 	}
 
 	// Appears we need to force mono in some cases. (See CPkmn's comments in issue #4248)
-	if (atrac->channels_ == 1) {
-		atrac->codecCtx_->channels = 1;
-		atrac->codecCtx_->channel_layout = AV_CH_LAYOUT_MONO;
-	} else if (atrac->channels_ == 2) {
-		atrac->codecCtx_->channels = 2;
-		atrac->codecCtx_->channel_layout = AV_CH_LAYOUT_STEREO;
+	if (channels == 1) {
+		ctx->channels = 1;
+		ctx->channel_layout = AV_CH_LAYOUT_MONO;
 	} else {
-		return hleReportError(ME, ATRAC_ERROR_UNKNOWN_FORMAT, "unknown channel layout in set context");
+		ctx->channels = 2;
+		ctx->channel_layout = AV_CH_LAYOUT_STEREO;
 	}
 
 	// Explicitly set the block_align value (needed by newer FFmpeg versions, see #5772.)
-	if (atrac->codecCtx_->block_align == 0) {
-		atrac->codecCtx_->block_align = atrac->bytesPerFrame_;
+	if (ctx->block_align == 0) {
+		ctx->block_align = bytesPerFrame;
 	}
 	// Only one supported, it seems?
-	atrac->codecCtx_->sample_rate = 44100;
+	ctx->sample_rate = 44100;
+
+	ctx->request_sample_fmt = AV_SAMPLE_FMT_S16;
+	return avcodec_open2(ctx, codec, nullptr);
+}
+#endif // USE_FFMPEG
+
+// Looping BGM decodes the same packets over and over.  The first time a loop starts, a thread
+// decodes the whole loop into PCM, and later passes through the loop just copy from that.
+#ifdef USE_FFMPEG
+// Limit on decoded audio kept around, across all loops.
+static const size_t ATRAC_CACHE_MAX_BYTES = 64 * 1024 * 1024;
+
+struct AtracCacheJob {
+	std::shared_ptr<AtracCachedSegment> segment;
+	// Copy of the file data from dataStart on.
+	std::vector<u8> data;
+	u32 dataStart;
+	u32 prefillStart;
+	u32 prefillEnd;
+	u32 firstPacket;
+	u32 codecType;
+	int channels;
+	int jointStereo;
+	u16 bytesPerFrame;
+};
+
+static std::mutex atracCacheLock;
+static std::condition_variable atracCacheCond;
+static std::map<u64, std::shared_ptr<AtracCachedSegment>> atracCache;
+static std::deque<AtracCacheJob *> atracCacheJobs;
+static std::thread *atracCacheThread;
+static bool atracCacheThreadStop;
+static size_t atracCacheBytes;
+static u64 atracCacheUseCounter;
+
+static void __AtracCacheDecode(AtracCacheJob *job) {
+	AtracCachedSegment *segment = job->segment.get();
+	AVCodecContext *codecCtx = nullptr;
+	SwrContext *swrCtx = nullptr;
+	AVFrame *frame = av_frame_alloc();
+
+	bool success = __AtracOpenCodec(&codecCtx, job->codecType, job->channels, job->jointStereo, job->bytesPerFrame) >= 0;
+	success = success && __AtracInitResampler(&swrCtx, segment->outputChannels, job->channels, codecCtx) >= 0;
+
+	const u32 dataEnd = job->dataStart + (u32)job->data.size();
+	auto decode = [&](u32 pos, u32 size, int *gotFrame) {
+		AVPacket packet;
+		av_init_packet(&packet);
+		packet.data = &job->data[pos - job->dataStart];
+		packet.size = size;
+		packet.pos = pos;
+		*gotFrame = 0;
+		return avcodec_decode_audio4(codecCtx, frame, gotFrame, &packet);
+	};
+
+	// Same as Atrac::PrefillDecoder(), so we start from the same state.
+	for (u32 pos = job->prefillStart; success && pos < job->prefillEnd; pos += job->bytesPerFrame) {
+		int gotFrame;
+		decode(pos, job->bytesPerFrame, &gotFrame);
+	}
+
+	u32 pos = job->firstPacket;
+	int feedCount = 0;
+	segment->pcm.reserve(segment->reservedBytes / sizeof(s16));
+	while (success && pos < dataEnd) {
+		int gotFrame;
+		int bytesRead = decode(pos, std::min((u32)job->bytesPerFrame, dataEnd - pos), &gotFrame);
+
+		AtracCachedPacket cached;
+		cached.offset = pos;
+		cached.samples = 0;
+		cached.pcmOffset = segment->pcm.size();
+		if (bytesRead == AVERROR_PATCHWELCOME) {
+			cached.result = ATDECODE_BADFRAME;
+		} else if (bytesRead < 0) {
+			cached.result = ATDECODE_FAILED;
+		} else if (gotFrame) {
+			cached.result = ATDECODE_GOTFRAME;
+			cached.samples = frame->nb_samples;
+			segment->pcm.resize(cached.pcmOffset + frame->nb_samples * segment->outputChannels);
+
+			u8 *out = (u8 *)&segment->pcm[cached.pcmOffset];
+			const u8 *inbuf[2] = {
+				frame->extended_data[0],
+				frame->extended_data[1],
+			};
+			if (swr_convert(swrCtx, &out, frame->nb_samples, inbuf, frame->nb_samples) < 0) {
+				success = false;
+			}
+		} else {
+			cached.result = ATDECODE_FEEDME;
+		}
+		segment->packets.push_back(cached);
+
+		if (cached.result == ATDECODE_FAILED) {
+			break;
+		} else if (cached.result == ATDECODE_FEEDME) {
+			// _AtracDecodeData() feeds the same packet again until it gets a frame.
+			if (++feedCount >= 8)
+				break;
+		} else {
+			feedCount = 0;
+			pos += job->bytesPerFrame;
+		}
+	}
+
+	av_frame_free(&frame);
+	swr_free(&swrCtx);
+	__AtracFreeCodecContext(&codecCtx);
+
+	std::lock_guard<std::mutex> guard(atracCacheLock);
+	segment->failed = !success;
+	segment->done = true;
+	atracCacheCond.notify_all();
+}
+
+static void __AtracCacheThread() {
+	setCurrentThreadName("AtracCache");
+
+	std::unique_lock<std::mutex> guard(atracCacheLock);
+	while (!atracCacheThreadStop) {
+		if (atracCacheJobs.empty()) {
+			atracCacheCond.wait(guard);
+			continue;
+		}
+
+		AtracCacheJob *job = atracCacheJobs.front();
+		atracCacheJobs.pop_front();
+		guard.unlock();
+		__AtracCacheDecode(job);
+		delete job;
+		guard.lock();
+	}
+}
+
+// Must be called with atracCacheLock held.
+static bool __AtracCacheMakeRoom(size_t bytes) {
+	while (atracCacheBytes + bytes > ATRAC_CACHE_MAX_BYTES) {
+		auto oldest = atracCache.end();
+		for (auto it = atracCache.begin(); it != atracCache.end(); ++it) {
+			if (it->second->done && (oldest == atracCache.end() || it->second->lastUse < oldest->second->lastUse))
+				oldest = it;
+		}
+		if (oldest == atracCache.end())
+			return false;
+		// Anyone still playing it keeps their reference.
+		atracCacheBytes -= oldest->second->reservedBytes;
+		atracCache.erase(oldest);
+	}
+	return true;
+}
+#endif // USE_FFMPEG
+
+static void __AtracCacheShutdown() {
+#ifdef USE_FFMPEG
+	std::unique_lock<std::mutex> guard(atracCacheLock);
+	atracCacheThreadStop = true;
+	atracCacheCond.notify_all();
+	guard.unlock();
+
+	if (atracCacheThread) {
+		atracCacheThread->join();
+		delete atracCacheThread;
+		atracCacheThread = nullptr;
+	}
+
+	guard.lock();
+	for (AtracCacheJob *job : atracCacheJobs)
+		delete job;
+	atracCacheJobs.clear();
+	atracCache.clear();
+	atracCacheBytes = 0;
+	atracCacheThreadStop = false;
+#endif // USE_FFMPEG
+}
+
+#ifdef USE_FFMPEG
+void Atrac::StartCachedRun(int sample) {
+	EndCachedRun();
+
+	// Only worth it when we'll come back here, and the data can't change under us.
+	const int loopStart = loopStartSample_ - (int)FirstOffsetExtra() - firstSampleOffset_;
+	const int loopEnd = loopEndSample_ - (int)FirstOffsetExtra() - firstSampleOffset_;
+	if (!g_Config.bAtracLoopCache || bufferState_ != ATRAC_STATUS_ALL_DATA_LOADED || loopNum_ == 0 || loopEndSample_ <= 0 || sample != loopStart) {
+		return;
+	}
+
+	u32 prefillStart, prefillEnd;
+	PrefillRange(sample, &prefillStart, &prefillEnd);
+	// This is where _AtracDecodeData() will read from after the seek.
+	const int skipSamples = (firstSampleOffset_ + FirstOffsetExtra() + sample) % SamplesPerFrame();
+	const u32 firstPacket = FileOffsetBySample(sample - skipSamples);
+	const u32 dataStart = std::min(prefillStart, firstPacket);
+	const u32 dataEnd = std::min(FileOffsetBySample(loopEnd) + bytesPerFrame_ * 2, first_.size);
+	if (firstPacket >= dataEnd || prefillEnd + bytesPerFrame_ > dataEnd) {
+		return;
+	}
+	if (ignoreDataBuf_ && !Memory::IsValidRange(first_.addr, dataEnd)) {
+		return;
+	}
+
+	struct {
+		u32 codecType;
+		u32 channels;
+		u32 jointStereo;
+		u32 bytesPerFrame;
+		u32 outputChannels;
+		u32 prefillStart;
+		u32 prefillEnd;
+		u32 firstPacket;
+		u32 dataEnd;
+	} params = { codecType_, channels_, (u32)jointStereo_, bytesPerFrame_, outputChannels_, prefillStart, prefillEnd, firstPacket, dataEnd };
+	const u8 *data = BufferStart() + dataStart;
+	const u64 key = XXH64(data, dataEnd - dataStart, XXH64(&params, sizeof(params), 0));
+
+	std::unique_lock<std::mutex> guard(atracCacheLock);
+	auto it = atracCache.find(key);
+	if (it != atracCache.end()) {
+		std::shared_ptr<AtracCachedSegment> segment = it->second;
+		// Still decoding, so just use the decoder for this pass rather than wait on it.
+		if (!segment->done)
+			return;
+		segment->lastUse = ++atracCacheUseCounter;
+		if (!segment->failed)
+			cachedSegment_ = segment;
+		return;
+	}
+
+	// First time through this loop.  Decode it in the background for the next time.
+	const size_t packets = (dataEnd - firstPacket) / bytesPerFrame_ + 1;
+	const size_t bytes = packets * SamplesPerFrame() * outputChannels_ * sizeof(s16);
+	if (!__AtracCacheMakeRoom(bytes)) {
+		return;
+	}
+
+	std::shared_ptr<AtracCachedSegment> segment = std::make_shared<AtracCachedSegment>();
+	segment->prefillStart = prefillStart;
+	segment->prefillEnd = prefillEnd;
+	segment->outputChannels = outputChannels_;
+	segment->reservedBytes = bytes;
+	segment->lastUse = ++atracCacheUseCounter;
+	segment->done = false;
+	segment->failed = false;
+	atracCache[key] = segment;
+	atracCacheBytes += bytes;
+
+	AtracCacheJob *job = new AtracCacheJob();
+	job->segment = segment;
+	job->data.assign(data, data + (dataEnd - dataStart));
+	job->dataStart = dataStart;
+	job->prefillStart = prefillStart;
+	job->prefillEnd = prefillEnd;
+	job->firstPacket = firstPacket;
+	job->codecType = codecType_;
+	job->channels = channels_;
+	job->jointStereo = jointStereo_;
+	job->bytesPerFrame = bytesPerFrame_;
+	atracCacheJobs.push_back(job);
+
+	if (!atracCacheThread)
+		atracCacheThread = new std::thread(&__AtracCacheThread);
+	atracCacheCond.notify_all();
+}
+
+void Atrac::ResyncFromCache() {
+	std::shared_ptr<AtracCachedSegment> segment = cachedSegment_;
+	const size_t skippedPackets = cachedPacketIndex_;
+	EndCachedRun();
+	if (skippedPackets == 0) {
+		// The decoder hasn't missed anything yet.
+		return;
+	}
+
+	// The decoder sat idle while the cache played.  Replay everything it would have decoded
+	// since the seek, so it continues in exactly the same state as without the cache.  That
+	// way, whether the cache was ready in time never changes the samples.
+	uint8_t *data = packet_->data;
+	int size = packet_->size;
+	int64_t pos = packet_->pos;
+
+	PrefillPackets(segment->prefillStart, segment->prefillEnd);
+	for (size_t i = 0; i < skippedPackets; ++i) {
+		const u32 off = segment->packets[i].offset;
+		av_init_packet(packet_);
+		packet_->data = BufferStart() + off;
+		packet_->size = std::min((u32)bytesPerFrame_, first_.size - off);
+		packet_->pos = off;
+		DecodePacket();
+	}
+
+	av_init_packet(packet_);
+	packet_->data = data;
+	packet_->size = size;
+	packet_->pos = pos;
+}
+#endif // USE_FFMPEG
+
+AtracDecodeResult Atrac::DecodeNextPacket() {
+#ifdef USE_FFMPEG
+	cachedPacket_ = nullptr;
+	if (cachedSegment_) {
+		const auto &packets = cachedSegment_->packets;
+		if (cachedPacketIndex_ < packets.size() && packets[cachedPacketIndex_].offset == packet_->pos && cachedSegment_->outputChannels == outputChannels_) {
+			cachedPacket_ = &packets[cachedPacketIndex_++];
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 12, 100)
+			av_packet_unref(packet_);
+#else
+			av_free_packet(packet_);
+#endif
+			if (cachedPacket_->result == ATDECODE_BADFRAME) {
+				packet_->size = 0;
+			} else if (cachedPacket_->result == ATDECODE_FAILED) {
+				failedDecode_ = true;
+			}
+			return cachedPacket_->result;
+		}
+
+		// Not the packet we expected, so continue with the decoder from here.
+		ResyncFromCache();
+	}
+#endif // USE_FFMPEG
+
+	return DecodePacket();
+}
+
+int __AtracSetContext(Atrac *atrac) {
+#ifdef USE_FFMPEG
+	InitFFmpeg();
+
+	if (atrac->codecType_ != PSP_MODE_AT_3 && atrac->codecType_ != PSP_MODE_AT_3_PLUS) {
+		return hleReportError(ME, ATRAC_ERROR_UNKNOWN_FORMAT, "unknown codec type in set context");
+	}
+	if (atrac->channels_ != 1 && atrac->channels_ != 2) {
+		return hleReportError(ME, ATRAC_ERROR_UNKNOWN_FORMAT, "unknown channel layout in set context");
+	}
 
-	atrac->codecCtx_->request_sample_fmt = AV_SAMPLE_FMT_S16;
 	int ret;
-	if ((ret = avcodec_open2(atrac->codecCtx_, codec, nullptr)) < 0) {
+	if ((ret = __AtracOpenCodec(&atrac->codecCtx_, atrac->codecType_, atrac->channels_, atrac->jointStereo_, atrac->bytesPerFrame_)) < 0) {
 		// This can mean that the frame size is wrong or etc.
 		return hleLogError(ME, ATRAC_ERROR_BAD_CODEC_PARAMS, "failed to open decoder %d", ret);
 	}
@@ -651,6 +651,9 @@ static void DoFrameIdleTiming() {
 void hleEnterVblank(u64 userdata, int cyclesLate) {
 	int vbCount = userdata;
 
+	// Frame presentation looks at framebuffers the GE thread may still be drawing.
+	gpu->SyncThread();
+
 	VERBOSE_LOG(SCEDISPLAY, "Enter VBlank %i", vbCount);
 
 	isVblank = 1;
@@ -190,7 +190,12 @@ static void __GeExecuteInterrupt(u64 userdata, int cyclesLate) {
 }
 
 static void __GeCheckCycles(u64 userdata, int cyclesLate) {
-	// Deprecated
+	// Formerly used to check GE cycles, now just wakes us up after the GE thread finishes.
+	gpu->SyncThread();
+}
+
+void __GeWakeFromThread() {
+	CoreTiming::ScheduleEvent_Threadsafe(0, geCycleEvent, 0);
 }
 
 void __GeInit() {
@@ -55,6 +55,8 @@ bool __GeTriggerSync(GPUSyncType waitType, int id, u64 atTicks);
 bool __GeTriggerInterrupt(int listid, u32 pc, u64 atTicks);
 void __GeWaitCurrentThread(GPUSyncType type, SceUID waitId, const char *reason);
 bool __GeTriggerWait(GPUSyncType type, SceUID waitId);
+// Called from the GE thread when it goes idle, to apply its pending events soon.
+void __GeWakeFromThread();
 
 
 // Export functions for use by Util/PPGe
@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+
 #include "Core/Core.h"
 #include "Core/Config.h"
 #include "Core/CwCheat.h"
@@ -26,6 +28,7 @@
 #include "Core/MIPS/MIPSInt.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 
+#include "Common/BitSet.h"
 #include "Common/LogManager.h"
 #include "Core/FileSystems/FileSystem.h"
 #include "Core/FileSystems/MetaFileSystem.h"
@@ -455,23 +458,79 @@ void KernelObject::GetQuickInfo(char *ptr, int size)
 }
 
 KernelObjectPool::KernelObjectPool() {
-	memset(occupied, 0, sizeof(bool)*maxCount);
+	ResetSlots();
 	nextID = initialNextID;
 }
 
+void KernelObjectPool::ResetSlots() {
+	for (int i = 0; i < maxCount; i++) {
+		pool[i] = nullptr;
+		types[i] = 0;
+	}
+	for (int i = 0; i < freeWordCount; i++)
+		freeSlots[i] = 0xFFFFFFFF;
+	for (int i = 0; i < freeSummaryCount; i++)
+		freeSummary[i] = 0xFFFFFFFF;
+}
+
+void KernelObjectPool::OccupySlot(int index, KernelObject *obj) {
+	pool[index] = obj;
+	types[index] = obj->GetIDType();
+	obj->uid = index + handleOffset;
+
+	const int word = index >> 5;
+	freeSlots[word] &= ~(1U << (index & 31));
+	if (freeSlots[word] == 0)
+		freeSummary[word >> 5] &= ~(1U << (word & 31));
+}
+
+void KernelObjectPool::ReleaseSlot(int index) {
+	pool[index] = nullptr;
+	types[index] = 0;
+
+	const int word = index >> 5;
+	freeSlots[word] |= 1U << (index & 31);
+	freeSummary[word >> 5] |= 1U << (word & 31);
+}
+
+int KernelObjectPool::FindFreeSlot(int start, int end) const {
+	if (start >= end)
+		return -1;
+
+	int word = start >> 5;
+	u32 bits = freeSlots[word] & (0xFFFFFFFFU << (start & 31));
+	if (bits == 0) {
+		// Skip any full words using the summary.
+		const int nextWord = word + 1;
+		word = -1;
+		for (int s = nextWord >> 5; s < freeSummaryCount; s++) {
+			u32 summary = freeSummary[s];
+			if (s == nextWord >> 5)
+				summary &= 0xFFFFFFFFU << (nextWord & 31);
+			if (summary != 0) {
+				word = (s << 5) + LeastSignificantSetBit(summary);
+				break;
+			}
+		}
+		if (word < 0)
+			return -1;
+		bits = freeSlots[word];
+	}
+
+	const int index = (word << 5) + LeastSignificantSetBit(bits);
+	return index < end ? index : -1;
+}
+
 SceUID KernelObjectPool::Create(KernelObject *obj, int rangeBottom, int rangeTop) {
 	if (rangeTop > maxCount)
 		rangeTop = maxCount;
 	if (nextID >= rangeBottom && nextID < rangeTop)
 		rangeBottom = nextID++;
 
-	for (int i = rangeBottom; i < rangeTop; i++) {
-		if (!occupied[i]) {
-			occupied[i] = true;
-			pool[i] = obj;
-			pool[i]->uid = i + handleOffset;
-			return i + handleOffset;
-		}
+	int i = FindFreeSlot(std::max(rangeBottom, 0), rangeTop);
+	if (i >= 0) {
+		OccupySlot(i, obj);
+		return i + handleOffset;
 	}
 
 	ERROR_LOG_REPORT(SCEKERNEL, "Unable to allocate kernel object, too many objects slots in use.");
@@ -483,40 +542,32 @@ bool KernelObjectPool::IsValid(SceUID handle) const {
 	if (index < 0 || index >= maxCount)
 		return false;
 	else
-		return occupied[index];
+		return pool[index] != nullptr;
 }
 
 void KernelObjectPool::Clear() {
 	for (int i = 0; i < maxCount; i++) {
 		// brutally clear everything, no validation
-		if (occupied[i])
-			delete pool[i];
-		pool[i] = nullptr;
-		occupied[i] = false;
+		delete pool[i];
 	}
+	ResetSlots();
 	nextID = initialNextID;
 }
 
 void KernelObjectPool::List() {
 	for (int i = 0; i < maxCount; i++) {
-		if (occupied[i]) {
+		if (pool[i]) {
 			char buffer[256];
-			if (pool[i]) {
-				pool[i]->GetQuickInfo(buffer, 256);
-				INFO_LOG(SCEKERNEL, "KO %i: %s \"%s\": %s", i + handleOffset, pool[i]->GetTypeName(), pool[i]->GetName(), buffer);
-			} else {
-				strcpy(buffer, "WTF? Zero Pointer");
-			}
+			pool[i]->GetQuickInfo(buffer, 256);
+			INFO_LOG(SCEKERNEL, "KO %i: %s \"%s\": %s", i + handleOffset, pool[i]->GetTypeName(), pool[i]->GetName(), buffer);
 		}
 	}
 }
 
 int KernelObjectPool::GetCount() const {
-	int count = 0;
-	for (int i = 0; i < maxCount; i++) {
-		if (occupied[i])
-			count++;
-	}
+	int count = maxCount;
+	for (int i = 0; i < freeWordCount; i++)
+		count -= CountSetBits(freeSlots[i]);
 	return count;
 }
 
@@ -540,6 +591,10 @@ void KernelObjectPool::DoState(PointerWrap &p) {
 	}
 
 	p.Do(nextID);
+	// Still stored as a flag per slot, for compatibility.
+	bool occupied[maxCount];
+	for (int i = 0; i < maxCount; ++i)
+		occupied[i] = pool[i] != nullptr;
 	p.DoArray(occupied, maxCount);
 	for (int i = 0; i < maxCount; ++i) {
 		if (!occupied[i])
@@ -548,13 +603,13 @@ void KernelObjectPool::DoState(PointerWrap &p) {
 		int type;
 		if (p.mode == p.MODE_READ) {
 			p.Do(type);
-			pool[i] = CreateByIDType(type);
+			KernelObject *obj = CreateByIDType(type);
 
 			// Already logged an error.
-			if (pool[i] == nullptr)
+			if (obj == nullptr)
 				return;
 
-			pool[i]->uid = i + handleOffset;
+			OccupySlot(i, obj);
 		} else {
 			type = pool[i]->GetIDType();
 			p.Do(type);
@@ -423,7 +423,6 @@ class KernelObject
 	}
 };
 
-// TODO: Delete the "occupied" array, rely on non-zero pool entries?
 class KernelObjectPool {
 public:
 	KernelObjectPool();
@@ -439,10 +438,9 @@ class KernelObjectPool {
 	u32 Destroy(SceUID handle) {
 		u32 error;
 		if (Get<T>(handle, error)) {
-			occupied[handle-handleOffset] = false;
-			delete pool[handle-handleOffset];
-			// Why weren't we zeroing before?
-			pool[handle-handleOffset] = nullptr;
+			const int index = handle - handleOffset;
+			delete pool[index];
+			ReleaseSlot(index);
 		}
 		return error;
 	};
@@ -451,7 +449,8 @@ class KernelObjectPool {
 
 	template <class T>
 	T* Get(SceUID handle, u32 &outError) {
-		if (handle < handleOffset || handle >= handleOffset+maxCount || !occupied[handle-handleOffset]) {
+		const u32 index = (u32)(handle - handleOffset);
+		if (index >= (u32)maxCount || !pool[index]) {
 			// Tekken 6 spams 0x80020001 gets wrong with no ill effects, also on the real PSP
 			if (handle != 0 && (u32)handle != 0x80020001) {
 				WARN_LOG(SCEKERNEL, "Kernel: Bad object handle %i (%08x)", handle, handle);
@@ -462,14 +461,14 @@ class KernelObjectPool {
 			// Previously we had a dynamic_cast here, but since RTTI was disabled traditionally,
 			// it just acted as a static case and everything worked. This means that we will never
 			// see the Wrong type object error below, but we'll just have to live with that danger.
-			T* t = static_cast<T*>(pool[handle - handleOffset]);
-			if (t == 0 || t->GetIDType() != T::GetStaticIDType()) {
+			// The type is cached at creation, so this doesn't need a virtual call.
+			if (types[index] != T::GetStaticIDType()) {
 				WARN_LOG(SCEKERNEL, "Kernel: Wrong object type for %i (%08x)", handle, handle);
 				outError = T::GetMissingErrorCode();
 				return 0;
 			}
 			outError = SCE_KERNEL_ERROR_OK;
-			return t;
+			return static_cast<T *>(pool[index]);
 		}
 	}
 
@@ -477,7 +476,7 @@ class KernelObjectPool {
 	template <class T>
 	T *GetFast(SceUID handle) {
 		const SceUID realHandle = handle - handleOffset;
-		_dbg_assert_(SCEKERNEL, realHandle >= 0 && realHandle < maxCount && occupied[realHandle]);
+		_dbg_assert_(SCEKERNEL, realHandle >= 0 && realHandle < maxCount && pool[realHandle]);
 		return static_cast<T *>(pool[realHandle]);
 	}
 
@@ -485,10 +484,8 @@ class KernelObjectPool {
 	void Iterate(bool func(T *, ArgT), ArgT arg) {
 		int type = T::GetStaticIDType();
 		for (int i = 0; i < maxCount; i++) {
-			if (!occupied[i])
-				continue;
-			T *t = static_cast<T *>(pool[i]);
-			if (t->GetIDType() == type) {
+			if (pool[i] && types[i] == type) {
+				T *t = static_cast<T *>(pool[i]);
 				if (!func(t, arg))
 					break;
 			}
@@ -498,10 +495,7 @@ class KernelObjectPool {
 	int ListIDType(int type, SceUID *uids, int count) const {
 		int total = 0;
 		for (int i = 0; i < maxCount; i++) {
-			if (!occupied[i]) {
-				continue;
-			}
-			if (pool[i]->GetIDType() == type) {
+			if (pool[i] && types[i] == type) {
 				if (total < count) {
 					*uids++ = pool[i]->GetUID();
 				}
@@ -512,12 +506,12 @@ class KernelObjectPool {
 	}
 
 	bool GetIDType(SceUID handle, int *type) const {
-		if (handle < handleOffset || handle >= handleOffset+maxCount || !occupied[handle-handleOffset]) {
+		const u32 index = (u32)(handle - handleOffset);
+		if (index >= (u32)maxCount || !pool[index]) {
 			ERROR_LOG(SCEKERNEL, "Kernel: Bad object handle %i (%08x)", handle, handle);
 			return false;
 		}
-		KernelObject *t = pool[handle - handleOffset];
-		*type = t->GetIDType();
+		*type = types[index];
 		return true;
 	}
 
@@ -529,16 +523,30 @@ class KernelObjectPool {
 	enum {
 		maxCount = 4096,
 		handleOffset = 0x100,
-		initialNextID = 0x10
+		initialNextID = 0x10,
+		freeWordCount = maxCount / 32,
+		freeSummaryCount = freeWordCount / 32,
 	};
+
+	// Returns the lowest free slot in [start, end), or -1.
+	int FindFreeSlot(int start, int end) const;
+	void OccupySlot(int index, KernelObject *obj);
+	void ReleaseSlot(int index);
+	void ResetSlots();
+
+	// A slot is occupied when its pool entry is non-null.
 	KernelObject *pool[maxCount];
-	bool occupied[maxCount];
+	// GetIDType() of each occupied slot, cached for Get().
+	int types[maxCount];
+	// One bit per free slot, and one bit in freeSummary per non-zero freeSlots word.
+	u32 freeSlots[freeWordCount];
+	u32 freeSummary[freeSummaryCount];
 	int nextID;
 };
 
 extern KernelObjectPool kernelObjects;
 
-typedef std::pair<int, int> KernelStatsSyscall;
+struct HLEFunction;
 
 struct KernelStats {
 	void Reset() {
@@ -556,7 +564,7 @@ struct KernelStats {
 	double msInSyscalls;
 	double slowestSyscallTime;
 	const char *slowestSyscallName;
-	std::map<KernelStatsSyscall, double> summedMsInSyscalls;
+	std::map<const HLEFunction *, double> summedMsInSyscalls;
 	double summedSlowestSyscallTime;
 	const char *summedSlowestSyscallName;
 };
@@ -20,6 +20,7 @@
 #include <vector>
 #include <map>
 
+#include "Common/BitSet.h"
 #include "Common/ChunkFile.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/FunctionWrappers.h"
@@ -98,26 +99,62 @@ struct FPL : public KernelObject
 	static int GetStaticIDType() { return SCE_KERNEL_TMID_Fpl; }
 	int GetIDType() const override { return SCE_KERNEL_TMID_Fpl; }
 
-	int findFreeBlock() {
+	// Rebuilds the host-side free block bitmap from blocks (it's not part of savestates.)
+	void RebuildFreeIndex() {
+		freeMask.assign((nf.numBlocks + 31) / 32, 0);
+		numFree = 0;
 		for (int i = 0; i < nf.numBlocks; i++) {
-			int b = nextBlock++ % nf.numBlocks;
-			if (!blocks[b]) {
-				return b;
+			if (!blocks[i]) {
+				freeMask[i / 32] |= 1U << (i & 31);
+				++numFree;
 			}
 		}
-		return -1;
+	}
+
+	// Returns the first free block in [start, end), or -1.
+	int findFreeBlockIn(int start, int end) const {
+		int word = start / 32;
+		u32 bits = freeMask[word] & (0xFFFFFFFFU << (start & 31));
+		const int lastWord = (end - 1) / 32;
+		while (bits == 0) {
+			if (++word > lastWord)
+				return -1;
+			bits = freeMask[word];
+		}
+		int b = word * 32 + LeastSignificantSetBit(bits);
+		return b < end ? b : -1;
+	}
+
+	int findFreeBlock() {
+		// Same order as scanning each block from nextBlock onward, but a word at a time.
+		if (numFree == 0) {
+			nextBlock += nf.numBlocks;
+			return -1;
+		}
+		int start = nextBlock % nf.numBlocks;
+		int b = findFreeBlockIn(start, nf.numBlocks);
+		if (b < 0 && start > 0)
+			b = findFreeBlockIn(0, start);
+		_dbg_assert_msg_(SCEKERNEL, b >= 0 && !blocks[b], "FPL free index out of sync");
+		nextBlock += (b >= start ? b - start : b + nf.numBlocks - start) + 1;
+		return b;
 	}
 
 	int allocateBlock() {
 		int block = findFreeBlock();
-		if (block >= 0)
+		if (block >= 0) {
 			blocks[block] = true;
+			freeMask[block / 32] &= ~(1U << (block & 31));
+			--numFree;
+		}
 		return block;
 	}
 	
 	bool freeBlock(int b) {
 		if (blocks[b]) {
 			blocks[b] = false;
+			freeMask[b / 32] |= 1U << (b & 31);
+			++numFree;
 			return true;
 		}
 		return false;
@@ -133,6 +170,8 @@ struct FPL : public KernelObject
 		if (p.mode == p.MODE_READ)
 			blocks = new bool[nf.numBlocks];
 		p.DoArray(blocks, nf.numBlocks);
+		if (p.mode == p.MODE_READ)
+			RebuildFreeIndex();
 		p.Do(address);
 		p.Do(alignedSize);
 		p.Do(nextBlock);
@@ -149,6 +188,10 @@ struct FPL : public KernelObject
 	std::vector<FplWaitingThread> waitingThreads;
 	// Key is the callback id it was for, or if no callback, the thread id.
 	std::map<SceUID, FplWaitingThread> pausedWaits;
+
+	// Host-side shadow of blocks: one bit per free block, and the number of free blocks.
+	std::vector<u32> freeMask;
+	int numFree = 0;
 };
 
 struct VplWaitingThread
@@ -212,17 +255,8 @@ struct SceKernelVplHeader {
 		auto prev = nextFreeBlock_;
 		do {
 			auto b = prev->next;
-			if (b->sizeInBlocks > allocBlocks) {
-				if (nextFreeBlock_ == b) {
-					nextFreeBlock_ = prev;
-				}
-				prev = b;
-				b = SplitBlock(b, allocBlocks);
-			}
-
-			if (b->sizeInBlocks == allocBlocks) {
-				UnlinkFreeBlock(b, prev);
-				return b.ptr + 8;
+			if (b->sizeInBlocks >= allocBlocks) {
+				return AllocateFrom(b, prev, allocBlocks);
 			}
 
 			prev = b;
@@ -231,17 +265,37 @@ struct SceKernelVplHeader {
 		return (u32)-1;
 	}
 
-	bool Free(u32 ptr) {
+	// Allocates from the end of free block b, which must be large enough.  prev is the free block before it.
+	u32 AllocateFrom(PSPPointer<SceKernelVplBlock> b, PSPPointer<SceKernelVplBlock> prev, u32 allocBlocks) {
+		if (b->sizeInBlocks > allocBlocks) {
+			if (nextFreeBlock_ == b) {
+				nextFreeBlock_ = prev;
+			}
+			prev = b;
+			b = SplitBlock(b, allocBlocks);
+		}
+
+		UnlinkFreeBlock(b, prev);
+		return b.ptr + 8;
+	}
+
+	// Checks that ptr looks like a block returned by Allocate() (not whether it's already been freed.)
+	bool IsAllocatedPtr(u32 ptr) {
 		auto b = PSPPointer<SceKernelVplBlock>::Create(ptr - 8);
 		// Is it even in the right range?  Can't be the last block, which is always 0.
 		if (!b.IsValid() || ptr < FirstBlockPtr() || ptr >= LastBlockPtr()) {
 			return false;
 		}
 		// Great, let's check if it matches our magic.
-		if (b->next.ptr != SentinelPtr() || b->sizeInBlocks > allocatedInBlocks_) {
+		return b->next.ptr == SentinelPtr() && b->sizeInBlocks <= allocatedInBlocks_;
+	}
+
+	bool Free(u32 ptr) {
+		if (!IsAllocatedPtr(ptr)) {
 			return false;
 		}
 
+		auto b = PSPPointer<SceKernelVplBlock>::Create(ptr - 8);
 		auto prev = LastBlock();
 		do {
 			auto next = prev->next;
@@ -379,6 +433,163 @@ struct SceKernelVplHeader {
 	}
 };
 
+// Host-side shadow of a vpl header's free list, so allocating and freeing doesn't walk guest memory.
+// The guest headers are still updated exactly as before, this only finds the blocks faster.
+// Not savestated, it's rebuilt from the guest headers whenever it's found to be out of sync.
+class VplFreeIndex {
+public:
+	void Clear() {
+		blocks_.clear();
+		for (auto &sizeClass : byClass_)
+			sizeClass.clear();
+		valid_ = false;
+	}
+
+	bool IsValid() const {
+		return valid_;
+	}
+
+	// Walks the guest free list.  Returns false if it doesn't look sane.
+	bool Rebuild(SceKernelVplHeader *header) {
+		Clear();
+		const u32 lastPtr = header->LastBlockPtr();
+		u32 prevPtr = 0;
+		auto b = header->LastBlock()->next;
+		while (b.ptr != lastPtr) {
+			// The list must be in address order, which also means it terminates.
+			if (b.ptr <= prevPtr || b.ptr < header->FirstBlockPtr() || b.ptr >= lastPtr || !b.IsValid() || b->sizeInBlocks == 0) {
+				Clear();
+				return false;
+			}
+			Add(b.ptr, b->sizeInBlocks);
+			prevPtr = b.ptr;
+			b = b->next;
+		}
+		valid_ = true;
+		return true;
+	}
+
+	// Same result as SceKernelVplHeader::Allocate().  Returns false (without allocating) if out of sync.
+	bool Allocate(SceKernelVplHeader *header, u32 allocBlocks, u32 &addr) {
+		const u32 lastPtr = header->LastBlockPtr();
+		const u32 nextFreePtr = header->nextFreeBlock_.ptr;
+		if (nextFreePtr != lastPtr && blocks_.find(nextFreePtr) == blocks_.end()) {
+			return false;
+		}
+
+		// The header walks the list starting after nextFreeBlock_, wrapping around to end with it.
+		u32 found = Find(nextFreePtr + 1, lastPtr, allocBlocks);
+		if (found == 0) {
+			found = Find(0, nextFreePtr + 1, allocBlocks);
+		}
+		if (found == 0) {
+			addr = (u32)-1;
+			return true;
+		}
+
+		auto it = blocks_.find(found);
+		auto b = PSPPointer<SceKernelVplBlock>::Create(found);
+		auto prev = PSPPointer<SceKernelVplBlock>::Create(it == blocks_.begin() ? lastPtr : std::prev(it)->first);
+		auto nextIt = std::next(it);
+		const u32 nextPtr = nextIt == blocks_.end() ? lastPtr : nextIt->first;
+		if (b->sizeInBlocks != it->second || b->next.ptr != nextPtr || prev->next.ptr != found) {
+			return false;
+		}
+
+		const u32 remaining = it->second - allocBlocks;
+		addr = header->AllocateFrom(b, prev, allocBlocks);
+		Remove(found);
+		if (remaining != 0) {
+			// The allocation comes from the end, so the start of the block stays free.
+			Add(found, remaining);
+		}
+		return true;
+	}
+
+	// Same result as SceKernelVplHeader::Free() for a ptr passing IsAllocatedPtr().
+	// Returns false (without freeing) if out of sync.
+	bool Free(SceKernelVplHeader *header, u32 ptr) {
+		const u32 lastPtr = header->LastBlockPtr();
+		const u32 bPtr = ptr - 8;
+		if (blocks_.find(bPtr) != blocks_.end()) {
+			// The guest header says it's allocated, so we're wrong.
+			return false;
+		}
+
+		auto nextIt = blocks_.upper_bound(bPtr);
+		const u32 nextPtr = nextIt == blocks_.end() ? lastPtr : nextIt->first;
+		const u32 prevPtr = nextIt == blocks_.begin() ? lastPtr : std::prev(nextIt)->first;
+		auto b = PSPPointer<SceKernelVplBlock>::Create(bPtr);
+		auto prev = PSPPointer<SceKernelVplBlock>::Create(prevPtr);
+		auto next = PSPPointer<SceKernelVplBlock>::Create(nextPtr);
+		if (prev->next.ptr != nextPtr) {
+			return false;
+		}
+
+		// Mirror the merges LinkFreeBlock() will do.
+		const bool mergeNext = b + b->sizeInBlocks == next && next->sizeInBlocks != 0;
+		const bool mergePrev = prev + prev->sizeInBlocks == b;
+		header->LinkFreeBlock(b, prev, next);
+
+		if (mergeNext) {
+			Remove(nextPtr);
+		}
+		if (mergePrev) {
+			Remove(prevPtr);
+			Add(prevPtr, prev->sizeInBlocks);
+		} else {
+			Add(bPtr, b->sizeInBlocks);
+		}
+		return true;
+	}
+
+private:
+	static int SizeClass(u32 sizeInBlocks) {
+		int c = 0;
+		while (sizeInBlocks >>= 1)
+			++c;
+		return c;
+	}
+
+	void Add(u32 ptr, u32 sizeInBlocks) {
+		blocks_[ptr] = sizeInBlocks;
+		byClass_[SizeClass(sizeInBlocks)][ptr] = sizeInBlocks;
+	}
+
+	void Remove(u32 ptr) {
+		auto it = blocks_.find(ptr);
+		if (it != blocks_.end()) {
+			byClass_[SizeClass(it->second)].erase(ptr);
+			blocks_.erase(it);
+		}
+	}
+
+	// Lowest free block in [start, end) with at least minBlocks, or 0 if none.
+	u32 Find(u32 start, u32 end, u32 minBlocks) const {
+		u32 best = 0;
+		const int minClass = SizeClass(minBlocks);
+		for (int c = minClass; c < 32; ++c) {
+			const auto &sizeClass = byClass_[c];
+			for (auto it = sizeClass.lower_bound(start); it != sizeClass.end() && it->first < end; ++it) {
+				if (best != 0 && it->first >= best)
+					break;
+				// Above the first class, everything fits.  Within it, we may need to skip a few.
+				if (it->second >= minBlocks) {
+					best = it->first;
+					break;
+				}
+			}
+		}
+		return best;
+	}
+
+	// Free blocks by address, to their size in blocks (as in the guest header.)
+	std::map<u32, u32> blocks_;
+	// Same, split by floor(log2(size)).
+	std::map<u32, u32> byClass_[32];
+	bool valid_ = false;
+};
+
 struct VPL : public KernelObject
 {
 	const char *GetName() override { return nv.name; }
@@ -407,6 +618,46 @@ struct VPL : public KernelObject
 		if (s >= 2) {
 			p.Do(header);
 		}
+		if (p.mode == p.MODE_READ) {
+			freeIndex.Clear();
+		}
+	}
+
+	u32 Allocate(u32 size) {
+		// An older savestate may have an invalid header, use the block allocator in that case.
+		if (!header.IsValid()) {
+			// Padding (normally used to track the allocation.)
+			u32 allocSize = size + 8;
+			return alloc.Alloc(allocSize, true);
+		}
+
+		u32 allocBlocks = ((size + 7) / 8) + 1;
+		u32 addr;
+		if (SyncFreeIndex() && freeIndex.Allocate(header, allocBlocks, addr)) {
+			return addr;
+		}
+		// The game may have scribbled on the headers, so do it the slow way exactly as they say.
+		freeIndex.Clear();
+		return header->Allocate(size);
+	}
+
+	bool Free(u32 addr) {
+		if (!header.IsValid()) {
+			return alloc.FreeExact(addr);
+		}
+
+		if (!header->IsAllocatedPtr(addr)) {
+			return false;
+		}
+		if (SyncFreeIndex() && freeIndex.Free(header, addr)) {
+			return true;
+		}
+		freeIndex.Clear();
+		return header->Free(addr);
+	}
+
+	bool SyncFreeIndex() {
+		return freeIndex.IsValid() || freeIndex.Rebuild(header);
 	}
 
 	SceKernelVplInfo nv;
@@ -416,6 +667,7 @@ struct VPL : public KernelObject
 	std::map<SceUID, VplWaitingThread> pausedWaits;
 	BlockAllocator alloc;
 	PSPPointer<SceKernelVplHeader> header;
+	VplFreeIndex freeIndex;
 };
 
 void __KernelVplTimeout(u64 userdata, int cyclesLate);
@@ -547,11 +799,6 @@ void __KernelFplEndCallback(SceUID threadID, SceUID prevCallbackId)
 		DEBUG_LOG(SCEKERNEL, "sceKernelReceiveMbxCB: Resuming mbx wait from callback");
 }
 
-static bool __FplThreadSortPriority(FplWaitingThread thread1, FplWaitingThread thread2)
-{
-	return __KernelThreadSortPriority(thread1.threadID, thread2.threadID);
-}
-
 static bool __KernelClearFplThreads(FPL *fpl, int reason)
 {
 	u32 error;
@@ -570,7 +817,15 @@ static void __KernelSortFplThreads(FPL *fpl)
 	HLEKernel::CleanupWaitingThreads(WAITTYPE_FPL, uid, fpl->waitingThreads);
 
 	if ((fpl->nf.attr & PSP_FPL_ATTR_PRIORITY) != 0)
-		std::stable_sort(fpl->waitingThreads.begin(), fpl->waitingThreads.end(), __FplThreadSortPriority);
+		HLEKernel::SortWaitingThreadsByPriority(fpl->waitingThreads);
+}
+
+static void __KernelAddFplWaitingThread(FPL *fpl, const FplWaitingThread &waiting)
+{
+	if ((fpl->nf.attr & PSP_FPL_ATTR_PRIORITY) != 0)
+		HLEKernel::AddWaitingThreadByPriority(fpl->waitingThreads, waiting);
+	else
+		fpl->waitingThreads.push_back(waiting);
 }
 
 int sceKernelCreateFpl(const char *name, u32 mpid, u32 attr, u32 blockSize, u32 numBlocks, u32 optPtr)
@@ -653,6 +908,7 @@ int sceKernelCreateFpl(const char *name, u32 mpid, u32 attr, u32 blockSize, u32
 
 	fpl->blocks = new bool[fpl->nf.numBlocks];
 	memset(fpl->blocks, 0, fpl->nf.numBlocks * sizeof(bool));
+	fpl->RebuildFreeIndex();
 	fpl->address = address;
 	fpl->alignedSize = alignedSize;
 
@@ -727,7 +983,7 @@ int sceKernelAllocateFpl(SceUID uid, u32 blockPtrAddr, u32 timeoutPtr)
 			SceUID threadID = __KernelGetCurThread();
 			HLEKernel::RemoveWaitingThread(fpl->waitingThreads, threadID);
 			FplWaitingThread waiting = {threadID, blockPtrAddr};
-			fpl->waitingThreads.push_back(waiting);
+			__KernelAddFplWaitingThread(fpl, waiting);
 
 			__KernelSetFplTimeout(timeoutPtr);
 			__KernelWaitCurThread(WAITTYPE_FPL, uid, 0, timeoutPtr, false, "fpl waited");
@@ -758,7 +1014,7 @@ int sceKernelAllocateFplCB(SceUID uid, u32 blockPtrAddr, u32 timeoutPtr)
 			SceUID threadID = __KernelGetCurThread();
 			HLEKernel::RemoveWaitingThread(fpl->waitingThreads, threadID);
 			FplWaitingThread waiting = {threadID, blockPtrAddr};
-			fpl->waitingThreads.push_back(waiting);
+			__KernelAddFplWaitingThread(fpl, waiting);
 
 			__KernelSetFplTimeout(timeoutPtr);
 			__KernelWaitCurThread(WAITTYPE_FPL, uid, 0, timeoutPtr, true, "fpl waited");
@@ -878,12 +1134,7 @@ int sceKernelReferFplStatus(SceUID uid, u32 statusPtr)
 		// Refresh waiting threads and free block count.
 		__KernelSortFplThreads(fpl);
 		fpl->nf.numWaitThreads = (int) fpl->waitingThreads.size();
-		fpl->nf.numFreeBlocks = 0;
-		for (int i = 0; i < (int)fpl->nf.numBlocks; ++i)
-		{
-			if (!fpl->blocks[i])
-				++fpl->nf.numFreeBlocks;
-		}
+		fpl->nf.numFreeBlocks = fpl->numFree;
 		if (Memory::Read_U32(statusPtr) != 0)
 			Memory::WriteStruct(statusPtr, &fpl->nf);
 		return 0;
@@ -1359,15 +1610,7 @@ static bool __KernelUnlockVplForThread(VPL *vpl, VplWaitingThread &threadInfo, u
 	if (result == 0) {
 		int size = (int) __KernelGetWaitValue(threadID, error);
 
-		// An older savestate may have an invalid header, use the block allocator in that case.
-		u32 addr;
-		if (vpl->header.IsValid()) {
-			addr = vpl->header->Allocate(size);
-		} else {
-			// Padding (normally used to track the allocation.)
-			u32 allocSize = size + 8;
-			addr = vpl->alloc.Alloc(allocSize, true);
-		}
+		u32 addr = vpl->Allocate(size);
 		if (addr != (u32) -1) {
 			Memory::Write_U32(addr, threadInfo.addrPtr);
 		} else {
@@ -1405,11 +1648,6 @@ void __KernelVplEndCallback(SceUID threadID, SceUID prevCallbackId)
 		DEBUG_LOG(SCEKERNEL, "sceKernelReceiveMbxCB: Resuming mbx wait from callback");
 }
 
-static bool __VplThreadSortPriority(VplWaitingThread thread1, VplWaitingThread thread2)
-{
-	return __KernelThreadSortPriority(thread1.threadID, thread2.threadID);
-}
-
 static bool __KernelClearVplThreads(VPL *vpl, int reason)
 {
 	u32 error;
@@ -1428,7 +1666,15 @@ static void __KernelSortVplThreads(VPL *vpl)
 	HLEKernel::CleanupWaitingThreads(WAITTYPE_VPL, uid, vpl->waitingThreads);
 
 	if ((vpl->nv.attr & PSP_VPL_ATTR_PRIORITY) != 0)
-		std::stable_sort(vpl->waitingThreads.begin(), vpl->waitingThreads.end(), __VplThreadSortPriority);
+		HLEKernel::SortWaitingThreadsByPriority(vpl->waitingThreads);
+}
+
+static void __KernelAddVplWaitingThread(VPL *vpl, const VplWaitingThread &waiting)
+{
+	if ((vpl->nv.attr & PSP_VPL_ATTR_PRIORITY) != 0)
+		HLEKernel::AddWaitingThreadByPriority(vpl->waitingThreads, waiting);
+	else
+		vpl->waitingThreads.push_back(waiting);
 }
 
 SceUID sceKernelCreateVpl(const char *name, int partition, u32 attr, u32 vplSize, u32 optPtr)
@@ -1555,15 +1801,7 @@ static bool __KernelAllocateVpl(SceUID uid, u32 size, u32 addrPtr, u32 &error, b
 			}
 		}
 
-		// Allocate using the header only for newer vpls (older come from savestates.)
-		u32 addr;
-		if (vpl->header.IsValid()) {
-			addr = vpl->header->Allocate(size);
-		} else {
-			// Padding (normally used to track the allocation.)
-			u32 allocSize = size + 8;
-			addr = vpl->alloc.Alloc(allocSize, true);
-		}
+		u32 addr = vpl->Allocate(size);
 		if (addr != (u32) -1) {
 			Memory::Write_U32(addr, addrPtr);
 			error =  0;
@@ -1632,7 +1870,7 @@ int sceKernelAllocateVpl(SceUID uid, u32 size, u32 addrPtr, u32 timeoutPtr)
 				SceUID threadID = __KernelGetCurThread();
 				HLEKernel::RemoveWaitingThread(vpl->waitingThreads, threadID);
 				VplWaitingThread waiting = {threadID, addrPtr};
-				vpl->waitingThreads.push_back(waiting);
+				__KernelAddVplWaitingThread(vpl, waiting);
 			}
 
 			__KernelSetVplTimeout(timeoutPtr);
@@ -1663,7 +1901,7 @@ int sceKernelAllocateVplCB(SceUID uid, u32 size, u32 addrPtr, u32 timeoutPtr)
 				SceUID threadID = __KernelGetCurThread();
 				HLEKernel::RemoveWaitingThread(vpl->waitingThreads, threadID);
 				VplWaitingThread waiting = {threadID, addrPtr};
-				vpl->waitingThreads.push_back(waiting);
+				__KernelAddVplWaitingThread(vpl, waiting);
 			}
 
 			__KernelSetVplTimeout(timeoutPtr);
@@ -1693,15 +1931,7 @@ int sceKernelFreeVpl(SceUID uid, u32 addr) {
 	u32 error;
 	VPL *vpl = kernelObjects.Get<VPL>(uid, error);
 	if (vpl) {
-		bool freed;
-		// Free using the header for newer vpls (not old savestates.)
-		if (vpl->header.IsValid()) {
-			freed = vpl->header->Free(addr);
-		} else {
-			freed = vpl->alloc.FreeExact(addr);
-		}
-
-		if (freed) {
+		if (vpl->Free(addr)) {
 			__KernelSortVplThreads(vpl);
 
 			bool wokeThreads = false;
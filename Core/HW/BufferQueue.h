@@ -108,6 +108,15 @@ struct BufferQueue {
 		return bytesgot;
 	}
 
+	// Moves the read position back over data that was popped but not overwritten since.
+	void rewind(int size) {
+		if (size <= 0)
+			return;
+		start -= size;
+		if (start < 0)
+			start += bufQueueSize;
+	}
+
 	int get_front(unsigned char *buf, int wantedsize) {
 		if (wantedsize <= 0)
 			return 0;
@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include "thread/threadutil.h"
 #include "Core/Config.h"
 #include "Core/Debugger/Breakpoints.h"
 #include "Core/HW/MediaEngine.h"
@@ -124,6 +125,17 @@ MediaEngine::MediaEngine(): m_pdata(0) {
 	m_pFrameRGB = 0;
 	m_pIOContext = 0;
 	m_sws_ctx = 0;
+
+	m_decodeAheadThread = nullptr;
+	m_decodeAheadSws = nullptr;
+	m_decodeAheadRunning = false;
+	m_decodeAheadStop = false;
+	m_decodeAheadWaiting = false;
+	m_decodeAheadMax = 0;
+	m_decodeAheadPixelMode = GE_CMODE_32BIT_ABGR8888;
+	m_decodeAheadDecodingSize = 0;
+	m_decodeAheadPopped = 0;
+	m_decodeAheadConsumed = 0;
 #endif
 	m_sws_fmt = 0;
 	m_buffer = 0;
@@ -172,6 +184,12 @@ void MediaEngine::DoState(PointerWrap &p) {
 	if (!s)
 		return;
 
+#ifdef USE_FFMPEG
+	// Frames decoded ahead aren't saved, the stream is reopened on load anyway.
+	if (p.mode == p.MODE_READ)
+		stopDecodeAhead();
+#endif
+
 	p.Do(m_videoStream);
 	p.Do(m_audioStream);
 
@@ -199,8 +217,18 @@ void MediaEngine::DoState(PointerWrap &p) {
 	u32 hasopencontext = false;
 #endif
 	p.Do(hasopencontext);
-	if (m_pdata)
+	if (m_pdata) {
+#ifdef USE_FFMPEG
+		// Save the data hidden by decode ahead as if it was never read.
+		std::lock_guard<std::mutex> guard(m_decodeAheadLock);
+		int hiddenSize = getDecodeAheadHiddenSize();
+		m_pdata->rewind(hiddenSize);
+		m_pdata->DoState(p);
+		m_pdata->pop_front(nullptr, hiddenSize);
+#else
 		m_pdata->DoState(p);
+#endif
+	}
 	if (m_demux)
 		m_demux->DoState(p);
 
@@ -229,6 +257,11 @@ void MediaEngine::DoState(PointerWrap &p) {
 static int MpegReadbuffer(void *opaque, uint8_t *buf, int buf_size) {
 	MediaEngine *mpeg = (MediaEngine *)opaque;
 
+#ifdef USE_FFMPEG
+	if (mpeg->m_decodeAheadRunning)
+		return mpeg->readDecodeAhead(buf, buf_size);
+#endif
+
 	int size = buf_size;
 	if (mpeg->m_mpegheaderReadPos < mpeg->m_mpegheaderSize) {
 		size = std::min(buf_size, mpeg->m_mpegheaderSize - mpeg->m_mpegheaderReadPos);
@@ -341,6 +374,7 @@ bool MediaEngine::openContext(bool keepReadPos) {
 void MediaEngine::closeContext()
 {
 #ifdef USE_FFMPEG
+	stopDecodeAhead();
 	if (m_buffer)
 		av_free(m_buffer);
 	if (m_pFrameRGB)
@@ -388,8 +422,17 @@ bool MediaEngine::reloadStream()
 int MediaEngine::addStreamData(const u8 *buffer, int addSize) {
 	int size = addSize;
 	if (size > 0 && m_pdata) {
+#ifdef USE_FFMPEG
+		std::unique_lock<std::mutex> guard(m_decodeAheadLock);
+		// Space taken by data decoded ahead still counts, as if it hadn't been read yet.
+		if (m_pdata->getRemainSize() - getDecodeAheadHiddenSize() < size || !m_pdata->push(buffer, size))
+			size = 0;
+		m_decodeAheadCond.notify_all();
+		guard.unlock();
+#else
 		if (!m_pdata->push(buffer, size)) 
 			size  = 0;
+#endif
 		if (m_demux) {
 			m_demux->addStreamData(buffer, addSize);
 		}
@@ -449,6 +492,10 @@ bool MediaEngine::setVideoStream(int streamNum, bool force) {
 	}
 
 #ifdef USE_FFMPEG
+	// The decode ahead thread only follows one stream, and needs the context to itself.
+	if (m_videoStream != streamNum)
+		stopDecodeAhead();
+
 	if (m_pFormatCtx && m_pCodecCtxs.find(streamNum) == m_pCodecCtxs.end()) {
 		// Get a pointer to the codec context for the video stream
 		if ((u32)streamNum >= m_pFormatCtx->nb_streams) {
@@ -498,14 +545,20 @@ bool MediaEngine::setVideoDim(int width, int height)
 	if (width == 0 && height == 0)
 	{
 		// use the orignal video size
-		m_desWidth = m_pCodecCtx->width;
-		m_desHeight = m_pCodecCtx->height;
-	}
-	else
-	{
-		m_desWidth = width;
-		m_desHeight = height;
+		width = m_pCodecCtx->width;
+		height = m_pCodecCtx->height;
 	}
+	return setVideoDim(width, height, m_pCodecCtx->width, m_pCodecCtx->height, m_pCodecCtx->pix_fmt);
+#else
+	return true;
+#endif // USE_FFMPEG
+}
+
+bool MediaEngine::setVideoDim(int width, int height, int srcWidth, int srcHeight, int srcPixFmt)
+{
+#ifdef USE_FFMPEG
+	m_desWidth = width;
+	m_desHeight = height;
 
 	// Allocate video frame
 	if (!m_pFrame) {
@@ -521,7 +574,7 @@ bool MediaEngine::setVideoDim(int width, int height)
 		return false;
 	}
 
-	updateSwsFormat(GE_CMODE_32BIT_ABGR8888);
+	updateSwsFormat(GE_CMODE_32BIT_ABGR8888, srcWidth, srcHeight, srcPixFmt);
 
 	// Allocate video frame for RGB24
 	m_pFrameRGB = av_frame_alloc();
@@ -542,39 +595,54 @@ bool MediaEngine::setVideoDim(int width, int height)
 	return true;
 }
 
+#ifdef USE_FFMPEG
+static SwsContext *getVideoSwsContext(SwsContext *ctx, int srcWidth, int srcHeight, int srcPixFmt, int desWidth, int desHeight, AVPixelFormat desPixFmt) {
+	ctx = sws_getCachedContext
+		(
+			ctx,
+			srcWidth,
+			srcHeight,
+			(AVPixelFormat)srcPixFmt,
+			desWidth,
+			desHeight,
+			desPixFmt,
+			SWS_BILINEAR,
+			NULL,
+			NULL,
+			NULL
+		);
+
+	int *inv_coefficients;
+	int *coefficients;
+	int srcRange, dstRange;
+	int brightness, contrast, saturation;
+
+	if (sws_getColorspaceDetails(ctx, &inv_coefficients, &srcRange, &coefficients, &dstRange, &brightness, &contrast, &saturation) != -1) {
+		srcRange = 0;
+		dstRange = 0;
+		sws_setColorspaceDetails(ctx, inv_coefficients, srcRange, coefficients, dstRange, brightness, contrast, saturation);
+	}
+	return ctx;
+}
+#endif
+
 void MediaEngine::updateSwsFormat(int videoPixelMode) {
 #ifdef USE_FFMPEG
 	auto codecIter = m_pCodecCtxs.find(m_videoStream);
 	AVCodecContext *m_pCodecCtx = codecIter == m_pCodecCtxs.end() ? 0 : codecIter->second;
 
+	if (m_pCodecCtx != 0) {
+		updateSwsFormat(videoPixelMode, m_pCodecCtx->width, m_pCodecCtx->height, m_pCodecCtx->pix_fmt);
+	}
+#endif
+}
+
+void MediaEngine::updateSwsFormat(int videoPixelMode, int srcWidth, int srcHeight, int srcPixFmt) {
+#ifdef USE_FFMPEG
 	AVPixelFormat swsDesired = getSwsFormat(videoPixelMode);
-	if (swsDesired != m_sws_fmt && m_pCodecCtx != 0) {
+	if (swsDesired != m_sws_fmt) {
 		m_sws_fmt = swsDesired;
-		m_sws_ctx = sws_getCachedContext
-			(
-				m_sws_ctx,
-				m_pCodecCtx->width,
-				m_pCodecCtx->height,
-				m_pCodecCtx->pix_fmt,
-				m_desWidth,
-				m_desHeight,
-				(AVPixelFormat)m_sws_fmt,
-				SWS_BILINEAR,
-				NULL,
-				NULL,
-				NULL
-			);
-
-		int *inv_coefficients;
-		int *coefficients;
-		int srcRange, dstRange;
-		int brightness, contrast, saturation;
-
-		if (sws_getColorspaceDetails(m_sws_ctx, &inv_coefficients, &srcRange, &coefficients, &dstRange, &brightness, &contrast, &saturation) != -1) {
-			srcRange = 0;
-			dstRange = 0;
-			sws_setColorspaceDetails(m_sws_ctx, inv_coefficients, srcRange, coefficients, dstRange, brightness, contrast, saturation);
-		}
+		m_sws_ctx = getVideoSwsContext(m_sws_ctx, srcWidth, srcHeight, srcPixFmt, m_desWidth, m_desHeight, swsDesired);
 	}
 #endif
 }
@@ -591,6 +659,11 @@ bool MediaEngine::stepVideo(int videoPixelMode, bool skipFrame) {
 	if (!m_pFrame)
 		return false;
 
+	if (!m_decodeAheadThread && g_Config.iMpegDecodeAhead > 0)
+		startDecodeAhead(videoPixelMode);
+	if (m_decodeAheadThread)
+		return stepVideoDecodedAhead(videoPixelMode, skipFrame);
+
 	AVPacket packet;
 	av_init_packet(&packet);
 	int frameFinished;
@@ -653,6 +726,211 @@ bool MediaEngine::stepVideo(int videoPixelMode, bool skipFrame) {
 #endif // USE_FFMPEG
 }
 
+#ifdef USE_FFMPEG
+int MediaEngine::getDecodeAheadHiddenSize() {
+	// Must be called with m_decodeAheadLock held.
+	return (int)(m_decodeAheadPopped - m_decodeAheadConsumed);
+}
+
+void MediaEngine::startDecodeAhead(int videoPixelMode) {
+	auto codecIter = m_pCodecCtxs.find(m_videoStream);
+	if (codecIter == m_pCodecCtxs.end())
+		return;
+
+	m_decodeAheadStop = false;
+	m_decodeAheadWaiting = false;
+	m_decodeAheadMax = g_Config.iMpegDecodeAhead;
+	m_decodeAheadPixelMode = videoPixelMode;
+	m_decodeAheadDecodingSize = m_decodingsize;
+	m_decodeAheadPopped = 0;
+	m_decodeAheadConsumed = 0;
+	m_decodeAheadRunning = true;
+	m_decodeAheadThread = new std::thread(&MediaEngine::decodeAheadThread, this, codecIter->second, m_videoStream);
+}
+
+void MediaEngine::stopDecodeAhead() {
+	if (!m_decodeAheadThread)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(m_decodeAheadLock);
+		m_decodeAheadStop = true;
+		m_decodeAheadCond.notify_all();
+	}
+	m_decodeAheadThread->join();
+	delete m_decodeAheadThread;
+	m_decodeAheadThread = nullptr;
+	m_decodeAheadRunning = false;
+
+	for (auto &decoded : m_decodeAheadFrames) {
+		av_frame_free(&decoded.frame);
+		av_free(decoded.image);
+	}
+	m_decodeAheadFrames.clear();
+	sws_freeContext(m_decodeAheadSws);
+	m_decodeAheadSws = nullptr;
+	// Anything read for those frames is gone now, the decoder has already consumed it.
+	m_decodeAheadPopped = 0;
+	m_decodeAheadConsumed = 0;
+	if (m_pFrame)
+		av_frame_unref(m_pFrame);
+}
+
+int MediaEngine::readDecodeAhead(u8 *buf, int buf_size) {
+	std::unique_lock<std::mutex> guard(m_decodeAheadLock);
+	if (m_mpegheaderReadPos < m_mpegheaderSize) {
+		int size = std::min(buf_size, m_mpegheaderSize - m_mpegheaderReadPos);
+		memcpy(buf, m_mpegheader + m_mpegheaderReadPos, size);
+		m_mpegheaderReadPos += size;
+		return size;
+	}
+
+	// A short read has to match what stepVideo() would have gotten, so only take one once
+	// the game is actually waiting for this frame.  Until then, more data may still arrive.
+	while (!m_decodeAheadStop && m_pdata->getQueueSize() < buf_size && !(m_decodeAheadWaiting && m_decodeAheadFrames.empty()))
+		m_decodeAheadCond.wait(guard);
+	if (m_decodeAheadStop)
+		return 0;
+
+	int size = m_pdata->pop_front(buf, buf_size);
+	if (size > 0) {
+		m_decodeAheadDecodingSize = size;
+		m_decodeAheadPopped += size;
+	}
+	return size;
+}
+
+void MediaEngine::decodeAheadThread(AVCodecContext *codecCtx, int videoStream) {
+	setCurrentThreadName("MpegDecodeAhead");
+
+	AVFrame *frame = av_frame_alloc();
+	std::unique_lock<std::mutex> guard(m_decodeAheadLock);
+	while (!m_decodeAheadStop) {
+		if ((int)m_decodeAheadFrames.size() >= m_decodeAheadMax) {
+			m_decodeAheadCond.wait(guard);
+			continue;
+		}
+
+		int videoPixelMode = m_decodeAheadPixelMode;
+		guard.unlock();
+		DecodedFrame decoded = decodeAheadFrame(codecCtx, videoStream, frame, videoPixelMode);
+		guard.lock();
+
+		decoded.poppedBytes = m_decodeAheadPopped;
+		decoded.decodingSize = m_decodeAheadDecodingSize;
+		decoded.videoEnd = decoded.dataEnd && !decoded.frame && m_pdata->getQueueSize() == 0;
+		if (decoded.videoEnd)
+			m_decodeAheadDecodingSize = 0;
+		m_decodeAheadFrames.push_back(decoded);
+		m_decodeAheadCond.notify_all();
+	}
+	guard.unlock();
+	av_frame_free(&frame);
+}
+
+MediaEngine::DecodedFrame MediaEngine::decodeAheadFrame(AVCodecContext *codecCtx, int videoStream, AVFrame *frame, int videoPixelMode) {
+	DecodedFrame decoded{};
+
+	// This mirrors stepVideo(), but keeps its own copy of the frame.
+	AVPacket packet;
+	av_init_packet(&packet);
+	int frameFinished;
+	while (!decoded.frame) {
+		bool dataEnd = av_read_frame(m_pFormatCtx, &packet) < 0;
+		if (dataEnd || packet.stream_index == videoStream) {
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 12, 100)
+			if (dataEnd)
+				av_packet_unref(&packet);
+#else
+			if (dataEnd)
+				av_free_packet(&packet);
+#endif
+
+			int result = avcodec_decode_video2(codecCtx, frame, &frameFinished, &packet);
+			if (frameFinished) {
+				// This copies the data if the decoder still owns it.
+				decoded.frame = av_frame_clone(frame);
+				decoded.bestEffortTimestamp = av_frame_get_best_effort_timestamp(frame);
+				decoded.duration = av_frame_get_pkt_duration(frame);
+
+				// Convert now too, the game rarely changes the pixel mode mid video.
+				AVPixelFormat swsFormat = getSwsFormat(videoPixelMode);
+				if (decoded.frame && swsFormat != 0) {
+					m_decodeAheadSws = getVideoSwsContext(m_decodeAheadSws, frame->width, frame->height, frame->format, frame->width, frame->height, swsFormat);
+					u8 *dstData[4] = {};
+					int dstLinesize[4] = {};
+					dstLinesize[0] = getPixelFormatBytes(videoPixelMode) * frame->width;
+					decoded.image = (u8 *)av_malloc(dstLinesize[0] * frame->height);
+					dstData[0] = decoded.image;
+					sws_scale(m_decodeAheadSws, frame->data, frame->linesize, 0, frame->height, dstData, dstLinesize);
+					decoded.pixelMode = videoPixelMode;
+				}
+			}
+			if (result <= 0 && dataEnd) {
+				decoded.dataEnd = true;
+				break;
+			}
+		}
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(57, 12, 100)
+		av_packet_unref(&packet);
+#else
+		av_free_packet(&packet);
+#endif
+	}
+	return decoded;
+}
+
+bool MediaEngine::stepVideoDecodedAhead(int videoPixelMode, bool skipFrame) {
+	std::unique_lock<std::mutex> guard(m_decodeAheadLock);
+	m_decodeAheadPixelMode = videoPixelMode;
+	m_decodeAheadWaiting = true;
+	m_decodeAheadCond.notify_all();
+	while (m_decodeAheadFrames.empty())
+		m_decodeAheadCond.wait(guard);
+	m_decodeAheadWaiting = false;
+
+	DecodedFrame decoded = m_decodeAheadFrames.front();
+	m_decodeAheadFrames.pop_front();
+	m_decodeAheadConsumed = decoded.poppedBytes;
+	m_decodingsize = decoded.decodingSize;
+	m_decodeAheadCond.notify_all();
+	guard.unlock();
+
+	if (decoded.dataEnd)
+		m_isVideoEnd = decoded.videoEnd;
+	if (!decoded.frame)
+		return false;
+
+	av_frame_unref(m_pFrame);
+	av_frame_move_ref(m_pFrame, decoded.frame);
+	av_frame_free(&decoded.frame);
+
+	// The codec context belongs to the decode ahead thread, so size things from the frame.
+	const int srcWidth = m_pFrame->width;
+	const int srcHeight = m_pFrame->height;
+	if (!m_pFrameRGB) {
+		setVideoDim(srcWidth, srcHeight, srcWidth, srcHeight, m_pFrame->format);
+	}
+	if (m_pFrameRGB && !skipFrame) {
+		m_pFrameRGB->linesize[0] = getPixelFormatBytes(videoPixelMode) * m_desWidth;
+		if (decoded.image && decoded.pixelMode == videoPixelMode && srcWidth == m_desWidth && srcHeight == m_desHeight) {
+			memcpy(m_pFrameRGB->data[0], decoded.image, m_pFrameRGB->linesize[0] * m_desHeight);
+		} else {
+			updateSwsFormat(videoPixelMode, srcWidth, srcHeight, m_pFrame->format);
+			sws_scale(m_sws_ctx, m_pFrame->data, m_pFrame->linesize, 0,
+				srcHeight, m_pFrameRGB->data, m_pFrameRGB->linesize);
+		}
+	}
+	av_free(decoded.image);
+
+	if (decoded.bestEffortTimestamp != AV_NOPTS_VALUE)
+		m_videopts = decoded.bestEffortTimestamp + decoded.duration - m_firstTimeStamp;
+	else
+		m_videopts += decoded.duration;
+	return true;
+}
+#endif // USE_FFMPEG
+
 // Helpers that null out alpha (which seems to be the case on the PSP.)
 // Some games depend on this, for example Sword Art Online (doesn't clear A's from buffer.)
 inline void writeVideoLineRGBA(void *destp, const void *srcp, int width) {
@@ -897,7 +1175,12 @@ u8 *MediaEngine::getFrameImage() {
 int MediaEngine::getRemainSize() {
 	if (!m_pdata)
 		return 0;
+#ifdef USE_FFMPEG
+	std::lock_guard<std::mutex> guard(m_decodeAheadLock);
+	return std::max(m_pdata->getRemainSize() - getDecodeAheadHiddenSize() - m_decodingsize - 2048, 0);
+#else
 	return std::max(m_pdata->getRemainSize() - m_decodingsize - 2048, 0);
+#endif
 }
 
 int MediaEngine::getAudioRemainSize() {
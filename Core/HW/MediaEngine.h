@@ -24,7 +24,12 @@
 
 // An approximation of what the interface will look like. Similar to JPCSP's.
 
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
+#include <thread>
+
 #include "Common/CommonTypes.h"
 #include "Core/HLE/sceMpeg.h"
 #include "Core/HW/MpegDemux.h"
@@ -92,12 +97,42 @@ class MediaEngine
 
 	void DoState(PointerWrap &p);
 
+#ifdef USE_FFMPEG
+	// Used by the ffmpeg read callback while frames are being decoded ahead.
+	int readDecodeAhead(u8 *buf, int buf_size);
+#endif
+
 private:
 	bool SetupStreams();
 	bool setVideoDim(int width = 0, int height = 0);
+	bool setVideoDim(int width, int height, int srcWidth, int srcHeight, int srcPixFmt);
 	void updateSwsFormat(int videoPixelMode);
+	void updateSwsFormat(int videoPixelMode, int srcWidth, int srcHeight, int srcPixFmt);
 	int getNextAudioFrame(u8 **buf, int *headerCode1, int *headerCode2);
 
+#ifdef USE_FFMPEG
+	// A frame decoded (and usually converted) by the decode ahead thread, waiting for stepVideo().
+	struct DecodedFrame {
+		AVFrame *frame;
+		u8 *image;
+		int pixelMode;
+		s64 bestEffortTimestamp;
+		s64 duration;
+		// Stream bytes consumed and size of the last read once this frame was done, as stepVideo() would see them.
+		s64 poppedBytes;
+		int decodingSize;
+		bool dataEnd;
+		bool videoEnd;
+	};
+
+	void startDecodeAhead(int videoPixelMode);
+	void stopDecodeAhead();
+	void decodeAheadThread(AVCodecContext *codecCtx, int videoStream);
+	DecodedFrame decodeAheadFrame(AVCodecContext *codecCtx, int videoStream, AVFrame *frame, int videoPixelMode);
+	bool stepVideoDecodedAhead(int videoPixelMode, bool skipFrame);
+	int getDecodeAheadHiddenSize();
+#endif
+
 public:  // TODO: Very little of this below should be public.
 
 	// Video ffmpeg context - not used for audio
@@ -140,4 +175,22 @@ class MediaEngine
 
 	// used for audio type 
 	int m_audioType;
+
+#ifdef USE_FFMPEG
+	// Decode ahead state.  Bytes the thread popped from m_pdata for frames that stepVideo()
+	// hasn't returned yet are hidden from the game, so ringbuffer accounting stays the same.
+	std::thread *m_decodeAheadThread;
+	std::mutex m_decodeAheadLock;
+	std::condition_variable m_decodeAheadCond;
+	std::deque<DecodedFrame> m_decodeAheadFrames;
+	SwsContext *m_decodeAheadSws;
+	volatile bool m_decodeAheadRunning;
+	bool m_decodeAheadStop;
+	bool m_decodeAheadWaiting;
+	int m_decodeAheadMax;
+	int m_decodeAheadPixelMode;
+	int m_decodeAheadDecodingSize;
+	s64 m_decodeAheadPopped;
+	s64 m_decodeAheadConsumed;
+#endif
 };
@@ -148,8 +148,19 @@ void IRFrontend::Comp_ReplacementFunc(MIPSOpcode op) {
 		}
 	}
 
+	ReplacementExpansion expansion = GetReplacementExpansion(entry);
 	if (disabled) {
 		MIPSCompileOp(Memory::Read_Instruction(GetCompilerPC(), true), this);
+	} else if (expansion != ReplacementExpansion::NONE) {
+		// As an op, the passes know exactly which regs it uses, and can expand small ones.
+		FlushAll();
+		ir.Write(IROp::SetPCConst, 0, ir.AddConstant(GetCompilerPC()));
+		ir.AddConstant(CBreakPoints::HasMemChecks() ? 0 : 1);
+		ir.Write(expansion == ReplacementExpansion::MEMCPY ? IROp::MemCpy : IROp::MemSet, MIPS_REG_A0, MIPS_REG_A1, MIPS_REG_A2);
+		ir.Write(IROp::Mov, MIPS_REG_V0, MIPS_REG_A0);
+		ir.Write(IROp::Downcount, 0, ir.AddConstant(js.downcountAmount));
+		ir.Write(IROp::ExitToReg, 0, MIPS_REG_RA, 0);
+		js.compiling = false;
 	} else if (entry->replaceFunc) {
 		FlushAll();
 		RestoreRoundingMode();
@@ -221,7 +232,27 @@ MIPSOpcode IRFrontend::GetOffsetInstruction(int offset) {
 	return Memory::Read_Instruction(GetCompilerPC() + 4 * offset);
 }
 
-void IRFrontend::DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes, bool preload) {
+static const IRPassFunc simplifyPasses[] = {
+	&RemoveLoadStoreLeftRight,
+	&OptimizeFPMoves,
+	&PropagateConstants,
+	&PurgeTemps,
+	// &ReorderLoadStore,
+	// &MergeLoadStore,
+	// &ThreeOpToTwoOp,
+};
+
+void IRFrontend::ApplyDeferredPasses(const std::vector<IRInst> &in, std::vector<IRInst> &out, const IROptions &opts) {
+	IRWriter original;
+	for (const IRInst &inst : in)
+		original.Write(inst);
+
+	IRWriter simplified;
+	IRApplyPasses(simplifyPasses, ARRAY_SIZE(simplifyPasses), original, simplified, opts);
+	out = simplified.GetInstructions();
+}
+
+bool IRFrontend::DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes, bool preload, bool deferPasses) {
 	js.cancel = false;
 	js.preloading = preload;
 	js.blockStart = em_address;
@@ -258,17 +289,13 @@ void IRFrontend::DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &m
 
 	IRWriter simplified;
 	IRWriter *code = &ir;
-	if (!js.hadBreakpoints) {
-		static const IRPassFunc passes[] = {
-			&RemoveLoadStoreLeftRight,
-			&OptimizeFPMoves,
-			&PropagateConstants,
-			&PurgeTemps,
-			// &ReorderLoadStore,
-			// &MergeLoadStore,
-			// &ThreeOpToTwoOp,
-		};
-		if (IRApplyPasses(passes, ARRAY_SIZE(passes), ir, simplified, opts))
+	bool deferred = false;
+	if (js.hadBreakpoints) {
+		// Breakpoints need the unsimplified code, now and later.
+	} else if (deferPasses) {
+		deferred = true;
+	} else {
+		if (IRApplyPasses(simplifyPasses, ARRAY_SIZE(simplifyPasses), ir, simplified, opts))
 			logBlocks = 1;
 		code = &simplified;
 		//if (ir.GetInstructions().size() >= 24)
@@ -311,6 +338,8 @@ void IRFrontend::DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &m
 		logBlocks--;
 	if (dontLogBlocks > 0)
 		dontLogBlocks--;
+
+	return deferred;
 }
 
 void IRFrontend::Comp_RunBlock(MIPSOpcode op) {
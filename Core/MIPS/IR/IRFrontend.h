@@ -88,7 +88,10 @@ class IRFrontend : public MIPSFrontendInterface {
 	void DoState(PointerWrap &p);
 	bool CheckRounding(u32 blockAddress);  // returns true if we need a do-over
 
-	void DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes, bool preload);
+	// With deferPasses, the simplify passes are skipped when they'd apply, and this returns true.
+	bool DoJit(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes, bool preload, bool deferPasses = false);
+	// Runs the simplify passes skipped by DoJit.  Uses no frontend state, so any thread can call it.
+	static void ApplyDeferredPasses(const std::vector<IRInst> &in, std::vector<IRInst> &out, const IROptions &opts);
 
 	void EatPrefix() override {
 		js.EatPrefix();
@@ -97,6 +100,9 @@ class IRFrontend : public MIPSFrontendInterface {
 	void SetOptions(const IROptions &o) {
 		opts = o;
 	}
+	const IROptions &GetOptions() const {
+		return opts;
+	}
 
 private:
 	void RestoreRoundingMode(bool force = false);
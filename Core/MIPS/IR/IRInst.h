@@ -212,6 +212,10 @@ enum class IROp : u8 {
 	SetPC,  // hack to make syscall returns work
 	SetPCConst,  // hack to make replacement know PC
 	CallReplacement,
+	// Replacement memcpy/memset: ptr (src3), src ptr / value, bytes.  Don't set v0.
+	// A nonzero constant means no memchecks were set, so small sizes may become plain stores.
+	MemCpy,
+	MemSet,
 	Break,
 	Breakpoint,
 	MemoryCheck,
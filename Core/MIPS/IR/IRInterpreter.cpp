@@ -944,6 +944,14 @@ u32 IRInterpret(MIPSState *mips, const IRInst *inst, int count) {
 			break;
 		}
 
+		case IROp::MemCpy:
+			mips->downcount -= Replacement_Memcpy(mips->r[inst->src3], mips->r[inst->src1], mips->r[inst->src2]);
+			break;
+
+		case IROp::MemSet:
+			mips->downcount -= Replacement_Memset(mips->r[inst->src3], (u8)mips->r[inst->src1], mips->r[inst->src2]);
+			break;
+
 		case IROp::Break:
 			if (!g_Config.bIgnoreBadMemAccess) {
 				Core_EnableStepping(true);
@@ -15,9 +15,13 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+#include <chrono>
+
 #include "base/logging.h"
 #include "ext/xxhash.h"
 #include "profiler/profiler.h"
+#include "thread/threadutil.h"
 #include "Common/ChunkFile.h"
 #include "Common/StringUtils.h"
 
@@ -38,6 +42,13 @@
 
 namespace MIPSComp {
 
+// Cold blocks are queued for the simplify passes once they've run this many times, and
+// switch to the result as soon as it's ready.  If the job still hasn't started after this
+// many runs, the emu thread runs the passes itself.  Both tiers do exactly the same thing,
+// so when the switch happens doesn't affect emulation.
+static const u32 TIER_QUEUE_RUNS = 16;
+static const u32 TIER_SWITCH_RUNS = 256;
+
 IRJit::IRJit(MIPSState *mips) : frontend_(mips->HasDefaultPrefix()), mips_(mips) {
 	u32 size = 128 * 1024;
 	// blTrampolines_ = kernelMemory.Alloc(size, true, "trampoline");
@@ -47,9 +58,21 @@ IRJit::IRJit(MIPSState *mips) : frontend_(mips->HasDefaultPrefix()), mips_(mips)
 	opts.disableFlags = g_Config.uJitDisableFlags;
 	opts.unalignedLoadStore = opts.disableFlags & (uint32_t)JitDisable::LSU_UNALIGNED;
 	frontend_.SetOptions(opts);
+
+	tiering_ = g_Config.bJitTiering;
+	if (tiering_)
+		tierThread_ = std::thread(&IRJit::TierThread, this);
 }
 
 IRJit::~IRJit() {
+	if (tierThread_.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(tierLock_);
+			tierStop_ = true;
+		}
+		tierCond_.notify_all();
+		tierThread_.join();
+	}
 }
 
 void IRJit::DoState(PointerWrap &p) {
@@ -61,11 +84,14 @@ void IRJit::UpdateFCR31() {
 
 void IRJit::ClearCache() {
 	ILOG("IRJit: Clearing the cache!");
+	ClearTierUps();
 	blocks_.Clear();
 }
 
 void IRJit::InvalidateCacheAt(u32 em_address, int length) {
 	blocks_.InvalidateICache(em_address, length);
+	if (tiering_)
+		DropInvalidTierUps();
 }
 
 void IRJit::Compile(u32 em_address) {
@@ -102,7 +128,7 @@ void IRJit::Compile(u32 em_address) {
 }
 
 bool IRJit::CompileBlock(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes, bool preload) {
-	frontend_.DoJit(em_address, instructions, mipsBytes, preload);
+	bool cold = frontend_.DoJit(em_address, instructions, mipsBytes, preload, tiering_ && !preload);
 	if (instructions.empty()) {
 		_dbg_assert_(JIT, preload);
 		// We return true when preloading so it doesn't abort.
@@ -118,6 +144,7 @@ bool IRJit::CompileBlock(u32 em_address, std::vector<IRInst> &instructions, u32
 	IRBlock *b = blocks_.GetBlock(block_num);
 	b->SetInstructions(instructions);
 	b->SetOriginalSize(mipsBytes);
+	b->SetCold(cold);
 	if (preload) {
 		// Hash, then only update page stats, don't link yet.
 		b->UpdateHash();
@@ -209,7 +236,8 @@ void IRJit::RunLoopUntil(u64 globalticks) {
 
 	// ApplyRoundingMode(true);
 	// IR Dispatcher
-	
+	const bool profile = g_Config.bJitBlockProfile;
+
 	while (true) {
 		// RestoreRoundingMode(true);
 		CoreTiming::Advance();
@@ -223,7 +251,12 @@ void IRJit::RunLoopUntil(u64 globalticks) {
 			if (opcode == MIPS_EMUHACK_OPCODE) {
 				u32 data = inst & 0xFFFFFF;
 				IRBlock *block = blocks_.GetBlock(data);
-				mips_->pc = IRInterpret(mips_, block->GetInstructions(), block->GetNumInstructions());
+				if (block->IsCold())
+					CountColdRun(data, block);
+				if (profile)
+					RunProfiledBlock(data);
+				else
+					mips_->pc = IRInterpret(mips_, block->GetInstructions(), block->GetNumInstructions());
 			} else {
 				// RestoreRoundingMode(true);
 				Compile(mips_->pc);
@@ -235,6 +268,162 @@ void IRJit::RunLoopUntil(u64 globalticks) {
 	// RestoreRoundingMode(true);
 }
 
+void IRJit::RunProfiledBlock(int block_num) {
+	IRBlock *block = blocks_.GetBlock(block_num);
+	const int startDowncount = mips_->downcount;
+	const bool sample = block->Profile().entries++ % JIT_BLOCK_PROFILE_SAMPLE_RATE == 0;
+	// Not time_now_d(), which is cached and only moves once a frame.
+	std::chrono::steady_clock::time_point startTime;
+	if (sample)
+		startTime = std::chrono::steady_clock::now();
+
+	mips_->pc = IRInterpret(mips_, block->GetInstructions(), block->GetNumInstructions());
+
+	// A syscall in the block may have cleared the cache.
+	block = blocks_.GetBlock(block_num);
+	if (!block)
+		return;
+	JitBlockProfile &profile = block->Profile();
+	if (sample) {
+		profile.sampledSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		profile.samples++;
+	}
+	// Syscalls can also force a timing check, which resets downcount.
+	if (mips_->downcount < startDowncount)
+		profile.cycles += startDowncount - mips_->downcount;
+}
+
+void IRJit::CountColdRun(int block_num, IRBlock *block) {
+	if (tierDone_ != 0) {
+		TakeFinishedTierUps();
+		if (!block->IsCold())
+			return;
+	}
+
+	u32 runs = block->CountColdRun();
+	if (runs == TIER_QUEUE_RUNS)
+		QueueTierUp(block_num, block);
+	else if (runs == TIER_SWITCH_RUNS)
+		FinishTierUp(block_num, block);
+}
+
+void IRJit::QueueTierUp(int block_num, const IRBlock *block) {
+	TierJob job;
+	job.instructions.assign(block->GetInstructions(), block->GetInstructions() + block->GetNumInstructions());
+	job.opts = frontend_.GetOptions();
+	job.started = false;
+	job.done = false;
+
+	{
+		std::lock_guard<std::mutex> guard(tierLock_);
+		job.generation = tierGeneration_;
+		tierJobs_[block_num] = std::move(job);
+		tierQueue_.push_back(block_num);
+	}
+	tierCond_.notify_one();
+}
+
+void IRJit::FinishTierUp(int block_num, IRBlock *block) {
+	{
+		std::lock_guard<std::mutex> guard(tierLock_);
+		auto job = tierJobs_.find(block_num);
+		if (job != tierJobs_.end()) {
+			// Already being worked on, it'll be taken when it's done.  Don't wait for it.
+			if (job->second.started)
+				return;
+			// Still queued, quicker to just do it here than wait behind the others.
+			tierJobs_.erase(job);
+			tierQueue_.erase(std::find(tierQueue_.begin(), tierQueue_.end(), block_num));
+		}
+	}
+
+	std::vector<IRInst> instructions(block->GetInstructions(), block->GetInstructions() + block->GetNumInstructions());
+	std::vector<IRInst> simplified;
+	IRFrontend::ApplyDeferredPasses(instructions, simplified, frontend_.GetOptions());
+	block->SetInstructions(simplified);
+	block->SetCold(false);
+}
+
+void IRJit::TakeFinishedTierUps() {
+	std::lock_guard<std::mutex> guard(tierLock_);
+	for (auto job = tierJobs_.begin(); job != tierJobs_.end(); ) {
+		if (!job->second.done) {
+			++job;
+			continue;
+		}
+
+		IRBlock *block = blocks_.GetBlock(job->first);
+		if (block && block->IsValid() && block->IsCold()) {
+			block->SetInstructions(job->second.instructions);
+			block->SetCold(false);
+		}
+		job = tierJobs_.erase(job);
+	}
+	tierDone_ = 0;
+}
+
+void IRJit::DropInvalidTierUps() {
+	std::lock_guard<std::mutex> guard(tierLock_);
+	for (auto job = tierJobs_.begin(); job != tierJobs_.end(); ) {
+		IRBlock *block = blocks_.GetBlock(job->first);
+		if (block && block->IsValid()) {
+			++job;
+			continue;
+		}
+
+		// A running job finds its entry gone and drops the result.
+		auto queued = std::find(tierQueue_.begin(), tierQueue_.end(), job->first);
+		if (queued != tierQueue_.end())
+			tierQueue_.erase(queued);
+		if (job->second.done)
+			tierDone_--;
+		job = tierJobs_.erase(job);
+	}
+}
+
+void IRJit::ClearTierUps() {
+	std::lock_guard<std::mutex> guard(tierLock_);
+	tierJobs_.clear();
+	tierQueue_.clear();
+	tierDone_ = 0;
+	// Block numbers get reused, so a job that's running now must not be taken for a new one.
+	tierGeneration_++;
+}
+
+void IRJit::TierThread() {
+	setCurrentThreadName("IRTierUp");
+
+	std::unique_lock<std::mutex> guard(tierLock_);
+	while (true) {
+		tierCond_.wait(guard, [&] { return tierStop_ || !tierQueue_.empty(); });
+		if (tierStop_)
+			break;
+
+		int block_num = tierQueue_.front();
+		tierQueue_.pop_front();
+		auto queued = tierJobs_.find(block_num);
+		if (queued == tierJobs_.end())
+			continue;
+		TierJob &job = queued->second;
+		job.started = true;
+		const u32 generation = job.generation;
+		const IROptions opts = job.opts;
+		std::vector<IRInst> instructions = std::move(job.instructions);
+
+		guard.unlock();
+		std::vector<IRInst> simplified;
+		IRFrontend::ApplyDeferredPasses(instructions, simplified, opts);
+		guard.lock();
+
+		auto finished = tierJobs_.find(block_num);
+		if (finished != tierJobs_.end() && finished->second.generation == generation) {
+			finished->second.instructions = std::move(simplified);
+			finished->second.done = true;
+			tierDone_++;
+		}
+	}
+}
+
 bool IRJit::DescribeCodePtr(const u8 *ptr, std::string &name) {
 	// Used in target disassembly viewer.
 	return false;
@@ -255,6 +444,11 @@ bool IRJit::ReplaceJalTo(u32 dest) {
 
 void IRBlockCache::Clear() {
 	for (int i = 0; i < (int)blocks_.size(); ++i) {
+		if (blocks_[i].Profile().entries != 0) {
+			u32 start, size;
+			blocks_[i].GetRange(start, size);
+			profileHistory_.Add(start, size, blocks_[i].Profile());
+		}
 		blocks_[i].Destroy(i);
 	}
 	blocks_.clear();
@@ -376,6 +570,24 @@ JitBlockDebugInfo IRBlockCache::GetBlockDebugInfo(int blockNum) const {
 	return debugInfo;
 }
 
+void IRBlockCache::GetBlockProfile(std::vector<JitBlockProfileInfo> &profile) const {
+	JitBlockProfileHistory merged = profileHistory_;
+	for (const IRBlock &b : blocks_) {
+		if (b.Profile().entries != 0) {
+			u32 start, size;
+			b.GetRange(start, size);
+			merged.Add(start, size, b.Profile());
+		}
+	}
+	merged.Get(profile);
+}
+
+void IRBlockCache::ResetBlockProfile() {
+	profileHistory_.Clear();
+	for (IRBlock &b : blocks_)
+		b.Profile() = JitBlockProfile{};
+}
+
 void IRBlockCache::ComputeStats(BlockCacheStats &bcStats) const {
 	double totalBloat = 0.0;
 	double maxBloat = 0.0;
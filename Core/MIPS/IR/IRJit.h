@@ -17,7 +17,12 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <unordered_map>
 
 #include "Common/Common.h"
@@ -47,6 +52,8 @@ class IRBlock {
 		origSize_ = b.origSize_;
 		origFirstOpcode_ = b.origFirstOpcode_;
 		hash_ = b.hash_;
+		coldRuns_ = b.coldRuns_;
+		profile_ = b.profile_;
 		b.instr_ = nullptr;
 	}
 
@@ -55,6 +62,7 @@ class IRBlock {
 	}
 
 	void SetInstructions(const std::vector<IRInst> &inst) {
+		delete[] instr_;
 		instr_ = new IRInst[inst.size()];
 		numInstructions_ = (u16)inst.size();
 		if (!inst.empty()) {
@@ -84,6 +92,14 @@ class IRBlock {
 		size = origSize_;
 	}
 
+	// Cold blocks still run unsimplified IR, and count their runs until they're switched over.
+	bool IsCold() const { return coldRuns_ != 0; }
+	void SetCold(bool cold) { coldRuns_ = cold ? 1 : 0; }
+	u32 CountColdRun() { return coldRuns_++; }
+
+	JitBlockProfile &Profile() { return profile_; }
+	const JitBlockProfile &Profile() const { return profile_; }
+
 	void Finalize(int number);
 	void Destroy(int number);
 
@@ -96,6 +112,8 @@ class IRBlock {
 	u32 origSize_;
 	u64 hash_ = 0;
 	MIPSOpcode origFirstOpcode_ = MIPSOpcode(0x68FFFFFF);
+	u32 coldRuns_ = 0;
+	JitBlockProfile profile_{};
 };
 
 class IRBlockCache : public JitBlockCacheDebugInterface {
@@ -124,6 +142,8 @@ class IRBlockCache : public JitBlockCacheDebugInterface {
 
 	JitBlockDebugInfo GetBlockDebugInfo(int blockNum) const override;
 	void ComputeStats(BlockCacheStats &bcStats) const override;
+	void GetBlockProfile(std::vector<JitBlockProfileInfo> &profile) const override;
+	void ResetBlockProfile() override;
 	int GetBlockNumberFromStartAddress(u32 em_address, bool realBlocksOnly = true) const override;
 
 private:
@@ -131,6 +151,8 @@ class IRBlockCache : public JitBlockCacheDebugInterface {
 
 	std::vector<IRBlock> blocks_;
 	std::unordered_map<u32, std::vector<int>> byPage_;
+	// Profile counts of blocks from before the last Clear().
+	JitBlockProfileHistory profileHistory_;
 };
 
 class IRJit : public JitInterface {
@@ -169,6 +191,23 @@ class IRJit : public JitInterface {
 	bool CompileBlock(u32 em_address, std::vector<IRInst> &instructions, u32 &mipsBytes, bool preload);
 	bool ReplaceJalTo(u32 dest);
 
+	void CountColdRun(int block_num, IRBlock *block);
+	void RunProfiledBlock(int block_num);
+	void QueueTierUp(int block_num, const IRBlock *block);
+	void FinishTierUp(int block_num, IRBlock *block);
+	void TakeFinishedTierUps();
+	void DropInvalidTierUps();
+	void ClearTierUps();
+	void TierThread();
+
+	struct TierJob {
+		std::vector<IRInst> instructions;
+		IROptions opts;
+		u32 generation;
+		bool started;
+		bool done;
+	};
+
 	JitOptions jo;
 
 	IRFrontend frontend_;
@@ -176,6 +215,19 @@ class IRJit : public JitInterface {
 
 	MIPSState *mips_;
 
+	// With tiering, new blocks skip the simplify passes, and blocks that keep running
+	// get them applied on tierThread_.
+	bool tiering_ = false;
+	std::thread tierThread_;
+	std::mutex tierLock_;
+	std::condition_variable tierCond_;
+	std::unordered_map<int, TierJob> tierJobs_;
+	std::deque<int> tierQueue_;
+	u32 tierGeneration_ = 0;
+	bool tierStop_ = false;
+	// Number of done jobs not yet taken, so cold runs can check without locking.
+	std::atomic<int> tierDone_{};
+
 	// where to write branch-likely trampolines. not used atm
 	// u32 blTrampolines_;
 	// int blTrampolineCount_;
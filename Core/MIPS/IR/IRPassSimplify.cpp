@@ -3,6 +3,7 @@
 #include <utility>
 
 #include "Common/Log.h"
+#include "Core/MemMap.h"
 #include "Core/MIPS/IR/IRInterpreter.h"
 #include "Core/MIPS/IR/IRPassSimplify.h"
 #include "Core/MIPS/IR/IRRegCache.h"
@@ -364,6 +365,23 @@ bool RemoveLoadStoreLeftRight(const IRWriter &in, IRWriter &out, const IROptions
 	return logBlocks;
 }
 
+// Larger memsets aren't worth the extra ops, the native memset wins.
+static const u32 MEMSET_EXPAND_MAX_BYTES = 16;
+
+// Small memsets to a known address are cheaper as plain stores, as long as there are no memchecks.
+static bool CanExpandMemSet(const IRInst &inst, const IRRegCache &gpr) {
+	if (inst.constant == 0 || !gpr.IsImm(inst.src1) || !gpr.IsImm(inst.src2) || !gpr.IsImm(inst.src3))
+		return false;
+	const u32 base = gpr.GetImm(inst.src3);
+	const u32 bytes = gpr.GetImm(inst.src2);
+	if (bytes > MEMSET_EXPAND_MAX_BYTES)
+		return false;
+	if (bytes == 0)
+		return true;
+	// Replacement_Memset() skips bad pointers, and lets the GPU handle VRAM.
+	return Memory::IsValidRange(base, bytes) && !Memory::IsVRAMAddress(base) && !Memory::IsVRAMAddress(base + bytes - 1);
+}
+
 bool PropagateConstants(const IRWriter &in, IRWriter &out, const IROptions &opts) {
 	IRRegCache gpr(&out);
 
@@ -696,6 +714,49 @@ bool PropagateConstants(const IRWriter &in, IRWriter &out, const IROptions &opts
 			gpr.MapDirtyIn(inst.dest, IRREG_VFPU_CTRL_BASE + inst.src1);
 			goto doDefault;
 
+		case IROp::MemSet:
+			if (CanExpandMemSet(inst, gpr)) {
+				const u32 base = gpr.GetImm(inst.src3);
+				const u32 bytes = gpr.GetImm(inst.src2);
+				const u32 word = (gpr.GetImm(inst.src1) & 0xFF) * 0x01010101;
+				int value = MIPS_REG_ZERO;
+				if (word != 0) {
+					value = IRTEMP_0;
+					gpr.SetImm(value, word);
+					gpr.MapIn(value);
+				}
+				// The address is known, so use the widest aligned store at each step.
+				for (u32 offset = 0; offset < bytes; ) {
+					const u32 addr = base + offset;
+					if ((addr & 3) == 0 && bytes - offset >= 4) {
+						out.Write(IROp::Store32, value, MIPS_REG_ZERO, out.AddConstant(addr));
+						offset += 4;
+					} else if ((addr & 1) == 0 && bytes - offset >= 2) {
+						out.Write(IROp::Store16, value, MIPS_REG_ZERO, out.AddConstant(addr));
+						offset += 2;
+					} else {
+						out.Write(IROp::Store8, value, MIPS_REG_ZERO, out.AddConstant(addr));
+						offset += 1;
+					}
+				}
+				// Same cycles as Replacement_Memset().
+				out.Write(IROp::Downcount, 0, out.AddConstant(10 + bytes / 4));
+			} else {
+				gpr.MapInInIn(inst.src3, inst.src1, inst.src2);
+				goto doDefault;
+			}
+			break;
+
+		case IROp::MemCpy:
+			if (gpr.IsImm(inst.src2) && gpr.GetImm(inst.src2) == 0) {
+				// Nothing to copy or check, Replacement_Memcpy() just eats cycles.
+				out.Write(IROp::Downcount, 0, out.AddConstant(10));
+			} else {
+				gpr.MapInInIn(inst.src3, inst.src1, inst.src2);
+				goto doDefault;
+			}
+			break;
+
 		case IROp::CallReplacement:
 		case IROp::Break:
 		case IROp::Syscall:
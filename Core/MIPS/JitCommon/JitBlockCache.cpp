@@ -31,6 +31,7 @@
 #include "Common/CommonWindows.h"
 #endif
 
+#include "Core/Config.h"
 #include "Core/Core.h"
 #include "Core/MemMap.h"
 #include "Core/CoreTiming.h"
@@ -58,6 +59,11 @@ op_agent_t agent;
 #endif
 
 const u32 INVALID_EXIT = 0xFFFFFFFF;
+const u32 INVALID_LINK = 0xFFFFFFFF;
+
+// Blocks are indexed by the 4KB pages of physical memory they overlap.
+static const u32 BLOCK_PAGE_SHIFT = 12;
+static const u32 BLOCK_PAGE_COUNT = 0x20000000 >> BLOCK_PAGE_SHIFT;
 
 JitBlockCache::JitBlockCache(MIPSState *mips, CodeBlockCommon *codeBlock) :
 	codeBlock_(codeBlock), blocks_(nullptr), num_blocks_(0) {
@@ -67,6 +73,53 @@ JitBlockCache::~JitBlockCache() {
 	Shutdown();
 }
 
+// Pages of physical memory a block covers. Empty blocks still go on the page they start in.
+static void GetBlockPageRange(const JitBlock &b, u32 &firstPage, u32 &lastPage) {
+	// Convert the logical address to a physical address for the block map
+	// Yeah, this'll work fine for PSP too I think.
+	const u32 pAddr = b.originalAddress & 0x1FFFFFFF;
+	const u32 pLast = b.originalSize == 0 ? pAddr : pAddr + 4 * b.originalSize - 1;
+	firstPage = pAddr >> BLOCK_PAGE_SHIFT;
+	lastPage = std::min(pLast >> BLOCK_PAGE_SHIFT, BLOCK_PAGE_COUNT - 1);
+}
+
+void JitBlockProfileHistory::Add(u32 address, u32 bytes, const JitBlockProfile &profile) {
+	if (byAddress_.size() >= MAX_ENTRIES && byAddress_.find(address) == byAddress_.end())
+		Prune();
+
+	JitBlockProfileInfo &info = byAddress_[address];
+	info.originalAddress = address;
+	// Recompiled blocks might not end in the same place, so keep the largest.
+	info.originalBytes = std::max(info.originalBytes, bytes);
+	info.profile.Add(profile);
+}
+
+void JitBlockProfileHistory::Prune() {
+	// Drop the colder half, so this only happens once per MAX_ENTRIES / 2 new addresses.
+	std::vector<JitBlockProfileInfo> infos;
+	Get(infos);
+	const size_t keep = MAX_ENTRIES / 2;
+	std::nth_element(infos.begin(), infos.begin() + keep, infos.end(), [](const JitBlockProfileInfo &a, const JitBlockProfileInfo &b) {
+		return a.profile.cycles > b.profile.cycles;
+	});
+
+	byAddress_.clear();
+	for (size_t i = 0; i < keep; ++i)
+		byAddress_[infos[i].originalAddress] = infos[i];
+}
+
+void JitBlockProfileHistory::Get(std::vector<JitBlockProfileInfo> &profile) const {
+	profile.reserve(profile.size() + byAddress_.size());
+	for (const auto &it : byAddress_)
+		profile.push_back(it.second);
+}
+
+static JitBlockProfile BlockProfileWithCycles(const JitBlock &b) {
+	JitBlockProfile profile = b.profile;
+	profile.cycles = profile.entries * b.profileCycles;
+	return profile;
+}
+
 bool JitBlock::ContainsAddress(u32 em_address) {
 	// WARNING - THIS DOES NOT WORK WITH JIT INLINING ENABLED.
 	// However, that doesn't exist yet so meh.
@@ -82,6 +135,7 @@ void JitBlockCache::Init() {
 	agent = op_open_agent();
 #endif
 	blocks_ = new JitBlock[MAX_NUM_BLOCKS];
+	blockPages_.resize(BLOCK_PAGE_COUNT);
 	Clear();
 }
 
@@ -90,6 +144,8 @@ void JitBlockCache::Shutdown() {
 	delete [] blocks_;
 	blocks_ = 0;
 	num_blocks_ = 0;
+	blockPages_.clear();
+	blockPages_.shrink_to_fit();
 #if defined USE_OPROFILE && USE_OPROFILE
 	op_close_agent(agent);
 #endif
@@ -102,11 +158,21 @@ void JitBlockCache::Shutdown() {
 // This clears the JIT cache. It's called from JitCache.cpp when the JIT cache
 // is full and when saving and loading states.
 void JitBlockCache::Clear() {
-	block_map_.clear();
-	proxyBlockMap_.clear();
+	for (int i = 0; i < num_blocks_; i++) {
+		if (blocks_[i].profile.entries != 0)
+			profileHistory_.Add(blocks_[i].originalAddress, 4 * blocks_[i].originalSize, BlockProfileWithCycles(blocks_[i]));
+	}
+
+	// Empty the pages up front, so destroying each block doesn't have to search them.
+	for (int i = 0; i < num_blocks_; i++) {
+		u32 firstPage, lastPage;
+		GetBlockPageRange(blocks_[i], firstPage, lastPage);
+		for (u32 page = firstPage; page <= lastPage; ++page)
+			blockPages_[page].clear();
+	}
 	for (int i = 0; i < num_blocks_; i++)
 		DestroyBlock(i, DestroyType::CLEAR);
-	links_to_.clear();
+	linksToHead_.clear();
 	num_blocks_ = 0;
 
 	blockMemRanges_[JITBLOCK_RANGE_SCRATCH] = std::make_pair(0xFFFFFFFF, 0x00000000);
@@ -130,29 +196,18 @@ const JitBlock *JitBlockCache::GetBlock(int no) const {
 int JitBlockCache::AllocateBlock(u32 startAddress) {
 	JitBlock &b = blocks_[num_blocks_];
 
+	// A pure proxy at this address stays as is: it covers its own range, and keeps its root alive.
 	b.proxyFor = 0;
-	// If there's an existing pure proxy block at the address, we need to ditch it and create a new one,
-	// taking over the proxied blocks.
-	int num = GetBlockNumberFromStartAddress(startAddress, false);
-	if (num >= 0) {
-		if (blocks_[num].IsPureProxy()) {
-			RemoveBlockMap(num);
-			blocks_[num].invalid = true;
-			b.proxyFor = new std::vector<u32>();
-			*b.proxyFor = *blocks_[num].proxyFor;
-			blocks_[num].proxyFor->clear();
-			delete blocks_[num].proxyFor;
-			blocks_[num].proxyFor = 0;
-		}
-	}
-
 	b.invalid = false;
 	b.originalAddress = startAddress;
 	for (int i = 0; i < MAX_JIT_BLOCK_EXITS; ++i) {
 		b.exitAddress[i] = INVALID_EXIT;
 		b.exitPtrs[i] = 0;
 		b.linkStatus[i] = false;
+		b.nextLinkTo[i] = INVALID_LINK;
 	}
+	b.profile = {};
+	b.profileCycles = 0;
 	b.blockNum = num_blocks_;
 	num_blocks_++; //commit the current block
 	return num_blocks_ - 1;
@@ -161,7 +216,7 @@ int JitBlockCache::AllocateBlock(u32 startAddress) {
 void JitBlockCache::ProxyBlock(u32 rootAddress, u32 startAddress, u32 size, const u8 *codePtr) {
 	// If there's an existing block at the startAddress, add rootAddress as a proxy root of that block
 	// instead of creating a new block.
-	int num = GetBlockNumberFromStartAddress(startAddress, false);
+	int num = GetBlockNumberFromStartAddress(startAddress);
 	if (num != -1) {
 		DEBUG_LOG(HLE, "Adding proxy root %08x to block at %08x", rootAddress, startAddress);
 		if (!blocks_[num].proxyFor) {
@@ -178,27 +233,35 @@ void JitBlockCache::ProxyBlock(u32 rootAddress, u32 startAddress, u32 size, cons
 		b.exitAddress[i] = INVALID_EXIT;
 		b.exitPtrs[i] = 0;
 		b.linkStatus[i] = false;
+		b.nextLinkTo[i] = INVALID_LINK;
 	}
 	b.exitAddress[0] = rootAddress;
+	b.profile = {};
+	b.profileCycles = 0;
 	b.blockNum = num_blocks_;
+	// Destroying the proxy must destroy the root, which depends on this code.
 	b.proxyFor = new std::vector<u32>();
+	b.proxyFor->push_back(rootAddress);
 	b.SetPureProxy();  // flag as pure proxy block.
 
 	// Make binary searches and stuff work ok
 	b.normalEntry = codePtr;
 	b.checkedEntry = (u8 *)codePtr;  // Ugh, casting away const..
-	proxyBlockMap_.insert(std::make_pair(startAddress, num_blocks_));
 	AddBlockMap(num_blocks_);
 
 	num_blocks_++; //commit the current block
 }
 
 void JitBlockCache::AddBlockMap(int block_num) {
-	const JitBlock &b = blocks_[block_num];
-	// Convert the logical address to a physical address for the block map
-	// Yeah, this'll work fine for PSP too I think.
-	u32 pAddr = b.originalAddress & 0x1FFFFFFF;
-	block_map_[std::make_pair(pAddr + 4 * b.originalSize, pAddr)] = block_num;
+	u32 firstPage, lastPage;
+	GetBlockPageRange(blocks_[block_num], firstPage, lastPage);
+	for (u32 page = firstPage; page <= lastPage; ++page) {
+		std::vector<int> &pageBlocks = blockPages_[page];
+		// New blocks have the highest number, so this is almost always an append.
+		auto it = std::lower_bound(pageBlocks.begin(), pageBlocks.end(), block_num);
+		if (it == pageBlocks.end() || *it != block_num)
+			pageBlocks.insert(it, block_num);
+	}
 }
 
 void JitBlockCache::RemoveBlockMap(int block_num) {
@@ -207,18 +270,26 @@ void JitBlockCache::RemoveBlockMap(int block_num) {
 		return;
 	}
 
-	const u32 pAddr = b.originalAddress & 0x1FFFFFFF;
-	auto it = block_map_.find(std::make_pair(pAddr + 4 * b.originalSize, pAddr));
-	if (it != block_map_.end() && it->second == (u32)block_num) {
-		block_map_.erase(it);
+	u32 firstPage, lastPage;
+	GetBlockPageRange(b, firstPage, lastPage);
+	for (u32 page = firstPage; page <= lastPage; ++page) {
+		std::vector<int> &pageBlocks = blockPages_[page];
+		auto it = std::lower_bound(pageBlocks.begin(), pageBlocks.end(), block_num);
+		if (it != pageBlocks.end() && *it == block_num)
+			pageBlocks.erase(it);
+	}
+}
+
+void JitBlockCache::AddLinkTo(int block_num, int exit) {
+	JitBlock &b = blocks_[block_num];
+	const u32 link = (u32)block_num * MAX_JIT_BLOCK_EXITS + exit;
+	auto it = linksToHead_.find(b.exitAddress[exit]);
+	if (it == linksToHead_.end()) {
+		b.nextLinkTo[exit] = INVALID_LINK;
+		linksToHead_[b.exitAddress[exit]] = link;
 	} else {
-		// It wasn't in there, or it has the wrong key.  Let's search...
-		for (auto it = block_map_.begin(); it != block_map_.end(); ++it) {
-			if (it->second == (u32)block_num) {
-				block_map_.erase(it);
-				break;
-			}
-		}
+		b.nextLinkTo[exit] = it->second;
+		it->second = link;
 	}
 }
 
@@ -230,6 +301,12 @@ static void ExpandRange(std::pair<u32, u32> &range, u32 newStart, u32 newEnd) {
 void JitBlockCache::FinalizeBlock(int block_num, bool block_link) {
 	JitBlock &b = blocks_[block_num];
 
+	if (g_Config.bJitBlockProfile) {
+		// Summed the same way the jit counts downcount, before the first op becomes an emuhack.
+		for (u32 i = 0; i < b.originalSize; ++i)
+			b.profileCycles += MIPSGetInstructionCycleEstimate(Memory::Read_Opcode_JIT(b.originalAddress + i * 4));
+	}
+
 	b.originalFirstOpcode = Memory::Read_Opcode_JIT(b.originalAddress);
 	MIPSOpcode opcode = GetEmuHackOpForBlock(block_num);
 	Memory::Write_Opcode_JIT(b.originalAddress, opcode);
@@ -239,7 +316,7 @@ void JitBlockCache::FinalizeBlock(int block_num, bool block_link) {
 	if (block_link) {
 		for (int i = 0; i < MAX_JIT_BLOCK_EXITS; i++) {
 			if (b.exitAddress[i] != INVALID_EXIT) {
-				links_to_.insert(std::make_pair(b.exitAddress[i], block_num));
+				AddLinkTo(block_num, i);
 			}
 		}
 
@@ -334,20 +411,12 @@ int JitBlockCache::GetBlockNumberFromStartAddress(u32 addr, bool realBlocksOnly)
 	if (!blocks_ || !Memory::IsValidAddress(addr))
 		return -1;
 
+	// Only real blocks are returned, whatever realBlocksOnly says.  Pure proxies always have proxyFor
+	// set, and are only reached through the page index (like in InvalidateICache.)
 	MIPSOpcode inst = MIPSOpcode(Memory::Read_U32(addr));
 	int bl = GetBlockNumberFromEmuHackOp(inst);
-	if (bl < 0) {
-		if (!realBlocksOnly) {
-			// Wasn't an emu hack op, look through proxyBlockMap_.
-			auto range = proxyBlockMap_.equal_range(addr);
-			for (auto it = range.first; it != range.second; ++it) {
-				const int blockIndex = it->second;
-				if (blocks_[blockIndex].originalAddress == addr && !blocks_[blockIndex].proxyFor && !blocks_[blockIndex].invalid)
-					return blockIndex;
-			}
-		}
+	if (bl < 0)
 		return -1;
-	}
 
 	if (blocks_[bl].originalAddress != addr)
 		return -1;
@@ -356,7 +425,9 @@ int JitBlockCache::GetBlockNumberFromStartAddress(u32 addr, bool realBlocksOnly)
 }
 
 void JitBlockCache::GetBlockNumbersFromAddress(u32 em_address, std::vector<int> *block_numbers) {
-	for (int i = 0; i < num_blocks_; i++)
+	if (!blocks_)
+		return;
+	for (int i : blockPages_[(em_address & 0x1FFFFFFF) >> BLOCK_PAGE_SHIFT])
 		if (blocks_[i].ContainsAddress(em_address))
 			block_numbers->push_back(i);
 }
@@ -396,7 +467,7 @@ void JitBlockCache::LinkBlockExits(int i) {
 
 	for (int e = 0; e < MAX_JIT_BLOCK_EXITS; e++) {
 		if (b.exitAddress[e] != INVALID_EXIT && !b.linkStatus[e]) {
-			int destinationBlock = GetBlockNumberFromStartAddress(b.exitAddress[e], true);
+			int destinationBlock = GetBlockNumberFromStartAddress(b.exitAddress[e]);
 			if (destinationBlock == -1) {
 				continue;
 			}
@@ -414,28 +485,27 @@ void JitBlockCache::LinkBlockExits(int i) {
 void JitBlockCache::LinkBlock(int i) {
 	LinkBlockExits(i);
 	JitBlock &b = blocks_[i];
-	// equal_range(b) returns pair<iterator,iterator> representing the range
-	// of element with key b
-	auto ppp = links_to_.equal_range(b.originalAddress);
-	if (ppp.first == ppp.second)
+	auto head = linksToHead_.find(b.originalAddress);
+	if (head == linksToHead_.end())
 		return;
-	for (auto iter = ppp.first; iter != ppp.second; ++iter) {
-		// PanicAlert("Linking block %i to block %i", iter->second, i);
-		LinkBlockExits(iter->second);
+	for (u32 link = head->second; link != INVALID_LINK; ) {
+		const int source = link / MAX_JIT_BLOCK_EXITS;
+		// PanicAlert("Linking block %i to block %i", source, i);
+		LinkBlockExits(source);
+		link = blocks_[source].nextLinkTo[link % MAX_JIT_BLOCK_EXITS];
 	}
 }
 
 void JitBlockCache::UnlinkBlock(int i) {
 	JitBlock &b = blocks_[i];
-	auto ppp = links_to_.equal_range(b.originalAddress);
-	if (ppp.first == ppp.second)
+	auto head = linksToHead_.find(b.originalAddress);
+	if (head == linksToHead_.end())
 		return;
-	for (auto iter = ppp.first; iter != ppp.second; ++iter) {
-		JitBlock &sourceBlock = blocks_[iter->second];
-		for (int e = 0; e < MAX_JIT_BLOCK_EXITS; e++) {
-			if (sourceBlock.exitAddress[e] == b.originalAddress)
-				sourceBlock.linkStatus[e] = false;
-		}
+	for (u32 link = head->second; link != INVALID_LINK; ) {
+		JitBlock &sourceBlock = blocks_[link / MAX_JIT_BLOCK_EXITS];
+		const int e = link % MAX_JIT_BLOCK_EXITS;
+		sourceBlock.linkStatus[e] = false;
+		link = sourceBlock.nextLinkTo[e];
 	}
 }
 
@@ -494,7 +564,7 @@ void JitBlockCache::DestroyBlock(int block_num, DestroyType type) {
 	// this block or its 'parent', so now that this block has changed, the root block must be destroyed.
 	if (b->proxyFor) {
 		for (size_t i = 0; i < b->proxyFor->size(); i++) {
-			int proxied_blocknum = GetBlockNumberFromStartAddress((*b->proxyFor)[i], false);
+			int proxied_blocknum = GetBlockNumberFromStartAddress((*b->proxyFor)[i]);
 			// If it was already cleared, we don't know which to destroy.
 			if (proxied_blocknum != -1) {
 				DestroyBlock(proxied_blocknum, type);
@@ -504,14 +574,6 @@ void JitBlockCache::DestroyBlock(int block_num, DestroyType type) {
 		delete b->proxyFor;
 		b->proxyFor = 0;
 	}
-	auto range = proxyBlockMap_.equal_range(b->originalAddress);
-	for (auto it = range.first; it != range.second; ++it) {
-		if (it->second == block_num) {
-			// Found it.  Delete and bail.
-			proxyBlockMap_.erase(it);
-			break;
-		}
-	}
 
 	// TODO: Handle the case when there's a proxy block and a regular JIT block at the same location.
 	// In this case we probably "leak" the proxy block currently (no memory leak but it'll stay enabled).
@@ -562,26 +624,28 @@ void JitBlockCache::InvalidateICache(u32 address, const u32 length) {
 		InvalidateChangedBlocks();
 		return;
 	}
+	if (!blocks_)
+		return;
 
-	// Blocks may start and end in overlapping ways, and destroying one invalidates iterators.
-	// So after destroying one, we start over.
-	do {
-	restart:
-		auto next = block_map_.lower_bound(std::make_pair(pAddr, 0));
-		auto last = block_map_.upper_bound(std::make_pair(pEnd + MAX_BLOCK_INSTRUCTIONS, 0));
-		// Note that if next is end(), last will be end() too (equal.)
-		for (; next != last; ++next) {
-			const u32 blockStart = next->first.second;
-			const u32 blockEnd = next->first.first;
-			if (blockStart < pEnd && blockEnd > pAddr) {
-				DestroyBlock(next->second, DestroyType::INVALIDATE);
-				// Our iterator is now invalid.  Break and search again.
-				// Most of the time there shouldn't be a bunch of matching blocks.
-				goto restart;
-			}
+	// Destroying a block changes the pages (and may destroy the blocks it's a proxy for), so collect first.
+	std::vector<int> overlapping;
+	const u32 firstPage = pAddr >> BLOCK_PAGE_SHIFT;
+	const u32 lastPage = std::min((pEnd == pAddr ? pAddr : pEnd - 1) >> BLOCK_PAGE_SHIFT, BLOCK_PAGE_COUNT - 1);
+	for (u32 page = firstPage; page <= lastPage; ++page) {
+		for (int block_num : blockPages_[page]) {
+			const JitBlock &b = blocks_[block_num];
+			const u32 blockStart = b.originalAddress & 0x1FFFFFFF;
+			const u32 blockEnd = blockStart + 4 * b.originalSize;
+			if (blockStart < pEnd && blockEnd > pAddr)
+				overlapping.push_back(block_num);
 		}
-		// We got here - it wasn't in the map at all (or anymore.)
-	} while (false);
+	}
+
+	for (int block_num : overlapping) {
+		// Might've been on multiple pages, or already destroyed through a proxy.
+		if (!blocks_[block_num].invalid)
+			DestroyBlock(block_num, DestroyType::INVALIDATE);
+	}
 }
 
 void JitBlockCache::InvalidateChangedBlocks() {
@@ -642,6 +706,21 @@ void JitBlockCache::ComputeStats(BlockCacheStats &bcStats) const {
 	bcStats.avgBloat = totalBloat / (double)num_blocks_;
 }
 
+void JitBlockCache::GetBlockProfile(std::vector<JitBlockProfileInfo> &profile) const {
+	JitBlockProfileHistory merged = profileHistory_;
+	for (int i = 0; i < num_blocks_; i++) {
+		if (blocks_[i].profile.entries != 0)
+			merged.Add(blocks_[i].originalAddress, 4 * blocks_[i].originalSize, BlockProfileWithCycles(blocks_[i]));
+	}
+	merged.Get(profile);
+}
+
+void JitBlockCache::ResetBlockProfile() {
+	profileHistory_.Clear();
+	for (int i = 0; i < num_blocks_; i++)
+		blocks_[i].profile = {};
+}
+
 JitBlockDebugInfo JitBlockCache::GetBlockDebugInfo(int blockNum) const {
 	JitBlockDebugInfo debugInfo{};
 	const JitBlock *block = GetBlock(blockNum);
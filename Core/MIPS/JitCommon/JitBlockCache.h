@@ -43,6 +43,54 @@ struct BlockCacheStats {
 	std::map<float, u32> bloatMap;
 };
 
+// Counts for the block profiler (g_Config.bJitBlockProfile.)
+struct JitBlockProfile {
+	u64 entries;
+	// Emulated cycles, measured where the backend can, otherwise estimated from the instructions.
+	u64 cycles;
+	// Host time of every JIT_BLOCK_PROFILE_SAMPLE_RATE-th entry, if the backend samples it.
+	double sampledSeconds;
+	u32 samples;
+
+	void Add(const JitBlockProfile &other) {
+		entries += other.entries;
+		cycles += other.cycles;
+		sampledSeconds += other.sampledSeconds;
+		samples += other.samples;
+	}
+	// Sampled time scaled up to all entries.
+	double EstimatedSeconds() const {
+		return samples == 0 ? 0.0 : sampledSeconds * ((double)entries / (double)samples);
+	}
+};
+
+// Timing every entry would mostly measure the timer, so only some are sampled.
+const u32 JIT_BLOCK_PROFILE_SAMPLE_RATE = 64;
+
+struct JitBlockProfileInfo {
+	u32 originalAddress;
+	u32 originalBytes;
+	JitBlockProfile profile;
+};
+
+// Keeps profile counts by address, so they survive blocks being cleared and recompiled.
+// Only the hottest addresses are kept once there are many, so code that keeps changing can't grow it forever.
+class JitBlockProfileHistory {
+public:
+	enum { MAX_ENTRIES = 8192 };
+
+	void Add(u32 address, u32 bytes, const JitBlockProfile &profile);
+	void Get(std::vector<JitBlockProfileInfo> &profile) const;
+	void Clear() {
+		byAddress_.clear();
+	}
+
+private:
+	void Prune();
+
+	std::unordered_map<u32, JitBlockProfileInfo> byAddress_;
+};
+
 enum class DestroyType {
 	DESTROY,
 	INVALIDATE,
@@ -64,6 +112,8 @@ struct JitBlock {
 
 	u8 *exitPtrs[MAX_JIT_BLOCK_EXITS];      // to be able to rewrite the exit jump
 	u32 exitAddress[MAX_JIT_BLOCK_EXITS];   // 0xFFFFFFFF == unknown
+	// Next exit (blockNum * MAX_JIT_BLOCK_EXITS + exit) that links to the same address, or 0xFFFFFFFF.
+	u32 nextLinkTo[MAX_JIT_BLOCK_EXITS];
 
 	u32 originalAddress;
 	MIPSOpcode originalFirstOpcode; //to be able to restore
@@ -74,6 +124,11 @@ struct JitBlock {
 	bool invalid;
 	bool linkStatus[MAX_JIT_BLOCK_EXITS];
 
+	// Only counted when the block was compiled with the profiler on.
+	JitBlockProfile profile;
+	// Estimated cycles per entry, since native code doesn't measure them.
+	u32 profileCycles;
+
 #ifdef USE_VTUNE
 	char blockName[32];
 #endif
@@ -106,6 +161,9 @@ class JitBlockCacheDebugInterface {
 	virtual int GetBlockNumberFromStartAddress(u32 em_address, bool realBlocksOnly = true) const = 0;
 	virtual JitBlockDebugInfo GetBlockDebugInfo(int blockNum) const = 0;
 	virtual void ComputeStats(BlockCacheStats &bcStats) const = 0;
+	// All blocks profiled since the last reset, merged by start address.
+	virtual void GetBlockProfile(std::vector<JitBlockProfileInfo> &profile) const = 0;
+	virtual void ResetBlockProfile() = 0;
 
 	virtual ~JitBlockCacheDebugInterface() {}
 };
@@ -127,6 +185,8 @@ class JitBlockCache : public JitBlockCacheDebugInterface {
 
 	bool IsFull() const;
 	void ComputeStats(BlockCacheStats &bcStats) const override;
+	void GetBlockProfile(std::vector<JitBlockProfileInfo> &profile) const override;
+	void ResetBlockProfile() override;
 
 	// Code Cache
 	JitBlock *GetBlock(int block_num);
@@ -137,8 +197,7 @@ class JitBlockCache : public JitBlockCacheDebugInterface {
 
 	// slower, but can get numbers from within blocks, not just the first instruction.
 	// WARNING! WILL NOT WORK WITH JIT INLINING ENABLED (not yet a feature but will be soon)
-	// Returns a list of block numbers - only one block can start at a particular address, but they CAN overlap.
-	// This one is slow so should only be used for one-shots from the debugger UI, not for anything during runtime.
+	// Returns a list of valid block numbers - only one block can start at a particular address, but they CAN overlap.
 	void GetBlockNumbersFromAddress(u32 em_address, std::vector<int> *block_numbers);
 	int GetBlockNumberFromEmuHackOp(MIPSOpcode inst, bool ignoreBad = false) const;
 
@@ -175,16 +234,20 @@ class JitBlockCache : public JitBlockCacheDebugInterface {
 
 	void AddBlockMap(int block_num);
 	void RemoveBlockMap(int block_num);
+	void AddLinkTo(int block_num, int exit);
 
 	MIPSOpcode GetEmuHackOpForBlock(int block_num) const;
 
 	CodeBlockCommon *codeBlock_;
 	JitBlock *blocks_;
-	std::unordered_multimap<u32, int> proxyBlockMap_;
 
 	int num_blocks_;
-	std::unordered_multimap<u32, int> links_to_;
-	std::map<std::pair<u32,u32>, u32> block_map_; // (end_addr, start_addr) -> number
+	// Exit address -> first exit linking to it, the rest are chained through JitBlock::nextLinkTo.
+	std::unordered_map<u32, u32> linksToHead_;
+	// Per 4KB page of physical memory, the numbers (sorted) of blocks and proxies overlapping it.
+	std::vector<std::vector<int>> blockPages_;
+	// Profile counts of blocks from before the last Clear().
+	JitBlockProfileHistory profileHistory_;
 
 	enum {
 		JITBLOCK_RANGE_SCRATCH = 0,
@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
 #include <cstdlib>
 
 #include "ext/disarm.h"
@@ -26,6 +27,7 @@
 #include "Core/Util/DisArm64.h"
 #include "Core/Config.h"
 
+#include "Core/MIPS/JitCommon/JitBlockCache.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/MIPS/JitCommon/JitState.h"
 #include "Core/MIPS/IR/IRJit.h"
@@ -48,6 +50,26 @@ namespace MIPSComp {
 		jit->Compile(currentMIPS->pc);
 	}
 
+	void GetHotBlockProfile(std::vector<JitBlockProfileInfo> &profile, size_t maxBlocks) {
+		profile.clear();
+		JitBlockCacheDebugInterface *blocks = jit ? jit->GetBlockCacheDebugInterface() : nullptr;
+		if (!blocks)
+			return;
+		blocks->GetBlockProfile(profile);
+
+		// If no time was actually measured (e.g. a coarse clock), ranking by it would just be noise.
+		const bool sampled = std::any_of(profile.begin(), profile.end(), [](const JitBlockProfileInfo &info) {
+			return info.profile.sampledSeconds > 0.0;
+		});
+		const size_t count = std::min(profile.size(), maxBlocks);
+		std::partial_sort(profile.begin(), profile.begin() + count, profile.end(), [&](const JitBlockProfileInfo &a, const JitBlockProfileInfo &b) {
+			if (sampled)
+				return a.profile.EstimatedSeconds() > b.profile.EstimatedSeconds();
+			return a.profile.cycles > b.profile.cycles;
+		});
+		profile.resize(count);
+	}
+
 	void DoDummyJitState(PointerWrap &p) {
 		// This is here so the savestate matches between jit and non-jit.
 		auto s = p.Section("Jit", 1, 2);
@@ -30,6 +30,7 @@ std::vector<std::string> DisassembleArm64(const u8 *data, int size);
 std::vector<std::string> DisassembleX86(const u8 *data, int size);
 
 struct JitBlock;
+struct JitBlockProfileInfo;
 class JitBlockCache;
 class JitBlockCacheDebugInterface;
 class PointerWrap;
@@ -42,6 +43,9 @@ class MIPSState;
 
 namespace MIPSComp {
 	void JitAt();
+	// The hottest blocks seen by the profiler (g_Config.bJitBlockProfile), hottest first.
+	// Ordered by sampled host time where the jit samples it, otherwise by emulated cycles.
+	void GetHotBlockProfile(std::vector<JitBlockProfileInfo> &profile, size_t maxBlocks);
 
 	class MIPSFrontendInterface {
 	public:
@@ -205,8 +205,9 @@ namespace MIPSComp {
 		POINTERIFY = 0x00400000,
 		STATIC_ALLOC = 0x00800000,
 		CACHE_POINTERS = 0x01000000,
+		DEAD_FLUSH = 0x02000000,
 
-		ALL_FLAGS = 0x01FFFFFF,
+		ALL_FLAGS = 0x03FFFFFF,
 	};
 
 	struct JitOptions {
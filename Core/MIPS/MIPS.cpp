@@ -166,6 +166,7 @@ void MIPSState::Shutdown() {
 		delete MIPSComp::jit;
 		MIPSComp::jit = 0;
 	}
+	MIPSInterpret_ClearCache();
 }
 
 void MIPSState::Reset() {
@@ -322,12 +323,13 @@ int MIPSState::RunLoopUntil(u64 globalTicks) {
 }
 
 void MIPSState::InvalidateICache(u32 address, int length) {
-	// Only really applies to jit.
 	if (MIPSComp::jit)
 		MIPSComp::jit->InvalidateCacheAt(address, length);
+	MIPSInterpret_InvalidateCache(address, length);
 }
 
 void MIPSState::ClearJitCache() {
 	if (MIPSComp::jit)
 		MIPSComp::jit->ClearCache();
+	MIPSInterpret_ClearCache();
 }
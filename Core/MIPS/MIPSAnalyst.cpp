@@ -15,6 +15,8 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+#include <functional>
 #include <map>
 #include <set>
 #include <unordered_map>
@@ -24,6 +26,7 @@
 #include "base/timeutil.h"
 #include "ext/cityhash/city.h"
 #include "Common/FileUtil.h"
+#include "Common/ThreadPools.h"
 #include "Core/Config.h"
 #include "Core/MemMap.h"
 #include "Core/System.h"
@@ -34,6 +37,7 @@
 #include "Core/MIPS/MIPSCodeUtils.h"
 #include "Core/Debugger/SymbolMap.h"
 #include "Core/Debugger/DebugInterface.h"
+#include "Core/ELF/ParamSFO.h"
 #include "Core/HLE/ReplaceTables.h"
 #include "ext/xxhash.h"
 
@@ -76,6 +80,65 @@ static std::unordered_set<HashMapFunc> hashMap;
 
 static std::string hashmapFileName;
 
+// Scan and hash results are cached per game, keyed by a hash of the code they came from.
+enum {
+	FUNC_CACHE_MAGIC = 0x43464150,  // PAFC
+	FUNC_CACHE_VERSION = 1,
+
+	FUNC_CACHE_STRAIGHT_LEAF = 1,
+	FUNC_CACHE_HAS_HASH = 2,
+};
+
+struct FuncCacheHeader {
+	u32 magic;
+	u32 version;
+	u32 count;
+};
+
+struct FuncCacheScan {
+	u64 codeHash;
+	u32 start;
+	u32 end;
+	// The scan may look ahead past end, so the code hash covers up to here.
+	u32 readEnd;
+	u32 count;
+};
+
+struct FuncCacheFunc {
+	u64 hash;
+	u32 start;
+	u32 end;
+	u32 flags;
+	u32 pad;
+};
+
+struct CachedScan {
+	FuncCacheScan scan;
+	std::vector<FuncCacheFunc> funcs;
+};
+
+// Scanned but not yet hashed, stored after FinalizeScan().
+struct PendingScan {
+	FuncCacheScan scan;
+	size_t first;
+};
+
+// Ranges are scanned in chunks of this size on the thread pool.
+static const u32 SCAN_CHUNK_BYTES = 0x10000;
+
+struct ScanChunkResult {
+	std::vector<MIPSAnalyst::AnalyzedFunction> found;
+	// Where the scan of each found function started, before skipping any nop padding.
+	std::vector<u32> foundStarts;
+	// Start of the function the scan stopped at, or INVALIDTARGET if it reached the end.
+	u32 stopAddr;
+	u32 readEnd;
+};
+
+static std::string funcCachePath;
+static std::unordered_map<u64, CachedScan> funcCache;
+static std::vector<PendingScan> pendingScans;
+
 #define MIPSTABLE_IMM_MASK 0xFC000000
 
 // Similar to HashMapFunc but has a char pointer for the name for efficiency.
@@ -748,6 +811,7 @@ namespace MIPSAnalyst {
 		std::lock_guard<std::recursive_mutex> guard(functions_lock);
 		functions.clear();
 		hashToFunction.clear();
+		pendingScans.clear();
 	}
 
 	void UpdateHashToFunctionMap() {
@@ -872,40 +936,48 @@ namespace MIPSAnalyst {
 		return DetermineRegisterUsage(reg, addr, instrs) == USAGE_CLOBBERED;
 	}
 
-	void HashFunctions() {
-		std::lock_guard<std::recursive_mutex> guard(functions_lock);
-		std::vector<u32> buffer;
+	static void HashFunction(AnalyzedFunction &f, std::vector<u32> &buffer) {
+		if (f.hashCached) {
+			f.hashCached = false;
+			return;
+		}
+		if (!Memory::IsValidRange(f.start, f.end - f.start + 4)) {
+			return;
+		}
 
-		for (auto iter = functions.begin(), end = functions.end(); iter != end; iter++) {
-			AnalyzedFunction &f = *iter;
-			if (!Memory::IsValidRange(f.start, f.end - f.start + 4)) {
-				continue;
+		// This is unfortunate.  In case of emuhacks or relocs, we have to make a copy.
+		buffer.resize((f.end - f.start + 4) / 4);
+		size_t pos = 0;
+		for (u32 addr = f.start; addr <= f.end; addr += 4) {
+			u32 validbits = 0xFFFFFFFF;
+			MIPSOpcode instr = Memory::ReadUnchecked_Instruction(addr, true);
+			if (MIPS_IS_EMUHACK(instr)) {
+				f.hasHash = false;
+				return;
 			}
 
-			// This is unfortunate.  In case of emuhacks or relocs, we have to make a copy.
-			buffer.resize((f.end - f.start + 4) / 4);
-			size_t pos = 0;
-			for (u32 addr = f.start; addr <= f.end; addr += 4) {
-				u32 validbits = 0xFFFFFFFF;
-				MIPSOpcode instr = Memory::ReadUnchecked_Instruction(addr, true);
-				if (MIPS_IS_EMUHACK(instr)) {
-					f.hasHash = false;
-					goto skip;
-				}
+			MIPSInfo flags = MIPSGetInfo(instr);
+			if (flags & IN_IMM16)
+				validbits &= ~0xFFFF;
+			if (flags & IN_IMM26)
+				validbits &= ~0x03FFFFFF;
+			buffer[pos++] = instr & validbits;
+		}
 
-				MIPSInfo flags = MIPSGetInfo(instr);
-				if (flags & IN_IMM16)
-					validbits &= ~0xFFFF;
-				if (flags & IN_IMM26)
-					validbits &= ~0x03FFFFFF;
-				buffer[pos++] = instr & validbits;
-			}
+		f.hash = CityHash64((const char *) &buffer[0], buffer.size() * sizeof(u32));
+		f.hasHash = true;
+	}
 
-			f.hash = CityHash64((const char *) &buffer[0], buffer.size() * sizeof(u32));
-			f.hasHash = true;
-skip:
-			;
-		}
+	void HashFunctions() {
+		std::lock_guard<std::recursive_mutex> guard(functions_lock);
+
+		// Each function is hashed independently, so this is the same in any order.
+		GlobalThreadPool::Loop([&](int lower, int upper) {
+			std::vector<u32> buffer;
+			for (int i = lower; i < upper; ++i) {
+				HashFunction(functions[i], buffer);
+			}
+		}, 0, (int)functions.size());
 	}
 
 	void PrecompileFunction(u32 startAddr, u32 length) {
@@ -958,7 +1030,14 @@ namespace MIPSAnalyst {
 		return IsDefaultFunction(name.c_str());
 	}
 
-	static u32 ScanAheadForJumpback(u32 fromAddr, u32 knownStart, u32 knownEnd) {
+	// Unlike Memory::Read_Instruction(), this has no side effects on bad addresses, so it's safe on any thread.
+	static MIPSOpcode ScanReadInstruction(u32 addr) {
+		if (!Memory::IsValidAddress(addr))
+			return MIPSOpcode(0);
+		return Memory::Read_Instruction(addr, true);
+	}
+
+	static u32 ScanAheadForJumpback(u32 fromAddr, u32 knownStart, u32 knownEnd, u32 &readEnd) {
 		static const u32 MAX_AHEAD_SCAN = 0x1000;
 		// Maybe a bit high... just to make sure we don't get confused by recursive tail recursion.
 		static const u32 MAX_FUNC_SIZE = 0x20000;
@@ -977,7 +1056,8 @@ namespace MIPSAnalyst {
 		u32 furthestJumpbackAddr = INVALIDTARGET;
 
 		for (u32 ahead = fromAddr; ahead < fromAddr + MAX_AHEAD_SCAN; ahead += 4) {
-			MIPSOpcode aheadOp = Memory::Read_Instruction(ahead, true);
+			readEnd = std::max(readEnd, ahead + 4);
+			MIPSOpcode aheadOp = ScanReadInstruction(ahead);
 			u32 target = GetBranchTargetNoRA(ahead, aheadOp);
 			if (target == INVALIDTARGET && ((aheadOp & 0xFC000000) == 0x08000000)) {
 				target = GetJumpTarget(ahead);
@@ -1001,7 +1081,7 @@ namespace MIPSAnalyst {
 
 		if (closestJumpbackAddr != INVALIDTARGET && furthestJumpbackAddr == INVALIDTARGET) {
 			for (u32 behind = closestJumpbackTarget; behind < fromAddr; behind += 4) {
-				MIPSOpcode behindOp = Memory::Read_Instruction(behind, true);
+				MIPSOpcode behindOp = ScanReadInstruction(behind);
 				u32 target = GetBranchTargetNoRA(behind, behindOp);
 				if (target == INVALIDTARGET && ((behindOp & 0xFC000000) == 0x08000000)) {
 					target = GetJumpTarget(behind);
@@ -1018,10 +1098,168 @@ namespace MIPSAnalyst {
 		return furthestJumpbackAddr;
 	}
 
-	bool ScanForFunctions(u32 startAddr, u32 endAddr, bool insertSymbols) {
+	// Returns the new insertSymbols value.
+	static bool CheckSymbolMapFunction(AnalyzedFunction &f, bool insertSymbols) {
+		// Check if we already have symbol info starting here.  If so, skip insertion.
+		// We used to use the symbols to find the functions, but sometimes we'd find
+		// wrong ones due to two modules with the same name.
+		u32 existingSize = g_symbolMap->GetFunctionSize(f.start);
+		if (existingSize != SymbolMap::INVALID_ADDRESS) {
+			f.foundInSymbolMap = true;
+
+			// If we run into a func with a different size, skip updating the hash map.
+			// This will prevent us saving incorrectly named funcs with wrong hashes.
+			u32 detectedSize = f.end - f.start + 4;
+			if (existingSize != detectedSize) {
+				insertSymbols = false;
+			}
+		}
+		return insertSymbols;
+	}
+
+	static u64 FuncCacheKey(u32 start, u32 end) {
+		return ((u64)start << 32) | end;
+	}
+
+	static u64 HashScannedCode(u32 start, u32 readEnd) {
+		if (!Memory::IsValidAddress(start) || readEnd <= start)
+			return 0;
+		u32 size = Memory::ValidSize(start, readEnd - start);
+		return XXH64(Memory::GetPointerUnchecked(start), size, 0);
+	}
+
+	static void LoadFuncCache() {
+		std::string discID = g_paramSFO.GetDiscID();
+		std::string path = discID.empty() ? "" : GetSysDirectory(DIRECTORY_APP_CACHE) + "/" + discID + ".funccache";
+		if (path == funcCachePath)
+			return;
+		funcCachePath = path;
+		funcCache.clear();
+
+		FILE *f = path.empty() ? nullptr : File::OpenCFile(path, "rb");
+		if (!f)
+			return;
+
+		FuncCacheHeader header;
+		bool valid = fread(&header, sizeof(header), 1, f) == 1 && header.magic == FUNC_CACHE_MAGIC && header.version == FUNC_CACHE_VERSION;
+		for (u32 i = 0; valid && i < header.count; ++i) {
+			CachedScan cached;
+			valid = fread(&cached.scan, sizeof(cached.scan), 1, f) == 1 && cached.scan.end >= cached.scan.start;
+			valid = valid && cached.scan.count <= (cached.scan.end - cached.scan.start) / 4 + 1;
+			if (valid && cached.scan.count != 0) {
+				cached.funcs.resize(cached.scan.count);
+				valid = fread(&cached.funcs[0], sizeof(FuncCacheFunc), cached.scan.count, f) == cached.scan.count;
+			}
+			if (valid)
+				funcCache[FuncCacheKey(cached.scan.start, cached.scan.end)] = std::move(cached);
+		}
+		fclose(f);
+		if (!valid) {
+			WARN_LOG(LOADER, "Bad function analysis cache %s, ignoring", path.c_str());
+			funcCache.clear();
+		}
+	}
+
+	static void SaveFuncCache() {
+		File::CreateFullPath(GetSysDirectory(DIRECTORY_APP_CACHE));
+		FILE *f = File::OpenCFile(funcCachePath, "wb");
+		if (!f) {
+			WARN_LOG(LOADER, "Could not store function analysis cache: %s", funcCachePath.c_str());
+			return;
+		}
+
+		FuncCacheHeader header{ FUNC_CACHE_MAGIC, FUNC_CACHE_VERSION, (u32)funcCache.size() };
+		fwrite(&header, sizeof(header), 1, f);
+		for (const auto &it : funcCache) {
+			fwrite(&it.second.scan, sizeof(it.second.scan), 1, f);
+			if (!it.second.funcs.empty())
+				fwrite(&it.second.funcs[0], sizeof(FuncCacheFunc), it.second.funcs.size(), f);
+		}
+		fclose(f);
+	}
+
+	// If this exact code was scanned before, adds the cached functions and returns true.
+	static bool ReadCachedScan(u32 startAddr, u32 endAddr, bool &insertSymbols) {
+		if (!g_Config.bFuncAnalysisCache)
+			return false;
+		LoadFuncCache();
+
+		auto it = funcCache.find(FuncCacheKey(startAddr, endAddr));
+		if (it == funcCache.end() || HashScannedCode(startAddr, it->second.scan.readEnd) != it->second.scan.codeHash)
+			return false;
+
+		for (const FuncCacheFunc &entry : it->second.funcs) {
+			AnalyzedFunction f = {entry.start};
+			f.end = entry.end;
+			f.hash = entry.hash;
+			f.isStraightLeaf = (entry.flags & FUNC_CACHE_STRAIGHT_LEAF) != 0;
+			f.hasHash = (entry.flags & FUNC_CACHE_HAS_HASH) != 0;
+			f.hashCached = true;
+			insertSymbols = CheckSymbolMapFunction(f, insertSymbols);
+			functions.push_back(f);
+		}
+		return true;
+	}
+
+	static void AddPendingScan(u32 startAddr, u32 endAddr, u32 readEnd, size_t first) {
+		if (!g_Config.bFuncAnalysisCache || funcCachePath.empty())
+			return;
+
+		PendingScan pending;
+		pending.scan.codeHash = HashScannedCode(startAddr, readEnd);
+		pending.scan.start = startAddr;
+		pending.scan.end = endAddr;
+		pending.scan.readEnd = readEnd;
+		pending.scan.count = (u32)(functions.size() - first);
+		pending.first = first;
+		pendingScans.push_back(pending);
+	}
+
+	// Called once the functions are hashed.
+	static void StorePendingScans() {
 		std::lock_guard<std::recursive_mutex> guard(functions_lock);
+		if (pendingScans.empty())
+			return;
+
+		for (const PendingScan &pending : pendingScans) {
+			CachedScan &cached = funcCache[FuncCacheKey(pending.scan.start, pending.scan.end)];
+			cached.scan = pending.scan;
+			cached.funcs.clear();
+			for (size_t i = pending.first; i < pending.first + pending.scan.count && i < functions.size(); ++i) {
+				const AnalyzedFunction &f = functions[i];
+				FuncCacheFunc entry{ f.hash, f.start, f.end, 0, 0 };
+				if (f.isStraightLeaf)
+					entry.flags |= FUNC_CACHE_STRAIGHT_LEAF;
+				if (f.hasHash)
+					entry.flags |= FUNC_CACHE_HAS_HASH;
+				cached.funcs.push_back(entry);
+			}
+			cached.scan.count = (u32)cached.funcs.size();
+		}
+		pendingScans.clear();
+		SaveFuncCache();
+	}
+
+	static void FinishScannedFunctions(bool insertSymbols) {
+		for (auto iter = functions.begin(); iter != functions.end(); iter++) {
+			iter->size = iter->end - iter->start + 4;
+			if (insertSymbols && !iter->foundInSymbolMap) {
+				char temp[256];
+				g_symbolMap->AddFunction(DefaultFunctionName(temp, iter->start), iter->start, iter->end - iter->start + 4);
+			}
+		}
+	}
+
+	// Scans from startAddr, which must be the start of a function, until stopAt() accepts the start of a new function.
+	// Once a function ends, what follows depends only on memory and the address, never on earlier functions.
+	// That's what makes it safe to scan chunks of a range separately.
+	static void ScanFunctionChunk(u32 startAddr, u32 endAddr, const std::function<bool(u32)> &stopAt, ScanChunkResult &result) {
+		// The delay slot of the last instruction may be read too.
+		result.readEnd = endAddr + 8;
+		result.stopAddr = INVALIDTARGET;
 
 		AnalyzedFunction currentFunction = {startAddr};
+		u32 scanStart = startAddr;
 
 		u32 furthestBranch = 0;
 		bool looking = false;
@@ -1031,7 +1269,7 @@ namespace MIPSAnalyst {
 
 		u32 addr;
 		for (addr = startAddr; addr <= endAddr; addr += 4) {
-			MIPSOpcode op = Memory::Read_Instruction(addr, true);
+			MIPSOpcode op = ScanReadInstruction(addr);
 			u32 target = GetBranchTargetNoRA(addr, op);
 			if (target != INVALIDTARGET) {
 				isStraightLeaf = false;
@@ -1054,7 +1292,7 @@ namespace MIPSAnalyst {
 					// If it's a nearby forward jump, and not a stackless leaf, assume not a tail call.
 					if (sureTarget <= addr + MAX_JUMP_FORWARD && decreasedSp) {
 						// But let's check the delay slot.
-						MIPSOpcode op = Memory::Read_Instruction(addr + 4, true);
+						MIPSOpcode op = ScanReadInstruction(addr + 4);
 						// addiu sp, sp, +X
 						if ((op & 0xFFFF8000) != 0x27BD0000) {
 							furthestBranch = sureTarget;
@@ -1065,7 +1303,7 @@ namespace MIPSAnalyst {
 					// A jump later.  Probably tail, but let's check if it jumps back.
 					// We use + 8 here in case it jumps right back to the delay slot.  We'll consider that inside the func.
 					u32 knownEnd = furthestBranch == 0 ? addr + 8 : furthestBranch;
-					u32 jumpback = ScanAheadForJumpback(sureTarget, currentFunction.start, knownEnd);
+					u32 jumpback = ScanAheadForJumpback(sureTarget, currentFunction.start, knownEnd, result.readEnd);
 					if (jumpback != INVALIDTARGET && jumpback > addr && jumpback > knownEnd) {
 						furthestBranch = jumpback;
 					} else {
@@ -1114,7 +1352,7 @@ namespace MIPSAnalyst {
 						// Okay, we have a downward jump.  Might be an else or a tail call...
 						// If there's a jump back upward in spitting distance of it, it's an else.
 						u32 knownEnd = furthestBranch == 0 ? addr : furthestBranch;
-						u32 jumpback = ScanAheadForJumpback(sureTarget, currentFunction.start, knownEnd);
+						u32 jumpback = ScanAheadForJumpback(sureTarget, currentFunction.start, knownEnd, result.readEnd);
 						if (jumpback != INVALIDTARGET && jumpback > addr && jumpback > knownEnd) {
 							furthestBranch = jumpback;
 						}
@@ -1125,23 +1363,8 @@ namespace MIPSAnalyst {
 			if (end) {
 				currentFunction.end = addr + 4;
 				currentFunction.isStraightLeaf = isStraightLeaf;
-
-				// Check if we already have symbol info starting here.  If so, skip insertion.
-				// We used to use the symbols to find the functions, but sometimes we'd find
-				// wrong ones due to two modules with the same name.
-				u32 existingSize = g_symbolMap->GetFunctionSize(currentFunction.start);
-				if (existingSize != SymbolMap::INVALID_ADDRESS) {
-					currentFunction.foundInSymbolMap = true;
-
-					// If we run into a func with a different size, skip updating the hash map.
-					// This will prevent us saving incorrectly named funcs with wrong hashes.
-					u32 detectedSize = currentFunction.end - currentFunction.start + 4;
-					if (existingSize != detectedSize) {
-						insertSymbols = false;
-					}
-				}
-
-				functions.push_back(currentFunction);
+				result.found.push_back(currentFunction);
+				result.foundStarts.push_back(scanStart);
 
 				furthestBranch = 0;
 				addr += 4;
@@ -1151,27 +1374,103 @@ namespace MIPSAnalyst {
 				decreasedSp = false;
 				currentFunction.start = addr + 4;
 				currentFunction.foundInSymbolMap = false;
+
+				scanStart = addr + 4;
+				if (scanStart <= endAddr && stopAt(scanStart)) {
+					result.stopAddr = scanStart;
+					return;
+				}
 			}
 		}
 
 		if (addr <= endAddr) {
 			currentFunction.end = addr + 4;
-			functions.push_back(currentFunction);
+			result.found.push_back(currentFunction);
+			result.foundStarts.push_back(scanStart);
 		}
+	}
 
-		for (auto iter = functions.begin(); iter != functions.end(); iter++) {
-			iter->size = iter->end - iter->start + 4;
-			if (insertSymbols && !iter->foundInSymbolMap) {
-				char temp[256];
-				g_symbolMap->AddFunction(DefaultFunctionName(temp, iter->start), iter->start, iter->end - iter->start + 4);
+	// Scans chunks of large ranges on the thread pool, then stitches them together in order.
+	// The result is exactly what scanning the whole range in one go would give.
+	static void ScanFunctionRange(u32 startAddr, u32 endAddr, std::vector<AnalyzedFunction> &found, u32 &readEnd) {
+		const int chunkCount = endAddr < startAddr ? 0 : (int)((endAddr + 4 - startAddr) / SCAN_CHUNK_BYTES);
+		if (chunkCount < 2) {
+			ScanChunkResult result;
+			ScanFunctionChunk(startAddr, endAddr, [](u32) { return false; }, result);
+			found = std::move(result.found);
+			readEnd = result.readEnd;
+			return;
+		}
+
+		// Each chunk pretends a function starts at its start, and runs until the first function start in the next chunk.
+		// Usually, it stops exactly where the next chunk's scan also started a function.
+		std::vector<ScanChunkResult> chunks(chunkCount);
+		GlobalThreadPool::Loop([&](int lower, int upper) {
+			for (int i = lower; i < upper; ++i) {
+				const u32 next = i + 1 < chunkCount ? startAddr + (i + 1) * SCAN_CHUNK_BYTES : INVALIDTARGET;
+				ScanFunctionChunk(startAddr + i * SCAN_CHUNK_BYTES, endAddr, [next](u32 addr) { return addr >= next; }, chunks[i]);
+			}
+		}, 0, chunkCount);
+
+		// Finds where the scan of the chunk containing addr started a function at addr, if it did.
+		auto findChunkStart = [&](u32 addr, int &chunk, size_t &index) {
+			chunk = std::min((int)((addr - startAddr) / SCAN_CHUNK_BYTES), chunkCount - 1);
+			const std::vector<u32> &starts = chunks[chunk].foundStarts;
+			auto it = std::lower_bound(starts.begin(), starts.end(), addr);
+			index = it - starts.begin();
+			return it != starts.end() && *it == addr;
+		};
+
+		readEnd = endAddr + 8;
+		u32 addr = startAddr;
+		while (addr != INVALIDTARGET) {
+			int chunk;
+			size_t index;
+			if (findChunkStart(addr, chunk, index)) {
+				const ScanChunkResult &result = chunks[chunk];
+				found.insert(found.end(), result.found.begin() + index, result.found.end());
+				readEnd = std::max(readEnd, result.readEnd);
+				addr = result.stopAddr;
+			} else {
+				// Didn't line up, so scan normally until it does.
+				ScanChunkResult result;
+				ScanFunctionChunk(addr, endAddr, [&](u32 next) {
+					int c;
+					size_t i;
+					return findChunkStart(next, c, i);
+				}, result);
+				found.insert(found.end(), result.found.begin(), result.found.end());
+				readEnd = std::max(readEnd, result.readEnd);
+				addr = result.stopAddr;
 			}
 		}
+	}
+
+	bool ScanForFunctions(u32 startAddr, u32 endAddr, bool insertSymbols) {
+		std::lock_guard<std::recursive_mutex> guard(functions_lock);
+
+		const size_t firstNew = functions.size();
+		if (ReadCachedScan(startAddr, endAddr, insertSymbols)) {
+			FinishScannedFunctions(insertSymbols);
+			return insertSymbols;
+		}
+
+		std::vector<AnalyzedFunction> found;
+		u32 readEnd;
+		ScanFunctionRange(startAddr, endAddr, found, readEnd);
+		for (AnalyzedFunction &f : found) {
+			insertSymbols = CheckSymbolMapFunction(f, insertSymbols);
+			functions.push_back(f);
+		}
 
+		AddPendingScan(startAddr, endAddr, readEnd, firstNew);
+		FinishScannedFunctions(insertSymbols);
 		return insertSymbols;
 	}
 
 	void FinalizeScan(bool insertSymbols) {
 		HashFunctions();
+		StorePendingScans();
 
 		std::string hashMapFilename = GetSysDirectory(DIRECTORY_SYSTEM) + "knownfuncs.ini";
 		if (g_Config.bFuncHashMap || g_Config.bFuncReplacements) {
@@ -1215,6 +1514,7 @@ namespace MIPSAnalyst {
 		fun.start = startAddr;
 		fun.end = startAddr + size - 4;
 		fun.isStraightLeaf = false;  // dunno really
+		fun.hashCached = false;
 		strncpy(fun.name, name, 64);
 		fun.name[63] = 0;
 		functions.push_back(fun);
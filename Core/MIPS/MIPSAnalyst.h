@@ -91,6 +91,8 @@ namespace MIPSAnalyst
 		bool hasHash;
 		bool usesVFPU;
 		bool foundInSymbolMap;
+		// Hash was loaded from the analysis cache, so the next HashFunctions() can skip it.
+		bool hashCached;
 		char name[64];
 	};
 
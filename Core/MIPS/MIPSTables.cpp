@@ -15,6 +15,10 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <cstring>
+#include <memory>
+#include <vector>
+
 #include "Core/Core.h"
 #include "Core/System.h"
 #include "Core/MemMap.h"
@@ -953,6 +957,85 @@ void MIPSInterpret(MIPSOpcode op) {
 	}
 }
 
+// The interpreter caches the table lookup per instruction address, in pages allocated as code runs.
+// Entries remember the word they were decoded from, so code modified without an icache
+// invalidate is still picked up. Invalidation just frees the pages.
+struct PredecodedOp {
+	u32 encoding;
+	MIPSInterpretFunc interpret;
+};
+
+static const int PREDECODE_PAGE_SHIFT = 12;
+static const u32 PREDECODE_PAGE_OPS = (1 << PREDECODE_PAGE_SHIFT) / 4;
+// Indexed by page with the cached/uncached mirror bits dropped, so mirrors share pages.
+// That's 2MB of pointers on 64-bit, allocated on first use.
+static const u32 PREDECODE_ADDRESS_MASK = 0x3FFFFFFF;
+static const u32 PREDECODE_PAGE_COUNT = (PREDECODE_ADDRESS_MASK >> PREDECODE_PAGE_SHIFT) + 1;
+
+static std::vector<std::unique_ptr<PredecodedOp[]>> predecodePages;
+static u32 predecodePagesUsed = 0;
+
+static inline PredecodedOp &GetPredecodedOp(u32 pc) {
+	const u32 page = (pc & PREDECODE_ADDRESS_MASK) >> PREDECODE_PAGE_SHIFT;
+	if (predecodePages.empty())
+		predecodePages.resize(PREDECODE_PAGE_COUNT);
+	std::unique_ptr<PredecodedOp[]> &ops = predecodePages[page];
+	if (!ops) {
+		ops.reset(new PredecodedOp[PREDECODE_PAGE_OPS]);
+		memset(ops.get(), 0, sizeof(PredecodedOp) * PREDECODE_PAGE_OPS);
+		predecodePagesUsed++;
+	}
+	return ops[(pc >> 2) & (PREDECODE_PAGE_OPS - 1)];
+}
+
+static inline void MIPSInterpretPredecoded(u32 pc, MIPSOpcode op) {
+	PredecodedOp &entry = GetPredecodedOp(pc);
+	if (entry.encoding != op.encoding || !entry.interpret) {
+		const MIPSInstruction *instr = MIPSGetInstruction(op);
+		if (!instr || !instr->interpret) {
+			// Let it report the error.
+			MIPSInterpret(op);
+			return;
+		}
+		entry.encoding = op.encoding;
+		entry.interpret = instr->interpret;
+	}
+	// The op may invalidate the cache, so don't touch entry after this.
+	MIPSInterpretFunc func = entry.interpret;
+	func(op);
+}
+
+void MIPSInterpret_InvalidateCache(u32 address, int length) {
+	if (predecodePagesUsed == 0 || length <= 0)
+		return;
+
+	const u64 end = (u64)address + length - 1;
+	if (end - address >= PREDECODE_ADDRESS_MASK) {
+		// Keep the table itself, code will likely run again right away.
+		for (auto &ops : predecodePages)
+			ops.reset();
+		predecodePagesUsed = 0;
+		return;
+	}
+
+	// The range may wrap around the masked space, so walk it by page count.
+	const u32 firstPage = (address & PREDECODE_ADDRESS_MASK) >> PREDECODE_PAGE_SHIFT;
+	const u32 pages = (u32)((end >> PREDECODE_PAGE_SHIFT) - (address >> PREDECODE_PAGE_SHIFT)) + 1;
+	for (u32 i = 0; i < pages && predecodePagesUsed != 0; ++i) {
+		std::unique_ptr<PredecodedOp[]> &ops = predecodePages[(firstPage + i) % PREDECODE_PAGE_COUNT];
+		if (ops) {
+			ops.reset();
+			predecodePagesUsed--;
+		}
+	}
+}
+
+void MIPSInterpret_ClearCache() {
+	predecodePages.clear();
+	predecodePages.shrink_to_fit();
+	predecodePagesUsed = 0;
+}
+
 #define _RS   ((op>>21) & 0x1F)
 #define _RT   ((op>>16) & 0x1F)
 #define _RD   ((op>>11) & 0x1F)
@@ -1015,7 +1098,7 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 				}
 				lastPC = curMips->pc;
 				*/
-				MIPSInterpret(op);
+				MIPSInterpretPredecoded(curMips->pc, op);
 
 				if (curMips->inDelaySlot)
 				{
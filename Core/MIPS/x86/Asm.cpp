@@ -125,6 +125,8 @@ void Jit::GenerateFixedCode(JitOptions &jo) {
 
 	outerLoop = GetCodePtr();
 		RestoreRoundingMode(true);
+		// Outside of any block, so this is a safe point to recompile blocks that faulted.
+		ABI_CallFunction(&ProcessPendingFastMemFaults);
 		ABI_CallFunction(reinterpret_cast<void *>(&CoreTiming::Advance));
 		ApplyRoundingMode(true);
 		FixupBranch skipToCoreStateCheck = J();  //skip the downcount check
@@ -272,9 +272,9 @@ void Jit::CompBranchExits(CCFlags cc, u32 targetAddr, u32 notTakenAddr, bool del
 		if (!likely)
 		{
 			if (!delaySlotIsNice)
-				CompileDelaySlot(DELAYSLOT_SAFE_FLUSH);
+				CompileDelaySlotForExits(DELAYSLOT_SAFE_FLUSH, targetAddr, notTakenAddr);
 			else
-				FlushAll();
+				FlushAllForExits(targetAddr, notTakenAddr);
 			ptr = J_CC(cc, true);
 		}
 		else
@@ -300,12 +300,12 @@ void Jit::CompBranchExit(bool taken, u32 targetAddr, u32 notTakenAddr, bool dela
 	// Continuing is handled in the imm branch case... TODO: move it here?
 	if (andLink)
 		gpr.SetImm(MIPS_REG_RA, GetCompilerPC() + 8);
+	const u32 destAddr = taken ? targetAddr : notTakenAddr;
 	if (taken || !likely)
-		CompileDelaySlot(DELAYSLOT_FLUSH);
+		CompileDelaySlotForExits(DELAYSLOT_FLUSH, destAddr);
 	else
-		FlushAll();
+		FlushAllForExits(destAddr);
 
-	const u32 destAddr = taken ? targetAddr : notTakenAddr;
 	CONDITIONAL_LOG_EXIT(destAddr);
 	WriteExit(destAddr, js.nextExit++);
 	js.compiling = false;
@@ -623,7 +623,7 @@ void Jit::Comp_Jump(MIPSOpcode op) {
 			js.compiling = true;
 			return;
 		}
-		FlushAll();
+		FlushAllForExits(targetAddr);
 		CONDITIONAL_LOG_EXIT(targetAddr);
 		WriteExit(targetAddr, js.nextExit++);
 		break;
@@ -648,7 +648,7 @@ void Jit::Comp_Jump(MIPSOpcode op) {
 			js.compiling = true;
 			return;
 		}
-		FlushAll();
+		FlushAllForExits(targetAddr);
 		CONDITIONAL_LOG_EXIT(targetAddr);
 		WriteExit(targetAddr, js.nextExit++);
 		break;
@@ -2834,26 +2834,53 @@ void Jit::Comp_Vmmul(MIPSOpcode op) {
 			transposeS = true;
 		}
 
-		// The T matrix we will address individually.
+		u8 scol[4][4];
 		GetMatrixColumns(vd, sz, dcols);
 		GetMatrixRows(vs, sz, scols);
+		for (int i = 0; i < n; i++) {
+			GetVectorRegs(scol[i], vsz, scols[i]);
+		}
+
+		// If a previous transpose left S cached in the form we need, just use it.
+		u8 stransposed[4][4];
+		if (transposeS) {
+			bool cached = true;
+			for (int i = 0; i < n; i++) {
+				for (int j = 0; j < n; j++) {
+					stransposed[i][j] = scol[j][i];
+				}
+				cached = cached && fpr.IsMappedVS(stransposed[i], vsz);
+			}
+			if (cached) {
+				memcpy(scol, stransposed, sizeof(scol));
+				transposeS = false;
+			}
+		}
+
+		// The T matrix we will address individually, except columns that are already in regs.
+		bool tcolMapped[4]{};
 		memset(tregs, 255, sizeof(tregs));
 		GetMatrixRegs(tregs, sz, vt);
-		for (int i = 0; i < 16; i++) {
-			if (tregs[i] != 255)
-				fpr.StoreFromRegisterV(tregs[i]);
+		for (int i = 0; i < n; i++) {
+#ifdef _M_X64
+			tcolMapped[i] = fpr.IsMappedVS(&tregs[4 * i], vsz);
+#endif
+			if (tcolMapped[i]) {
+				fpr.SpillLockV(&tregs[4 * i], vsz);
+				continue;
+			}
+			for (int j = 0; j < n; j++) {
+				fpr.StoreFromRegisterV(tregs[4 * i + j]);
+			}
 		}
 
-		u8 scol[4][4];
-
 		// Map all of S's columns into registers.
 		for (int i = 0; i < n; i++) {
 			if (transposeS){
 				fpr.StoreFromRegisterV(scols[i]);
 			}
-			GetVectorRegs(scol[i], vsz, scols[i]);
 			fpr.MapRegsVS(scol[i], vsz, 0);
-			fpr.SpillLockV(scols[i], vsz);
+			fpr.SpillLockV(scol[i], vsz);
 		}
 
 		// Shorter than manually stuffing the registers. But it feels like ther'es room for optimization here...
@@ -2881,23 +2908,41 @@ void Jit::Comp_Vmmul(MIPSOpcode op) {
 
 		// Some games pass in S as an E matrix (transposed). Let's just transpose the data before we do the multiplication instead.
 		// This is shorter than trying to combine a discontinous matrix with lots of shufps.
+		// The regs are then relabeled, so the transposed S stays cached for the next vmmul.
 		if (transposeS) {
 			transposeInPlace(scol);
+			fpr.RelabelTransposedVS(scol);
+			memcpy(scol, stransposed, sizeof(scol));
 		}
 
+		auto broadcastT = [&](X64Reg dest, int i, int j) {
+			const u8 treg = tregs[4 * i + j];
+			if (tcolMapped[i]) {
+				X64Reg tcol = fpr.VSX(&tregs[4 * i]);
+				if (cpu_info.bAVX) {
+					VPERMILPS(dest, R(tcol), _MM_SHUFFLE(j, j, j, j));
+				} else {
+					MOVAPS(dest, R(tcol));
+					SHUFPS(dest, R(dest), _MM_SHUFFLE(j, j, j, j));
+				}
+			} else if (cpu_info.bAVX && !fpr.V(treg).IsSimpleReg()) {
+				VBROADCASTSS(dest, fpr.V(treg));
+			} else {
+				MOVSS(dest, fpr.V(treg));
+				SHUFPS(dest, R(dest), _MM_SHUFFLE(0, 0, 0, 0));
+			}
+		};
+
 		// Now, work our way through the matrix, loading things as we go.
 		// TODO: With more temp registers, can generate much more efficient code.
 		for (int i = 0; i < n; i++) {
-			MOVSS(XMM1, fpr.V(tregs[4 * i]));  // TODO: AVX broadcastss to replace this and the SHUFPS
-			MOVSS(XMM0, fpr.V(tregs[4 * i + 1]));
-			SHUFPS(XMM1, R(XMM1), _MM_SHUFFLE(0, 0, 0, 0));
-			SHUFPS(XMM0, R(XMM0), _MM_SHUFFLE(0, 0, 0, 0));
+			broadcastT(XMM1, i, 0);
+			broadcastT(XMM0, i, 1);
 			MULPS(XMM1, fpr.VS(scol[0]));
 			MULPS(XMM0, fpr.VS(scol[1]));
 			ADDPS(XMM1, R(XMM0));
 			for (int j = 2; j < n; j++) {
-				MOVSS(XMM0, fpr.V(tregs[4 * i + j]));
-				SHUFPS(XMM0, R(XMM0), _MM_SHUFFLE(0, 0, 0, 0));
+				broadcastT(XMM0, i, j);
 				MULPS(XMM0, fpr.VS(scol[j]));
 				ADDPS(XMM1, R(XMM0));
 			}
@@ -2911,11 +2956,6 @@ void Jit::Comp_Vmmul(MIPSOpcode op) {
 #endif
 			MOVAPS(fpr.VS(dcol), XMM1);
 		}
-		if (transposeS){
-			for (int i = 0; i < n; i++){
-				fpr.DiscardVS(scols[i]);
-			}
-		}
 
 #ifndef _M_X64
 		fpr.ReleaseSpillLocks();
@@ -3068,12 +3108,36 @@ void Jit::Comp_Vtfm(MIPSOpcode op) {
 		int vd = _VD;
 		int vt = _VT;  // vector!
 
-		// The T matrix we will address individually.
+		// The T vector we will address individually, unless it's already in a reg.
 		GetVectorRegs(dcol, sz, vd);
 		GetMatrixRows(vs, msz, scols);
 		GetVectorRegs(tregs, sz, vt);
+
+		u8 scol[4][4];
 		for (int i = 0; i < n; i++) {
-			fpr.StoreFromRegisterV(tregs[i]);
+			GetVectorRegs(scol[i], sz, scols[i]);
+		}
+
+		// The last element isn't read for homogenous, so it doesn't matter where it lives.
+		const VectorSize tsz = homogenous ? (VectorSize)((int)sz - 1) : sz;
+		bool tMapped = false;
+#ifdef _M_X64
+		tMapped = fpr.IsMappedVS(tregs, tsz);
+		for (int i = 0; i < n && tMapped; ++i) {
+			for (int j = 0; j < n; ++j) {
+				for (int k = 0; k < GetNumVectorElements(tsz); ++k) {
+					if (scol[i][j] == tregs[k])
+						tMapped = false;
+				}
+			}
+		}
+#endif
+		if (tMapped) {
+			fpr.SpillLockV(tregs, tsz);
+		} else {
+			for (int i = 0; i < n; i++) {
+				fpr.StoreFromRegisterV(tregs[i]);
+			}
 		}
 
 		// We need the T regs in individual regs, but they could overlap with S regs.
@@ -3094,24 +3158,37 @@ void Jit::Comp_Vtfm(MIPSOpcode op) {
 			}
 		};
 
-		u8 scol[4][4];
-
 		// Map all of S's columns into registers.
 		for (int i = 0; i < n; i++) {
-			GetVectorRegs(scol[i], sz, scols[i]);
-			flushConflictingTRegsToTemps(scol[i]);
+			if (!tMapped)
+				flushConflictingTRegsToTemps(scol[i]);
 			fpr.MapRegsVS(scol[i], sz, 0);
 		}
 
+		auto broadcastT = [&](X64Reg dest, int j) {
+			if (tMapped) {
+				if (cpu_info.bAVX) {
+					VPERMILPS(dest, fpr.VS(tregs), _MM_SHUFFLE(j, j, j, j));
+				} else {
+					MOVAPS(dest, fpr.VS(tregs));
+					SHUFPS(dest, R(dest), _MM_SHUFFLE(j, j, j, j));
+				}
+			} else if (cpu_info.bAVX && !fpr.V(tregs[j]).IsSimpleReg()) {
+				// Temps from flushConflictingTRegsToTemps are in regs, which needs AVX2.
+				VBROADCASTSS(dest, fpr.V(tregs[j]));
+			} else {
+				MOVSS(dest, fpr.V(tregs[j]));
+				SHUFPS(dest, R(dest), _MM_SHUFFLE(0, 0, 0, 0));
+			}
+		};
+
 		// Now, work our way through the matrix, loading things as we go.
 		// TODO: With more temp registers, can generate much more efficient code.
-		MOVSS(XMM1, fpr.V(tregs[0]));  // TODO: AVX broadcastss to replace this and the SHUFPS (but take care of temps, unless we force store them.)
-		SHUFPS(XMM1, R(XMM1), _MM_SHUFFLE(0, 0, 0, 0));
+		broadcastT(XMM1, 0);
 		MULPS(XMM1, fpr.VS(scol[0]));
 		for (int j = 1; j < n; j++) {
 			if (!homogenous || j != n - 1) {
-				MOVSS(XMM0, fpr.V(tregs[j]));
-				SHUFPS(XMM0, R(XMM0), _MM_SHUFFLE(0, 0, 0, 0));
+				broadcastT(XMM0, j);
 				MULPS(XMM0, fpr.VS(scol[j]));
 				ADDPS(XMM1, R(XMM0));
 			} else {
@@ -3122,6 +3199,8 @@ void Jit::Comp_Vtfm(MIPSOpcode op) {
 		for (int i = 0; i < n; i++) {
 			fpr.ReleaseSpillLockV(scol[i], sz);
 		}
+		if (tMapped)
+			fpr.ReleaseSpillLockV(tregs, tsz);
 		fpr.MapRegsVS(dcol, sz, MAP_DIRTY | MAP_NOINIT);
 		MOVAPS(fpr.VS(dcol), XMM1);
 		fpr.ReleaseSpillLocks();
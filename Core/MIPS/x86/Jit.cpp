@@ -40,6 +40,7 @@
 
 #include "RegCache.h"
 #include "Jit.h"
+#include "JitFaultHandler.h"
 
 #include "Core/Host.h"
 #include "Core/Debugger/Breakpoints.h"
@@ -119,9 +120,98 @@ Jit::Jit(MIPSState *mips)
 	// The debugger sets this so that "go" on a breakpoint will actually... go.
 	// But if they reset, we can end up hitting it by mistake, since it's based on PC and ticks.
 	CBreakPoints::SetSkipFirst(0);
+
+	InstallFastMemFaultHandler(this);
 }
 
 Jit::~Jit() {
+	UninstallFastMemFaultHandler(this);
+}
+
+void Jit::NoteFastMemFault(const u8 *codePtr, u32 addr, bool isWrite) {
+	static_assert(ATOMIC_POINTER_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_BOOL_LOCK_FREE == 2, "Must be usable from a signal handler");
+
+	// This runs inside the signal handler, so no locks, allocation, or logging here.
+	for (auto &slot : pendingFastMemFaults) {
+		const u8 *expected = nullptr;
+		if (slot.codePtr.compare_exchange_strong(expected, codePtr)) {
+			slot.addr = addr;
+			slot.isWrite = isWrite;
+			hasPendingFastMemFaults = true;
+			return;
+		} else if (expected == codePtr) {
+			hasPendingFastMemFaults = true;
+			return;
+		}
+	}
+}
+
+void ProcessPendingFastMemFaults() {
+	static_cast<Jit *>(MIPSComp::jit)->ProcessFastMemFaults();
+}
+
+void Jit::ProcessFastMemFaults() {
+	if (!hasPendingFastMemFaults.exchange(false))
+		return;
+
+	for (auto &slot : pendingFastMemFaults) {
+		const u8 *codePtr = slot.codePtr.load();
+		if (!codePtr)
+			continue;
+		const u32 addr = slot.addr;
+		const bool isWrite = slot.isWrite;
+		slot.codePtr = nullptr;
+
+		// Same as the slow path in MemMapFunctions.cpp.
+		const char *func = isWrite ? "WriteToHardware" : "ReadFromHardware";
+		if (g_Config.bIgnoreBadMemAccess) {
+			WARN_LOG(MEMMAP, "%s: Invalid address %08x", func, addr);
+		} else {
+			WARN_LOG(MEMMAP, "%s: Invalid address %08x PC %08x LR %08x", func, addr, mips_->pc, mips_->r[MIPS_REG_RA]);
+		}
+		static bool reported = false;
+		if (!reported) {
+			Reporting::ReportMessage("%s: Invalid address %08x near PC %08x LR %08x", func, addr, mips_->pc, mips_->r[MIPS_REG_RA]);
+			reported = true;
+		}
+		if (!g_Config.bIgnoreBadMemAccess) {
+			Core_EnableStepping(true);
+			host->SetDebugMode(true);
+		}
+
+		u32 blockAddress = blocks.GetAddressFromBlockPtr(codePtr);
+		if (blockAddress == 0 || blockAddress == (u32)-1)
+			continue;
+
+		// Other accesses in an already recompiled block (like sp based ones) are still fast, nothing to do.
+		if (!slowMemBlocks.insert(blockAddress).second)
+			continue;
+
+		WARN_LOG(JIT, "Fast memory access faulted in block %08x, recompiling with checks", blockAddress);
+		blocks.InvalidateICache(blockAddress, 4);
+	}
+}
+
+void Jit::CheckFastMemFault() {
+	// The fault handler can't stop the block, so check if it noted anything, like the slow path
+	// checks coreState.  Registers are left alone, only flags are clobbered.
+	if (!IsFastMemFaultHandlerInstalled())
+		return;
+	if (RipAccessible((const void *)&hasPendingFastMemFaults)) {
+		CMP(8, M(&hasPendingFastMemFaults), Imm8(0));  // rip accessible
+	} else {
+		PUSH(RAX);
+		MOV(PTRBITS, R(RAX), ImmPtr((const void *)&hasPendingFastMemFaults));
+		CMP(8, MatR(RAX), Imm8(0));
+		POP(RAX);
+	}
+	FixupBranch skip = J_CC(CC_Z, true);
+	MOV(32, MIPSSTATE_VAR(pc), Imm32(GetCompilerPC()));
+	ABI_CallFunction(thunks.ProtectFunction(&ProcessPendingFastMemFaults));
+	SetJumpTarget(skip);
+
+	// Reporting may have tripped coreState, and then we exit after this op.
+	js.afterOp |= JitState::AFTER_CORE_STATE;
 }
 
 void Jit::DoState(PointerWrap &p) {
@@ -162,6 +252,59 @@ void Jit::FlushAll() {
 	FlushPrefixV();
 }
 
+// How far past an exit FlushAllForExits looks.  The code there must stay the same for
+// the skipped stores to be safe, so a proxy block covers it.
+static const int DEAD_FLUSH_LOOKAHEAD_OPS = 16;
+
+static bool CanAnalyzeExit(u32 exit) {
+	if (!Memory::IsValidRange(exit, DEAD_FLUSH_LOOKAHEAD_OPS * 4) || CBreakPoints::IsAddressBreakPoint(exit))
+		return false;
+	for (int i = 0; i < DEAD_FLUSH_LOOKAHEAD_OPS; ++i) {
+		// Replacements and syscalls read registers their flags don't mention.
+		MIPSOpcode op = Memory::Read_Opcode_JIT(exit + i * 4);
+		if (MIPS_IS_EMUHACK(op) || (MIPSGetInfo(op) & (IN_OTHER | BAD_INSTRUCTION)))
+			return false;
+	}
+	return true;
+}
+
+void Jit::FlushAllForExits(u32 exit1, u32 exit2) {
+	const u32 exits[2] = { exit1, exit2 };
+	const int numExits = exit2 != 0 ? 2 : 1;
+
+	// If we might stop at this op instead, the regs are still live.
+	bool usable = !jo.Disabled(JitDisable::DEAD_FLUSH) && !blocks.IsFull();
+	usable = usable && (js.afterOp & (JitState::AFTER_CORE_STATE | JitState::AFTER_REWIND_PC_BAD_STATE)) == 0;
+	for (int i = 0; usable && i < numExits; ++i)
+		usable = CanAnalyzeExit(exits[i]);
+
+	bool discarded = false;
+	for (int r = 1; usable && r < X64JitConstants::NUM_MIPS_GPRS; ++r) {
+		const MIPSGPReg reg = (MIPSGPReg)r;
+		if (!gpr.NeedsStore(reg))
+			continue;
+		bool dead = true;
+		for (int i = 0; dead && i < numExits; ++i)
+			dead = MIPSAnalyst::IsRegisterClobbered(reg, exits[i], DEAD_FLUSH_LOOKAHEAD_OPS);
+		if (dead) {
+			gpr.DiscardR(reg);
+			discarded = true;
+		}
+	}
+
+	if (discarded) {
+		for (int i = 0; i < numExits; ++i) {
+			// No need when we're already invalidated along with that code (like a loop to our start.)
+			const u32 end = exits[i] + DEAD_FLUSH_LOOKAHEAD_OPS * 4;
+			if (js.lastContinuedPC == 0 && exits[i] >= js.blockStart && end <= GetCompilerPC() + 8)
+				continue;
+			blocks.ProxyBlock(js.blockStart, exits[i], DEAD_FLUSH_LOOKAHEAD_OPS, GetCodePtr());
+		}
+	}
+
+	FlushAll();
+}
+
 void Jit::FlushPrefixV() {
 	if ((js.prefixSFlag & JitState::PREFIX_DIRTY) != 0) {
 		MOV(32, MIPSSTATE_VAR(vfpuCtrl[VFPU_CTRL_SPREFIX]), Imm32(js.prefixS));
@@ -208,6 +351,12 @@ void Jit::UpdateRoundingMode(u32 fcr31) {
 
 void Jit::ClearCache()
 {
+	// The pending code pointers are about to be meaningless, and the blocks get a fresh start.
+	hasPendingFastMemFaults = false;
+	for (auto &slot : pendingFastMemFaults)
+		slot.codePtr = nullptr;
+	slowMemBlocks.clear();
+
 	blocks.Clear();
 	ClearCodeSpace(0);
 	GenerateFixedCode(jo);
@@ -252,6 +401,13 @@ void Jit::CompileDelaySlot(int flags, RegCacheState *state) {
 		LoadFlags(); // restore flag!
 }
 
+void Jit::CompileDelaySlotForExits(int flags, u32 exit1, u32 exit2) {
+	// Storing doesn't touch the flags, so it's fine to flush after they're restored.
+	CompileDelaySlot(flags & ~DELAYSLOT_FLUSH);
+	if (flags & DELAYSLOT_FLUSH)
+		FlushAllForExits(exit1, exit2);
+}
+
 void Jit::EatInstruction(MIPSOpcode op) {
 	MIPSInfo info = MIPSGetInfo(op);
 	if (info & DELAYSLOT) {
@@ -330,6 +486,7 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b) {
 	js.downcountAmount = 0;
 	js.curBlock = b;
 	js.compiling = true;
+	compilingSlowMem = slowMemBlocks.count(em_address) != 0;
 	js.inDelaySlot = false;
 	js.afterOp = JitState::AFTER_NONE;
 	js.PrefixStart();
@@ -344,6 +501,17 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b) {
 
 	b->normalEntry = GetCodePtr();
 
+	if (g_Config.bJitBlockProfile) {
+		// Counted after the downcount check, so entries from the dispatcher count too.
+#if PPSSPP_ARCH(AMD64)
+		MOV(PTRBITS, R(RAX), ImmPtr(&b->profile.entries));
+		ADD(64, MatR(RAX), Imm8(1));
+#else
+		ADD(32, M(&b->profile.entries), Imm8(1));
+		ADC(32, M((const u8 *)&b->profile.entries + 4), Imm8(0));
+#endif
+	}
+
 	MIPSAnalyst::AnalysisResults analysis = MIPSAnalyst::Analyze(em_address);
 
 	gpr.Start(mips_, &js, &jo, analysis);
@@ -360,8 +528,8 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b) {
 		MIPSCompileOp(inst, this);
 
 		if (js.afterOp & JitState::AFTER_CORE_STATE) {
-			// TODO: Save/restore?
-			FlushAll();
+			// Registers only need flushing if we exit, so keep them mapped otherwise.
+			FlushPrefixV();
 
 			// If we're rewinding, CORE_NEXTFRAME should not cause a rewind.
 			// It doesn't really matter either way if we're not rewinding.
@@ -372,12 +540,15 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b) {
 				MOV(PTRBITS, R(RAX), ImmPtr((const void *)&coreState));
 				CMP(32, MatR(RAX), Imm32(CORE_NEXTFRAME));
 			}
-			FixupBranch skipCheck = J_CC(CC_LE);
+			FixupBranch skipCheck = J_CC(CC_LE, true);
+			RegCacheState state;
+			GetStateAndFlushAll(state);
 			if (js.afterOp & JitState::AFTER_REWIND_PC_BAD_STATE)
 				MOV(32, MIPSSTATE_VAR(pc), Imm32(GetCompilerPC()));
 			else
 				MOV(32, MIPSSTATE_VAR(pc), Imm32(GetCompilerPC() + 4));
 			WriteSyscallExit();
+			RestoreState(state);
 			SetJumpTarget(skipCheck);
 
 			js.afterOp = JitState::AFTER_NONE;
@@ -20,6 +20,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <unordered_set>
+
 #include "Common/CommonTypes.h"
 #include "Common/Thunk.h"
 #include "Common/x64Emitter.h"
@@ -38,6 +41,8 @@ namespace MIPSComp {
 
 // This is called when Jit hits a breakpoint.  Returns 1 when hit.
 u32 JitBreakpoint();
+// Calls Jit::ProcessFastMemFaults() on the current jit, from the dispatcher or jit code.
+void ProcessPendingFastMemFaults();
 
 struct RegCacheState {
 	GPRRegCacheState gpr;
@@ -180,11 +185,20 @@ class Jit : public Gen::XCodeBlock, public JitInterface, public MIPSFrontendInte
 	void LinkBlock(u8 *exitPoint, const u8 *checkedEntry) override;
 	void UnlinkBlock(u8 *checkedEntry, u32 originalAddress) override;
 
+	// Called from the fault handler when a fast memory access in jit code hit unmapped memory.
+	// Only records the access, so it's safe inside a signal handler.
+	void NoteFastMemFault(const u8 *codePtr, u32 addr, bool isWrite);
+	// Reports the accesses noted above like the slow path would, and recompiles their blocks.
+	void ProcessFastMemFaults();
+
 private:
 	void GenerateFixedCode(JitOptions &jo);
 	void GetStateAndFlushAll(RegCacheState &state);
 	void RestoreState(const RegCacheState& state);
 	void FlushAll();
+	// Like FlushAll(), for a flush that only leads to these exits (exit2 may be 0.)
+	// Registers the exits overwrite before reading aren't stored.
+	void FlushAllForExits(u32 exit1, u32 exit2 = 0);
 	void FlushPrefixV();
 	void WriteDowncount(int offset = 0);
 	bool ReplaceJalTo(u32 dest);
@@ -195,6 +209,7 @@ class Jit : public Gen::XCodeBlock, public JitInterface, public MIPSFrontendInte
 	void CompileDelaySlot(int flags, RegCacheState &state) {
 		CompileDelaySlot(flags, &state);
 	}
+	void CompileDelaySlotForExits(int flags, u32 exit1, u32 exit2 = 0);
 	void EatInstruction(MIPSOpcode op);
 	void AddContinuedBlock(u32 dest);
 	MIPSOpcode GetOffsetInstruction(int offset);
@@ -205,6 +220,7 @@ class Jit : public Gen::XCodeBlock, public JitInterface, public MIPSFrontendInte
 //	void WriteRfiExitDestInEAX();
 	void WriteSyscallExit();
 	bool CheckJitBreakpoint(u32 addr, int downcountOffset);
+	void CheckFastMemFault();
 
 	// Utility compilation functions
 	void BranchFPFlag(MIPSOpcode op, Gen::CCFlags cc, bool likely);
@@ -311,6 +327,20 @@ class Jit : public Gen::XCodeBlock, public JitInterface, public MIPSFrontendInte
 
 	MIPSState *mips_;
 
+	// Blocks that faulted on fast memory, and whether the current one is one of them.
+	std::unordered_set<u32> slowMemBlocks;
+	bool compilingSlowMem = false;
+	// Accesses noted by the fault handler, not yet processed.  A slot is claimed by its code pointer.
+	// If these fill up, later faults are dropped and simply noted again next time they happen.
+	struct PendingFastMemFault {
+		std::atomic<const u8 *> codePtr;
+		std::atomic<u32> addr;
+		std::atomic<bool> isWrite;
+	};
+	enum { MAX_PENDING_FAST_MEM_FAULTS = 16 };
+	PendingFastMemFault pendingFastMemFaults[MAX_PENDING_FAST_MEM_FAULTS]{};
+	std::atomic<bool> hasPendingFastMemFaults{};
+
 
 	const u8 *enterDispatcher;
 
@@ -0,0 +1,176 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "ppsspp_config.h"
+
+#include "Core/MIPS/x86/JitFaultHandler.h"
+
+#if PPSSPP_PLATFORM(LINUX) && PPSSPP_ARCH(AMD64)
+
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <ucontext.h>
+
+#include "Common/Log.h"
+#include "Common/x64Analyzer.h"
+#include "Core/MemMap.h"
+#include "Core/MIPS/x86/Jit.h"
+
+namespace MIPSComp {
+
+static Jit *faultJit;
+static struct sigaction prevSegvAction;
+static struct sigaction prevBusAction;
+
+// Slack around the window, since the jit adds signed 16-bit offsets to the base.
+static const uintptr_t FAULT_WINDOW_SLACK = 0x10000;
+
+// In x86 register encoding order.
+static const int gregIndices[16] = {
+	REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+	REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15,
+};
+
+static bool HandleFastMemFault(int sig, siginfo_t *info, ucontext_t *uc) {
+	Jit *jit = faultJit;
+	if (!jit || !Memory::base || sig != SIGSEGV)
+		return false;
+
+	greg_t *gregs = uc->uc_mcontext.gregs;
+	const u8 *codePtr = (const u8 *)gregs[REG_RIP];
+	if (!jit->IsInSpace(codePtr))
+		return false;
+
+	const uintptr_t windowStart = (uintptr_t)Memory::base - FAULT_WINDOW_SLACK;
+	const uintptr_t windowSize = 0x100000000ULL + FAULT_WINDOW_SLACK * 2;
+	if ((uintptr_t)info->si_addr - windowStart >= windowSize)
+		return false;
+
+	// Bit 1 of the page fault error code is set for writes.
+	InstructionInfo instr;
+	const bool isWrite = (gregs[REG_ERR] & 2) != 0;
+	if (!DisassembleMov(codePtr, instr, isWrite ? OP_ACCESS_WRITE : OP_ACCESS_READ))
+		return false;
+
+	uintptr_t effective = (uintptr_t)(intptr_t)instr.displacement;
+	if (instr.otherReg >= 0)
+		effective += (uintptr_t)gregs[gregIndices[instr.otherReg]];
+	if (instr.scaledReg >= 0)
+		effective += (uintptr_t)gregs[gregIndices[instr.scaledReg]] * instr.scale;
+	if (effective - windowStart >= windowSize)
+		return false;
+
+	// Same wraparound as the slow path, which adds the offset to the 32-bit register.
+	const u32 addr = (u32)(effective - (uintptr_t)Memory::base);
+	if (instr.isXmmOperand && !uc->uc_mcontext.fpregs)
+		return false;
+
+	// Nothing is mapped there, so like the slow path, loads read zero and stores are dropped.
+	// Reporting it is left to the jit, since logging isn't safe in a signal handler.
+	if (!instr.isMemoryWrite) {
+		if (instr.isXmmOperand) {
+			// For movss, the rest of the register is cleared too.
+			memset(uc->uc_mcontext.fpregs->_xmm[instr.regOperandReg].element, 0, 16);
+		} else {
+			greg_t &reg = gregs[gregIndices[instr.regOperandReg]];
+			u64 prev = (u64)reg;
+			switch (instr.regOperandSize) {
+			case 1:
+				reg = (greg_t)(prev & (instr.isHighByteReg ? ~0xFF00ULL : ~0xFFULL));
+				break;
+			case 2:
+				reg = (greg_t)(prev & ~0xFFFFULL);
+				break;
+			default:
+				// 32-bit operations clear the upper half.
+				reg = 0;
+				break;
+			}
+		}
+	}
+
+	gregs[REG_RIP] += instr.instructionSize;
+	jit->NoteFastMemFault(codePtr, addr, instr.isMemoryWrite);
+	return true;
+}
+
+static void FastMemSignalHandler(int sig, siginfo_t *info, void *raw) {
+	if (HandleFastMemFault(sig, info, (ucontext_t *)raw))
+		return;
+
+	// Not ours, let the previous handler (or the default action) deal with it.
+	const struct sigaction &prev = sig == SIGSEGV ? prevSegvAction : prevBusAction;
+	if (prev.sa_flags & SA_SIGINFO) {
+		prev.sa_sigaction(sig, info, raw);
+	} else if (prev.sa_handler != SIG_DFL && prev.sa_handler != SIG_IGN) {
+		prev.sa_handler(sig);
+	} else {
+		// Returning will retry the instruction and fault again, this time fatally.
+		signal(sig, SIG_DFL);
+	}
+}
+
+void InstallFastMemFaultHandler(Jit *jit) {
+	if (faultJit) {
+		faultJit = jit;
+		return;
+	}
+
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_sigaction = &FastMemSignalHandler;
+	action.sa_flags = SA_SIGINFO;
+	sigemptyset(&action.sa_mask);
+	if (sigaction(SIGSEGV, &action, &prevSegvAction) != 0 || sigaction(SIGBUS, &action, &prevBusAction) != 0) {
+		ERROR_LOG(JIT, "Unable to install fast memory fault handler");
+		return;
+	}
+	faultJit = jit;
+}
+
+void UninstallFastMemFaultHandler(Jit *jit) {
+	if (!faultJit || faultJit != jit)
+		return;
+	faultJit = nullptr;
+	sigaction(SIGSEGV, &prevSegvAction, nullptr);
+	sigaction(SIGBUS, &prevBusAction, nullptr);
+}
+
+bool IsFastMemFaultHandlerInstalled() {
+	return faultJit != nullptr;
+}
+
+}  // namespace MIPSComp
+
+#else
+
+namespace MIPSComp {
+
+void InstallFastMemFaultHandler(Jit *jit) {
+}
+
+void UninstallFastMemFaultHandler(Jit *jit) {
+}
+
+bool IsFastMemFaultHandlerInstalled() {
+	return false;
+}
+
+}  // namespace MIPSComp
+
+#endif
@@ -0,0 +1,33 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+namespace MIPSComp {
+
+class Jit;
+
+// With fast memory, the jit accesses memory through the 4GB window at Memory::base without checks.
+// When one of those accesses hits an unmapped address, this handler zeroes the load or drops the
+// store the way the slow path would, skips the instruction, and notes the fault.  The jit reports
+// it and recompiles the block with checked accesses later, outside the signal handler.
+// Only implemented for Linux x86-64, elsewhere these do nothing and bad accesses still crash.
+void InstallFastMemFaultHandler(Jit *jit);
+void UninstallFastMemFaultHandler(Jit *jit);
+bool IsFastMemFaultHandlerInstalled();
+
+}  // namespace MIPSComp
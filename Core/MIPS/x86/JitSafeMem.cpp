@@ -59,7 +59,7 @@ JitSafeMem::JitSafeMem(Jit *jit, MIPSGPReg raddr, s32 offset, u32 alignMask)
 	else
 		iaddr_ = (u32) -1;
 
-	fast_ = g_Config.bFastMemory || raddr == MIPS_REG_SP;
+	fast_ = (g_Config.bFastMemory && !jit_->compilingSlowMem) || raddr == MIPS_REG_SP;
 
 	// If raddr_ is going to get loaded soon, load it now for more optimal code.
 	// We assume that it was already locked.
@@ -340,6 +340,9 @@ void JitSafeMem::Finish()
 	// Memory::Read_U32/etc. may have tripped coreState.
 	if (needsCheck_ && !g_Config.bIgnoreBadMemAccess)
 		jit_->js.afterOp |= JitState::AFTER_CORE_STATE;
+	// Faults on fast accesses to a register address are noted by the fault handler instead.
+	if (fast_ && iaddr_ == (u32) -1 && !g_Config.bIgnoreBadMemAccess)
+		jit_->CheckFastMemFault();
 	if (needsSkip_)
 		jit_->SetJumpTarget(skip_);
 	for (auto it = skipChecks_.begin(), end = skipChecks_.end(); it != end; ++it)
@@ -374,53 +377,52 @@ void JitSafeMem::MemCheckImm(MemoryOpType type) {
 
 void JitSafeMem::MemCheckAsm(MemoryOpType type)
 {
-	const auto memchecks = CBreakPoints::GetMemCheckRanges(type == MEM_WRITE);
-	bool possible = !memchecks.empty();
-	for (auto it = memchecks.begin(), end = memchecks.end(); it != end; ++it)
-	{
-		FixupBranch skipNext, skipNextRange;
-		if (it->end != 0)
-		{
-			jit_->CMP(32, R(xaddr_), Imm32(it->start - offset_ - size_));
-			skipNext = jit_->J_CC(CC_BE);
-			jit_->CMP(32, R(xaddr_), Imm32(it->end - offset_));
-			skipNextRange = jit_->J_CC(CC_AE);
-		}
-		else
-		{
-			jit_->CMP(32, R(xaddr_), Imm32(it->start - offset_));
-			skipNext = jit_->J_CC(CC_NE);
-		}
-
-		// Keep the stack 16-byte aligned, just PUSH/POP 4 times.
-		for (int i = 0; i < 4; ++i)
-			jit_->PUSH(xaddr_);
-		jit_->MOV(32, MIPSSTATE_VAR(pc), Imm32(jit_->GetCompilerPC()));
-		jit_->ADD(32, R(xaddr_), Imm32(offset_));
-		jit_->CallProtectedFunction(&JitMemCheck, R(xaddr_), size_, type == MEM_WRITE ? 1 : 0);
-		for (int i = 0; i < 4; ++i)
-			jit_->POP(xaddr_);
+	const u32 *pageBits = CBreakPoints::GetMemCheckPageBits(type == MEM_WRITE);
+	if (!pageBits)
+		return;
 
-		jit_->SetJumpTarget(skipNext);
-		if (it->end != 0)
-			jit_->SetJumpTarget(skipNextRange);
+	// Only call into the memcheck code for watched pages, so other accesses stay fast.
+	X64Reg temps[2];
+	int numTemps = 0;
+	for (X64Reg reg : { RAX, RCX, RDX }) {
+		if (reg != xaddr_ && numTemps < 2)
+			temps[numTemps++] = reg;
 	}
 
-	if (possible)
-	{
-		// CORE_RUNNING is <= CORE_NEXTFRAME.
-		if (jit_->RipAccessible((const void *)&coreState)) {
-			jit_->CMP(32, M(&coreState), Imm32(CORE_NEXTFRAME));  // rip accessible
-		} else {
-			// We can't safely overwrite any register, so push.  This is only while debugging.
-			jit_->PUSH(RAX);
-			jit_->MOV(PTRBITS, R(RAX), ImmPtr((const void *)&coreState));
-			jit_->CMP(32, MatR(RAX), Imm32(CORE_NEXTFRAME));
-			jit_->POP(RAX);
-		}
-		skipChecks_.push_back(jit_->J_CC(CC_G, true));
-		jit_->js.afterOp |= JitState::AFTER_CORE_STATE | JitState::AFTER_REWIND_PC_BAD_STATE | JitState::AFTER_MEMCHECK_CLEANUP;
+	// We can't safely overwrite any register, so push.  This is only while debugging.
+	jit_->PUSH(temps[0]);
+	jit_->PUSH(temps[1]);
+	jit_->LEA(32, temps[0], MDisp(xaddr_, offset_));
+	// Without the cached bit, 4KB per bit.
+	jit_->AND(32, R(temps[0]), Imm32(~0x40000000));
+	jit_->SHR(32, R(temps[0]), Imm8(12));
+	jit_->MOV(PTRBITS, R(temps[1]), ImmPtr(pageBits));
+	jit_->BT(32, MatR(temps[1]), R(temps[0]));
+	jit_->POP(temps[1]);
+	jit_->POP(temps[0]);
+	FixupBranch unwatched = jit_->J_CC(CC_NC, true);
+
+	// Keep the stack 16-byte aligned, just PUSH/POP 4 times.
+	for (int i = 0; i < 4; ++i)
+		jit_->PUSH(xaddr_);
+	jit_->MOV(32, MIPSSTATE_VAR(pc), Imm32(jit_->GetCompilerPC()));
+	jit_->ADD(32, R(xaddr_), Imm32(offset_));
+	jit_->CallProtectedFunction(&JitMemCheck, R(xaddr_), size_, type == MEM_WRITE ? 1 : 0);
+	for (int i = 0; i < 4; ++i)
+		jit_->POP(xaddr_);
+
+	// CORE_RUNNING is <= CORE_NEXTFRAME.
+	if (jit_->RipAccessible((const void *)&coreState)) {
+		jit_->CMP(32, M(&coreState), Imm32(CORE_NEXTFRAME));  // rip accessible
+	} else {
+		jit_->PUSH(RAX);
+		jit_->MOV(PTRBITS, R(RAX), ImmPtr((const void *)&coreState));
+		jit_->CMP(32, MatR(RAX), Imm32(CORE_NEXTFRAME));
+		jit_->POP(RAX);
 	}
+	skipChecks_.push_back(jit_->J_CC(CC_G, true));
+	jit_->SetJumpTarget(unwatched);
+	jit_->js.afterOp |= JitState::AFTER_CORE_STATE | JitState::AFTER_REWIND_PC_BAD_STATE | JitState::AFTER_MEMCHECK_CLEANUP;
 }
 
 static const int FUNCS_ARENA_SIZE = 512 * 1024;
@@ -409,6 +409,14 @@ void GPRRegCache::StoreFromRegister(MIPSGPReg i) {
 	}
 }
 
+bool GPRRegCache::NeedsStore(MIPSGPReg preg) const {
+	if (!regs[preg].away || preg == MIPS_REG_ZERO)
+		return false;
+	if (regs[preg].location.IsSimpleReg())
+		return xregs[regs[preg].location.GetSimpleReg()].dirty;
+	return true;
+}
+
 void GPRRegCache::Flush() {
 	for (int i = 0; i < NUM_X_REGS; i++) {
 		if (xregs[i].allocLocked)
@@ -95,6 +95,8 @@ class GPRRegCache
 
 	void MapReg(MIPSGPReg preg, bool doLoad = true, bool makeDirty = true);
 	void StoreFromRegister(MIPSGPReg preg);
+	// True if flushing would write preg back (it's dirty, or an immediate.)
+	bool NeedsStore(MIPSGPReg preg) const;
 
 	const Gen::OpArg &R(MIPSGPReg preg) const {return regs[preg].location;}
 	Gen::X64Reg RX(MIPSGPReg preg) const
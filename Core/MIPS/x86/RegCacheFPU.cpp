@@ -545,6 +545,28 @@ bool FPURegCache::TryMapDirtyInInVS(const u8 *vd, VectorSize vdsz, const u8 *vs,
 	return success;
 }
 
+void FPURegCache::RelabelTransposedVS(const u8 v[4][4]) {
+	X64Reg xrs[4];
+	bool dirty = false;
+	for (int i = 0; i < 4; ++i) {
+		_dbg_assert_msg_(JIT, IsMappedVS(v[i], V_Quad), "RelabelTransposedVS requires mapped quads");
+		xrs[i] = VSX(v[i]);
+		dirty = dirty || xregs[xrs[i]].dirty;
+	}
+
+	// The lanes moved between regs, so dirtiness can't be tracked per reg anymore.
+	for (int i = 0; i < 4; ++i) {
+		for (int j = 0; j < 4; ++j) {
+			MIPSCachedFPReg &vr = vregs[v[j][i]];
+			xregs[xrs[i]].mipsRegs[j] = v[j][i] + 32;
+			vr.location = Gen::R(xrs[i]);
+			vr.lane = j + 1;
+		}
+		xregs[xrs[i]].dirty = dirty;
+	}
+	Invariant();
+}
+
 void FPURegCache::SimpleRegsV(const u8 *v, VectorSize vsz, int flags) {
 	const int n = GetNumVectorElements(vsz);
 	// TODO: Could be more optimal (in case of Discard or etc.)
@@ -195,6 +195,9 @@ class FPURegCache
 	bool TryMapRegsVS(const u8 *v, VectorSize vsz, int flags);
 	bool TryMapDirtyInVS(const u8 *vd, VectorSize vdsz, const u8 *vs, VectorSize vssz, bool avoidLoad = true);
 	bool TryMapDirtyInInVS(const u8 *vd, VectorSize vdsz, const u8 *vs, VectorSize vssz, const u8 *vt, VectorSize vtsz, bool avoidLoad = true);
+	// Call after transposing four mapped quads in place: the reg for v[i] now holds v[0][i]..v[3][i].
+	// Relabels the lanes to match, so the data stays cached instead of being discarded.
+	void RelabelTransposedVS(const u8 v[4][4]);
 	// TODO: If s/t overlap differently, need read-only copies?  Maybe finalize d?  Major design flaw...
 	// TODO: Matrix versions?  Cols/Rows?
 	// No MapRegVS, that'd be silly.
@@ -444,12 +444,14 @@ void PSP_Shutdown() {
 void PSP_BeginHostFrame() {
 	// Reapply the graphics state of the PSP
 	if (gpu) {
+		gpu->SyncThread();
 		gpu->BeginHostFrame();
 	}
 }
 
 void PSP_EndHostFrame() {
 	if (gpu) {
+		gpu->SyncThread();
 		gpu->EndHostFrame();
 	}
 }
@@ -479,6 +481,7 @@ void PSP_RunLoopUntil(u64 globalticks) {
 	}
 
 	mipsr4k.RunLoopUntil(globalticks);
+	gpu->SyncThread();
 	gpu->CleanupBeforeUI();
 }
 
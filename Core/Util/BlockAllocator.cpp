@@ -23,7 +23,16 @@
 #include "Core/Util/BlockAllocator.h"
 #include "Core/Reporting.h"
 
-// Slow freaking thing but works (eventually) :)
+// Blocks live in an address ordered linked list, indexed by start address for lookups.
+// Free blocks are also kept in per size class maps, so allocation doesn't scan taken blocks.
+// Results must match a plain first-fit scan of the list exactly - savestates depend on it.
+
+static inline int SizeClass(u32 size) {
+	int c = 0;
+	while (size >>= 1)
+		++c;
+	return c;
+}
 
 BlockAllocator::BlockAllocator(int grain) : bottom_(NULL), top_(NULL), grain_(grain)
 {
@@ -42,6 +51,7 @@ void BlockAllocator::Init(u32 rangeStart, u32 rangeSize)
 	//Initial block, covering everything
 	top_ = new Block(rangeStart_, rangeSize_, false, NULL, NULL);
 	bottom_ = top_;
+	IndexBlock(top_);
 }
 
 void BlockAllocator::Shutdown()
@@ -53,6 +63,102 @@ void BlockAllocator::Shutdown()
 		bottom_ = next;
 	}
 	top_ = NULL;
+	blocksByStart_.clear();
+	for (auto &freeList : freeLists_)
+		freeList.clear();
+}
+
+void BlockAllocator::IndexBlock(Block *b)
+{
+	// Empty blocks can't contain an address or satisfy an allocation, and may share a start.
+	if (b->size == 0)
+		return;
+	blocksByStart_[b->start] = b;
+	if (!b->taken)
+		freeLists_[SizeClass(b->size)][b->start] = b;
+}
+
+void BlockAllocator::UnindexBlock(Block *b)
+{
+	if (b->size == 0)
+		return;
+	blocksByStart_.erase(b->start);
+	if (!b->taken)
+		freeLists_[SizeClass(b->size)].erase(b->start);
+}
+
+void BlockAllocator::RebuildIndex()
+{
+	blocksByStart_.clear();
+	for (auto &freeList : freeLists_)
+		freeList.clear();
+	for (Block *bp = bottom_; bp != NULL; bp = bp->next)
+		IndexBlock(bp);
+}
+
+static inline bool FitsFromBottom(u32 start, u32 blockSize, u32 size, u32 grain)
+{
+	u32 offset = start % grain;
+	if (offset != 0)
+		offset = grain - offset;
+	return blockSize >= offset + size;
+}
+
+static inline bool FitsFromTop(u32 start, u32 blockSize, u32 size, u32 grain)
+{
+	u32 offset = (start + blockSize - size) % grain;
+	return blockSize >= offset + size;
+}
+
+// Finds the same block a first-fit scan from the bottom (or top) would: the lowest (or highest) free block that fits.
+BlockAllocator::Block *BlockAllocator::FindFreeBlock(u32 size, u32 grain, bool fromTop)
+{
+	Block *best = NULL;
+	// Blocks at least this large fit regardless of their alignment.
+	const u64 alwaysFits = (u64)size + grain - 1;
+	// Smaller classes only hold blocks smaller than size.
+	for (int c = SizeClass(size); c < SIZE_CLASSES; ++c)
+	{
+		const std::map<u32, Block *> &freeList = freeLists_[c];
+		if (freeList.empty())
+			continue;
+
+		if (((u64)1 << c) >= alwaysFits)
+		{
+			Block *b = fromTop ? freeList.rbegin()->second : freeList.begin()->second;
+			if (!best || (fromTop ? b->start > best->start : b->start < best->start))
+				best = b;
+		}
+		else if (!fromTop)
+		{
+			for (auto it = freeList.begin(); it != freeList.end(); ++it)
+			{
+				Block *b = it->second;
+				if (best && b->start > best->start)
+					break;
+				if (FitsFromBottom(b->start, b->size, size, grain))
+				{
+					best = b;
+					break;
+				}
+			}
+		}
+		else
+		{
+			for (auto it = freeList.rbegin(); it != freeList.rend(); ++it)
+			{
+				Block *b = it->second;
+				if (best && b->start < best->start)
+					break;
+				if (FitsFromTop(b->start, b->size, size, grain))
+				{
+					best = b;
+					break;
+				}
+			}
+		}
+	}
+	return best;
 }
 
 u32 BlockAllocator::AllocAligned(u32 &size, u32 sizeGrain, u32 grain, bool fromTop, const char *tag)
@@ -72,67 +178,37 @@ u32 BlockAllocator::AllocAligned(u32 &size, u32 sizeGrain, u32 grain, bool fromT
 	// upalign size to grain
 	size = (size + sizeGrain - 1) & ~(sizeGrain - 1);
 
-	if (!fromTop)
+	Block *bp = FindFreeBlock(size, grain, fromTop);
+	if (bp != NULL)
 	{
-		//Allocate from bottom of mem
-		for (Block *bp = bottom_; bp != NULL; bp = bp->next)
+		Block &b = *bp;
+		UnindexBlock(bp);
+		if (!fromTop)
 		{
-			Block &b = *bp;
+			//Allocate from bottom of mem
 			u32 offset = b.start % grain;
 			if (offset != 0)
 				offset = grain - offset;
 			u32 needed = offset + size;
-			if (b.taken == false && b.size >= needed)
-			{
-				if (b.size == needed)
-				{
-					if (offset >= grain_)
-						InsertFreeBefore(&b, offset);
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start;
-				}
-				else
-				{
-					InsertFreeAfter(&b, b.size - needed);
-					if (offset >= grain_)
-						InsertFreeBefore(&b, offset);
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start;
-				}
-			}
+			if (b.size != needed)
+				InsertFreeAfter(&b, b.size - needed);
+			if (offset >= grain_)
+				InsertFreeBefore(&b, offset);
 		}
-	}
-	else
-	{
-		// Allocate from top of mem.
-		for (Block *bp = top_; bp != NULL; bp = bp->prev)
+		else
 		{
-			Block &b = *bp;
+			// Allocate from top of mem.
 			u32 offset = (b.start + b.size - size) % grain;
 			u32 needed = offset + size;
-			if (b.taken == false && b.size >= needed)
-			{
-				if (b.size == needed)
-				{
-					if (offset >= grain_)
-						InsertFreeAfter(&b, offset);
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start;
-				}
-				else
-				{
-					InsertFreeBefore(&b, b.size - needed);
-					if (offset >= grain_)
-						InsertFreeAfter(&b, offset);
-					b.taken = true;
-					b.SetTag(tag);
-					return b.start;
-				}
-			}
+			if (b.size != needed)
+				InsertFreeBefore(&b, b.size - needed);
+			if (offset >= grain_)
+				InsertFreeAfter(&b, offset);
 		}
+		b.taken = true;
+		b.SetTag(tag);
+		IndexBlock(bp);
+		return b.start;
 	}
 
 	//Out of memory :(
@@ -191,20 +267,24 @@ u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 			//good to go
 			else if (b.start == alignedPosition)
 			{
+				UnindexBlock(bp);
 				if (b.size != alignedSize)
 					InsertFreeAfter(&b, b.size - alignedSize);
 				b.taken = true;
 				b.SetTag(tag);
+				IndexBlock(bp);
 				CheckBlocks();
 				return position;
 			}
 			else
 			{
+				UnindexBlock(bp);
 				InsertFreeBefore(&b, alignedPosition - b.start);
 				if (b.size > alignedSize)
 					InsertFreeAfter(&b, b.size - alignedSize);
 				b.taken = true;
 				b.SetTag(tag);
+				IndexBlock(bp);
 
 				return position;
 			}
@@ -222,6 +302,7 @@ u32 BlockAllocator::AllocAt(u32 position, u32 size, const char *tag)
 	return -1;
 }
 
+// fromBlock must already be unindexed.  The merged result is indexed again.
 void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 {
 	DEBUG_LOG(SCEKERNEL, "Merging Blocks");
@@ -230,6 +311,7 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 	while (prev != NULL && prev->taken == false)
 	{
 		DEBUG_LOG(SCEKERNEL, "Block Alloc found adjacent free blocks - merging");
+		UnindexBlock(prev);
 		prev->size += fromBlock->size;
 		if (fromBlock->next == NULL)
 			top_ = prev;
@@ -250,6 +332,7 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 	while (next != NULL && next->taken == false)
 	{
 		DEBUG_LOG(SCEKERNEL, "Block Alloc found adjacent free blocks - merging");
+		UnindexBlock(next);
 		fromBlock->size += next->size;
 		fromBlock->next = next->next;
 		delete next;
@@ -260,6 +343,8 @@ void BlockAllocator::MergeFreeBlocks(Block *fromBlock)
 		top_ = fromBlock;
 	else
 		next->prev = fromBlock;
+
+	IndexBlock(fromBlock);
 }
 
 bool BlockAllocator::Free(u32 position)
@@ -267,6 +352,7 @@ bool BlockAllocator::Free(u32 position)
 	Block *b = GetBlockFromAddress(position);
 	if (b && b->taken)
 	{
+		UnindexBlock(b);
 		b->taken = false;
 		MergeFreeBlocks(b);
 		return true;
@@ -283,6 +369,7 @@ bool BlockAllocator::FreeExact(u32 position)
 	Block *b = GetBlockFromAddress(position);
 	if (b && b->taken && b->start == position)
 	{
+		UnindexBlock(b);
 		b->taken = false;
 		MergeFreeBlocks(b);
 		return true;
@@ -305,6 +392,7 @@ BlockAllocator::Block *BlockAllocator::InsertFreeBefore(Block *b, u32 size)
 
 	b->start += size;
 	b->size -= size;
+	IndexBlock(inserted);
 	return inserted;
 }
 
@@ -318,6 +406,7 @@ BlockAllocator::Block *BlockAllocator::InsertFreeAfter(Block *b, u32 size)
 		inserted->next->prev = inserted;
 
 	b->size -= size;
+	IndexBlock(inserted);
 	return inserted;
 }
 
@@ -341,31 +430,27 @@ const char *BlockAllocator::GetBlockTag(u32 addr) const {
 	return b->tag;
 }
 
-inline BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr)
+BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr)
 {
-	for (Block *bp = bottom_; bp != NULL; bp = bp->next)
-	{
-		Block &b = *bp;
-		if (b.start <= addr && b.start + b.size > addr)
-		{
-			// Got one!
-			return bp;
-		}
-	}
+	auto it = blocksByStart_.upper_bound(addr);
+	if (it == blocksByStart_.begin())
+		return NULL;
+	--it;
+	Block *b = it->second;
+	if (b->start + b->size > addr)
+		return b;
 	return NULL;
 }
 
 const BlockAllocator::Block *BlockAllocator::GetBlockFromAddress(u32 addr) const
 {
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
-	{
-		const Block &b = *bp;
-		if (b.start <= addr && b.start + b.size > addr)
-		{
-			// Got one!
-			return bp;
-		}
-	}
+	auto it = blocksByStart_.upper_bound(addr);
+	if (it == blocksByStart_.begin())
+		return NULL;
+	--it;
+	const Block *b = it->second;
+	if (b->start + b->size > addr)
+		return b;
 	return NULL;
 }
 
@@ -401,14 +486,17 @@ void BlockAllocator::ListBlocks() const
 u32 BlockAllocator::GetLargestFreeBlockSize() const
 {
 	u32 maxFreeBlock = 0;
-	for (const Block *bp = bottom_; bp != NULL; bp = bp->next)
+	// Only the largest non-empty size class can hold the largest block.
+	for (int c = SIZE_CLASSES - 1; c >= 0; --c)
 	{
-		const Block &b = *bp;
-		if (!b.taken)
+		if (freeLists_[c].empty())
+			continue;
+		for (const auto &it : freeLists_[c])
 		{
-			if (b.size > maxFreeBlock)
-				maxFreeBlock = b.size;
+			if (it.second->size > maxFreeBlock)
+				maxFreeBlock = it.second->size;
 		}
+		break;
 	}
 	if (maxFreeBlock & (grain_ - 1))
 		WARN_LOG_REPORT(HLE, "GetLargestFreeBlockSize: free size %08x does not align to grain %08x.", maxFreeBlock, grain_);
@@ -476,6 +564,9 @@ void BlockAllocator::DoState(PointerWrap &p)
 	p.Do(rangeStart_);
 	p.Do(rangeSize_);
 	p.Do(grain_);
+
+	if (p.mode == p.MODE_READ)
+		RebuildIndex();
 }
 
 BlockAllocator::Block::Block(u32 _start, u32 _size, bool _taken, Block *_prev, Block *_next)
@@ -19,6 +19,8 @@
 
 class PointerWrap;
 
+#include <map>
+
 #include "Common/CommonTypes.h"
 
 class BlockAllocator
@@ -72,6 +74,11 @@ class BlockAllocator
 		Block *next;
 	};
 
+	enum {
+		// Free blocks are segregated by floor(log2(size)).
+		SIZE_CLASSES = 32,
+	};
+
 	Block *bottom_;
 	Block *top_;
 	u32 rangeStart_;
@@ -79,6 +86,15 @@ class BlockAllocator
 
 	u32 grain_;
 
+	// All blocks by start address, for lookups.  The linked list stays the source of truth for order.
+	std::map<u32, Block *> blocksByStart_;
+	// Free blocks by start address, one map per size class.
+	std::map<u32, Block *> freeLists_[SIZE_CLASSES];
+
+	void IndexBlock(Block *b);
+	void UnindexBlock(Block *b);
+	void RebuildIndex();
+	Block *FindFreeBlock(u32 size, u32 grain, bool fromTop);
 	void MergeFreeBlocks(Block *fromBlock);
 	Block *GetBlockFromAddress(u32 addr);
 	const Block *GetBlockFromAddress(u32 addr) const;
@@ -18,7 +18,9 @@
 #include <algorithm>
 
 #include "profiler/profiler.h"
+#include "thread/threadutil.h"
 #include "Common/ColorConv.h"
+#include "Common/FileUtil.h"
 #include "Core/Config.h"
 #include "GPU/Common/DrawEngineCommon.h"
 #include "GPU/Common/SplineCommon.h"
@@ -40,6 +42,8 @@ DrawEngineCommon::DrawEngineCommon() : decoderMap_(16) {
 }
 
 DrawEngineCommon::~DrawEngineCommon() {
+	// Normally already saved by GPUCommon::SaveGameCaches(), this only catches new types since.
+	SaveVertexDecoderCache();
 	FreeMemoryPages(transformed, TRANSFORMED_VERTEX_BUFFER_SIZE);
 	FreeMemoryPages(transformedExpanded, 3 * TRANSFORMED_VERTEX_BUFFER_SIZE);
 	delete decJitCache_;
@@ -53,12 +57,127 @@ VertexDecoder *DrawEngineCommon::GetVertexDecoder(u32 vtype) {
 	VertexDecoder *dec = decoderMap_.Get(vtype);
 	if (dec)
 		return dec;
+
+	std::unique_lock<std::mutex> guard(decoderPrecompileLock_, std::defer_lock);
+	if (decoderPrecompileDone_) {
+		FinishVertexDecoderPrecompile();
+		dec = decoderMap_.Get(vtype);
+	} else if (decoderPrecompileThread_.joinable()) {
+		// Still precompiling.  Take what's done so far, and keep the lock while compiling below so
+		// we don't write to the jit cache at the same time.  At most, this waits for one decoder.
+		guard.lock();
+		TakePrecompiledDecoders();
+		dec = decoderMap_.Get(vtype);
+	}
+	if (dec)
+		return dec;
+
 	dec = new VertexDecoder();
 	dec->SetVertexType(vtype, decOptions_, decJitCache_);
 	decoderMap_.Insert(vtype, dec);
+	if (!decoderCachePath_.empty() && knownVertexTypes_.insert(vtype).second)
+		knownVertexTypesChanged_ = true;
 	return dec;
 }
 
+enum {
+	VERTEX_DECODER_CACHE_MAGIC = 0x43445650,  // PVDC
+	VERTEX_DECODER_CACHE_VERSION = 1,
+	// Keep well within the jit cache space.
+	VERTEX_DECODER_PRECOMPILE_MAX = 256,
+};
+
+struct VertexDecoderCacheHeader {
+	u32 magic;
+	u32 version;
+	u32 count;
+};
+
+bool DrawEngineCommon::ReadVertexDecoderCache(const std::string &filename, std::vector<u32> &vtypes) {
+	FILE *f = File::OpenCFile(filename, "rb");
+	if (!f)
+		return false;
+
+	VertexDecoderCacheHeader header;
+	bool valid = fread(&header, sizeof(header), 1, f) == 1 && header.magic == VERTEX_DECODER_CACHE_MAGIC && header.version == VERTEX_DECODER_CACHE_VERSION;
+	if (valid) {
+		vtypes.resize(header.count);
+		valid = header.count == 0 || fread(&vtypes[0], sizeof(u32), header.count, f) == header.count;
+	}
+	fclose(f);
+	if (!valid) {
+		WARN_LOG(G3D, "Bad vertex decoder cache %s, ignoring", filename.c_str());
+		vtypes.clear();
+	}
+	return valid;
+}
+
+void DrawEngineCommon::LoadVertexDecoderCache(const std::string &filename) {
+	FinishVertexDecoderPrecompile();
+	decoderCachePath_ = filename;
+
+	std::vector<u32> vtypes;
+	if (!ReadVertexDecoderCache(filename, vtypes) || vtypes.empty())
+		return;
+
+	knownVertexTypes_.insert(vtypes.begin(), vtypes.end());
+	if (vtypes.size() > VERTEX_DECODER_PRECOMPILE_MAX)
+		vtypes.resize(VERTEX_DECODER_PRECOMPILE_MAX);
+
+	// GetVertexDecoder() picks these up as they finish, without waiting for the rest.
+	decoderPrecompileDone_ = false;
+	decoderPrecompileThread_ = std::thread([this, vtypes] {
+		setCurrentThreadName("VertexDecoderPrecompile");
+		for (u32 vtype : vtypes) {
+			std::lock_guard<std::mutex> guard(decoderPrecompileLock_);
+			VertexDecoder *dec = new VertexDecoder();
+			dec->SetVertexType(vtype, decOptions_, decJitCache_, (GETexMapMode)((vtype >> 24) & 3));
+			precompiledDecoders_.push_back(dec);
+		}
+		decoderPrecompileDone_ = true;
+	});
+	INFO_LOG(G3D, "Precompiling %d vertex decoders", (int)vtypes.size());
+}
+
+void DrawEngineCommon::FinishVertexDecoderPrecompile() {
+	if (!decoderPrecompileThread_.joinable())
+		return;
+	decoderPrecompileThread_.join();
+	decoderPrecompileDone_ = false;
+	TakePrecompiledDecoders();
+}
+
+void DrawEngineCommon::TakePrecompiledDecoders() {
+	// A type may have been needed (and compiled) before the precompile got to it.
+	for (VertexDecoder *dec : precompiledDecoders_) {
+		if (decoderMap_.Get(dec->VertexType()))
+			delete dec;
+		else
+			decoderMap_.Insert(dec->VertexType(), dec);
+	}
+	precompiledDecoders_.clear();
+}
+
+void DrawEngineCommon::SaveVertexDecoderCache() {
+	FinishVertexDecoderPrecompile();
+	if (decoderCachePath_.empty() || !knownVertexTypesChanged_)
+		return;
+
+	FILE *f = File::OpenCFile(decoderCachePath_, "wb");
+	if (!f)
+		return;
+
+	std::vector<u32> vtypes(knownVertexTypes_.begin(), knownVertexTypes_.end());
+	std::sort(vtypes.begin(), vtypes.end());
+	VertexDecoderCacheHeader header{ VERTEX_DECODER_CACHE_MAGIC, VERTEX_DECODER_CACHE_VERSION, (u32)vtypes.size() };
+	fwrite(&header, sizeof(header), 1, f);
+	if (!vtypes.empty())
+		fwrite(&vtypes[0], sizeof(u32), vtypes.size(), f);
+	fclose(f);
+	knownVertexTypesChanged_ = false;
+	INFO_LOG(G3D, "Saved %d vertex types to the vertex decoder cache", (int)vtypes.size());
+}
+
 int DrawEngineCommon::ComputeNumVertsToDecode() const {
 	int vertsToDecode = 0;
 	if (drawCalls[0].indexType == GE_VTYPE_IDX_NONE >> GE_VTYPE_IDX_SHIFT) {
@@ -163,6 +282,7 @@ static Vec3f ScreenToDrawing(const Vec3f& coords) {
 }
 
 void DrawEngineCommon::Resized() {
+	FinishVertexDecoderPrecompile();
 	decJitCache_->Clear();
 	lastVType_ = -1;
 	dec_ = nullptr;
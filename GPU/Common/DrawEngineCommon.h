@@ -17,8 +17,13 @@
 
 #pragma once
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <vector>
 #include <unordered_map>
+#include <unordered_set>
 
 #include "Common/CommonTypes.h"
 #include "Common/Hashmaps.h"
@@ -100,9 +105,18 @@ class DrawEngineCommon {
 
 	VertexDecoder *GetVertexDecoder(u32 vtype);
 
+	// Remembers the vertex types seen in filename, and starts compiling those seen last time on a thread.
+	void LoadVertexDecoderCache(const std::string &filename);
+	static bool ReadVertexDecoderCache(const std::string &filename, std::vector<u32> &vtypes);
+	// Writes out the vertex types seen, if there are any new ones.
+	void SaveVertexDecoderCache();
+
 protected:
 	virtual void ClearTrackedVertexArrays() {}
 
+	void FinishVertexDecoderPrecompile();
+	void TakePrecompiledDecoders();
+
 	int ComputeNumVertsToDecode() const;
 	void DecodeVerts(u8 *dest);
 
@@ -139,6 +153,16 @@ class DrawEngineCommon {
 	VertexDecoderJitCache *decJitCache_ = nullptr;
 	VertexDecoderOptions decOptions_{};
 
+	// Vertex types seen this session (and last), saved to decoderCachePath_.
+	std::string decoderCachePath_;
+	std::unordered_set<u32> knownVertexTypes_;
+	bool knownVertexTypesChanged_ = false;
+	std::thread decoderPrecompileThread_;
+	std::atomic<bool> decoderPrecompileDone_{};
+	// Guards precompiledDecoders_, and held while writing to decJitCache_ during the precompile.
+	std::mutex decoderPrecompileLock_;
+	std::vector<VertexDecoder *> precompiledDecoders_;
+
 	TransformedVertex *transformed = nullptr;
 	TransformedVertex *transformedExpanded = nullptr;
 
@@ -448,6 +448,8 @@ class VertexDecoder {
 
 	// A jit cache is not mandatory.
 	void SetVertexType(u32 vtype, const VertexDecoderOptions &options, VertexDecoderJitCache *jitCache = nullptr);
+	// Same, but with an explicit UV gen mode instead of the one in gstate (e.g. when not on the GPU thread.)
+	void SetVertexType(u32 vtype, const VertexDecoderOptions &options, VertexDecoderJitCache *jitCache, GETexMapMode uvGenMode);
 
 	u32 VertexType() const { return fmt_; }
 
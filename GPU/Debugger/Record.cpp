@@ -16,12 +16,20 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <algorithm>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <functional>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 #include <snappy-c.h>
 #include "base/stringutil.h"
+#include "base/timeutil.h"
+#include "ext/xxhash.h"
+#include "thread/threadutil.h"
 #include "Common/Common.h"
 #include "Common/FileUtil.h"
 #include "Common/Log.h"
@@ -47,13 +55,22 @@ static const char *HEADER = "PPSSPPGE";
 // Version 1: Uncompressed
 // Version 2: Uses snappy
 // Version 3: Adds FRAMEBUF0-FRAMEBUF9
-static const int VERSION = 3;
+// Version 4: Buffer is written in separately compressed chunks, followed by the commands
+static const int VERSION = 4;
 static const int MIN_VERSION = 2;
 
+// Raw size of each compressed buffer chunk, written while still recording.
+static const u32 WRITE_CHUNK_SIZE = 1024 * 1024;
+// How much of the start of each payload is hashed to find it again.
+static const u32 DEDUPE_PREFIX_SIZE = 64;
+// Max payloads remembered per prefix hash.
+static const size_t DEDUPE_MAX_CANDIDATES = 16;
+
 static bool active = false;
 static bool nextFrame = false;
 static int flipLastAction = -1;
 static std::function<void(const std::string &)> writeCallback;
+static std::function<void(double)> replayCallback;
 
 enum class CommandType : u8 {
 	INIT = 0,
@@ -99,8 +116,44 @@ struct Command {
 static std::vector<u8> pushbuf;
 static std::vector<Command> commands;
 static std::vector<u32> lastRegisters;
-static std::vector<u32> lastTextures;
 static std::set<u32> lastRenderTargets;
+// Payload offsets in pushbuf, by a hash of their first bytes.
+static std::unordered_map<u64, std::vector<u32>> pushbufIndex;
+// How much of pushbuf has been handed to the writer.
+static u32 pushbufQueued = 0;
+static std::string recordingFilename;
+
+// Compresses and writes out finished chunks of the buffer while recording continues,
+// so finishing a long recording doesn't stall on compressing all of it.
+class RecordingWriter {
+public:
+	~RecordingWriter() {
+		// A recording still open at exit never got its commands, so don't leave a broken dump.
+		Cancel();
+	}
+
+	bool Begin(const std::string &filename);
+	// Copies the data, it's compressed and written later.
+	void QueueChunk(const u8 *p, u32 sz);
+	// Waits for queued chunks, then writes the commands and sizes and closes the file.
+	void Finish(const std::vector<Command> &cmds, u32 bufsz);
+	// Stops writing and deletes the unfinished file.
+	void Cancel();
+
+private:
+	void Run();
+	void StopThread();
+
+	FILE *fp_ = nullptr;
+	std::string filename_;
+	std::thread thread_;
+	std::mutex lock_;
+	std::condition_variable cond_;
+	std::deque<std::vector<u8>> pending_;
+	bool finishing_ = false;
+};
+
+static RecordingWriter recordingWriter;
 
 // TODO: Maybe move execute to another file?
 class DumpExecute {
@@ -359,6 +412,105 @@ bool BufMapping::SlabInfo::Setup(u32 bufpos) {
 
 int BufMapping::slabGeneration_ = 0;
 
+static void WriteCompressed(FILE *fp, const void *p, size_t sz);
+
+bool RecordingWriter::Begin(const std::string &filename) {
+	fp_ = File::OpenCFile(filename, "wb");
+	if (!fp_) {
+		ERROR_LOG(G3D, "Unable to open recording file: %s", filename.c_str());
+		return false;
+	}
+	filename_ = filename;
+
+	// The counts are filled in by Finish().
+	u32 placeholder = 0;
+	fwrite(HEADER, 8, 1, fp_);
+	fwrite(&VERSION, sizeof(VERSION), 1, fp_);
+	fwrite(&placeholder, sizeof(placeholder), 1, fp_);
+	fwrite(&placeholder, sizeof(placeholder), 1, fp_);
+
+	finishing_ = false;
+	thread_ = std::thread([this] {
+		setCurrentThreadName("GERecordWriter");
+		Run();
+	});
+	return true;
+}
+
+void RecordingWriter::QueueChunk(const u8 *p, u32 sz) {
+	if (!fp_)
+		return;
+
+	std::lock_guard<std::mutex> guard(lock_);
+	pending_.push_back(std::vector<u8>(p, p + sz));
+	cond_.notify_one();
+}
+
+void RecordingWriter::Run() {
+	std::unique_lock<std::mutex> guard(lock_);
+	while (true) {
+		cond_.wait(guard, [this] { return finishing_ || !pending_.empty(); });
+		if (pending_.empty())
+			break;
+
+		std::vector<u8> chunk = std::move(pending_.front());
+		pending_.pop_front();
+		guard.unlock();
+		WriteCompressed(fp_, chunk.data(), chunk.size());
+		guard.lock();
+	}
+}
+
+void RecordingWriter::StopThread() {
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		finishing_ = true;
+		cond_.notify_one();
+	}
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void RecordingWriter::Finish(const std::vector<Command> &cmds, u32 bufsz) {
+	if (!fp_)
+		return;
+
+	StopThread();
+	WriteCompressed(fp_, cmds.data(), cmds.size() * sizeof(Command));
+
+	u32 sz = (u32)cmds.size();
+	fseek(fp_, 8 + sizeof(VERSION), SEEK_SET);
+	fwrite(&sz, sizeof(sz), 1, fp_);
+	fwrite(&bufsz, sizeof(bufsz), 1, fp_);
+
+	fclose(fp_);
+	fp_ = nullptr;
+}
+
+void RecordingWriter::Cancel() {
+	if (!fp_)
+		return;
+
+	{
+		// No point compressing what's about to be deleted.
+		std::lock_guard<std::mutex> guard(lock_);
+		pending_.clear();
+	}
+	StopThread();
+	fclose(fp_);
+	fp_ = nullptr;
+	File::Delete(filename_);
+}
+
+// Hands full chunks of pushbuf (or everything left, if final) to the writer.
+static void QueueFinishedChunks(bool final) {
+	while (pushbuf.size() - pushbufQueued >= WRITE_CHUNK_SIZE || (final && pushbuf.size() > pushbufQueued)) {
+		u32 sz = std::min(WRITE_CHUNK_SIZE, (u32)pushbuf.size() - pushbufQueued);
+		recordingWriter.QueueChunk(pushbuf.data() + pushbufQueued, sz);
+		pushbufQueued += sz;
+	}
+}
+
 static void FlushRegisters() {
 	if (!lastRegisters.empty()) {
 		Command last{CommandType::REGISTERS};
@@ -369,6 +521,7 @@ static void FlushRegisters() {
 		lastRegisters.clear();
 
 		commands.push_back(last);
+		QueueFinishedChunks(false);
 	}
 }
 
@@ -388,19 +541,31 @@ static std::string GenRecordingFilename() {
 	return StringFromFormat("%s_%04d.ppdmp", prefix.c_str(), 9999);
 }
 
-static void BeginRecording() {
-	active = true;
+static bool BeginRecording() {
 	nextFrame = false;
-	lastTextures.clear();
-	lastRenderTargets.clear();
 	flipLastAction = gpuStats.numFlips;
 
+	recordingFilename = GenRecordingFilename();
+	NOTICE_LOG(G3D, "Recording filename: %s", recordingFilename.c_str());
+	if (!recordingWriter.Begin(recordingFilename)) {
+		ERROR_LOG(G3D, "Recording aborted, could not start writing %s", recordingFilename.c_str());
+		// Nothing will be written, so don't leave the callback for a later recording.
+		writeCallback = nullptr;
+		return false;
+	}
+
+	active = true;
+	lastRenderTargets.clear();
+	pushbufIndex.clear();
+	pushbufQueued = 0;
+
 	u32 ptr = (u32)pushbuf.size();
 	u32 sz = 512 * 4;
 	pushbuf.resize(pushbuf.size() + sz);
 	gstate.Save((u32_le *)(pushbuf.data() + ptr));
 
 	commands.push_back({CommandType::INIT, sz, ptr});
+	return true;
 }
 
 static void WriteCompressed(FILE *fp, const void *p, size_t sz) {
@@ -417,26 +582,11 @@ static void WriteCompressed(FILE *fp, const void *p, size_t sz) {
 
 static std::string WriteRecording() {
 	FlushRegisters();
+	QueueFinishedChunks(true);
 
-	const std::string filename = GenRecordingFilename();
+	recordingWriter.Finish(commands, (u32)pushbuf.size());
 
-	NOTICE_LOG(G3D, "Recording filename: %s", filename.c_str());
-
-	FILE *fp = File::OpenCFile(filename, "wb");
-	fwrite(HEADER, 8, 1, fp);
-	fwrite(&VERSION, sizeof(VERSION), 1, fp);
-
-	u32 sz = (u32)commands.size();
-	fwrite(&sz, sizeof(sz), 1, fp);
-	u32 bufsz = (u32)pushbuf.size();
-	fwrite(&bufsz, sizeof(bufsz), 1, fp);
-
-	WriteCompressed(fp, commands.data(), commands.size() * sizeof(Command));
-	WriteCompressed(fp, pushbuf.data(), bufsz);
-
-	fclose(fp);
-
-	return filename;
+	return recordingFilename;
 }
 
 static void GetVertDataSizes(int vcount, const void *indices, u32 &vbytes, u32 &ibytes) {
@@ -463,6 +613,35 @@ static void GetVertDataSizes(int vcount, const void *indices, u32 &vbytes, u32 &
 	}
 }
 
+static u64 PayloadPrefixHash(const void *p, u32 sz) {
+	u32 len = std::min(sz, DEDUPE_PREFIX_SIZE);
+	return XXH64(p, len, len);
+}
+
+static const u8 *FindIndexedPayload(u64 hash, const void *p, u32 sz) {
+	auto it = pushbufIndex.find(hash);
+	if (it == pushbufIndex.end()) {
+		return nullptr;
+	}
+
+	// Newest first, likely to be the same data again.
+	const std::vector<u32> &candidates = it->second;
+	for (auto ptr = candidates.rbegin(); ptr != candidates.rend(); ++ptr) {
+		if (*ptr + sz <= pushbuf.size() && memcmp(pushbuf.data() + *ptr, p, sz) == 0) {
+			return pushbuf.data() + *ptr;
+		}
+	}
+	return nullptr;
+}
+
+static void IndexPayload(u64 hash, u32 ptr) {
+	std::vector<u32> &candidates = pushbufIndex[hash];
+	if (candidates.size() >= DEDUPE_MAX_CANDIDATES) {
+		candidates.erase(candidates.begin());
+	}
+	candidates.push_back(ptr);
+}
+
 static const u8 *mymemmem(const u8 *haystack, size_t hlen, const u8 *needle, size_t nlen) {
 	if (!nlen) {
 		return nullptr;
@@ -498,9 +677,13 @@ static Command EmitCommandWithRAM(CommandType t, const void *p, u32 sz) {
 		// Let's try nearby first... it will often be nearby.
 		if (pushbuf.size() > NEAR_WINDOW) {
 			prev = mymemmem(pushbuf.data() + pushbuf.size() - NEAR_WINDOW, NEAR_WINDOW, (const u8 *)p, sz);
+		} else {
+			prev = mymemmem(pushbuf.data(), pushbuf.size(), (const u8 *)p, sz);
 		}
+		// Otherwise, look for an earlier payload starting with the same data.
+		const u64 hash = PayloadPrefixHash(p, sz);
 		if (!prev) {
-			prev = mymemmem(pushbuf.data(), pushbuf.size(), (const u8 *)p, sz);
+			prev = FindIndexedPayload(hash, p, sz);
 		}
 
 		if (prev) {
@@ -517,10 +700,12 @@ static Command EmitCommandWithRAM(CommandType t, const void *p, u32 sz) {
 				memset(pushbuf.data() + cmd.ptr - pad, 0, pad);
 			}
 			memcpy(pushbuf.data() + cmd.ptr, p, sz);
+			IndexPayload(hash, cmd.ptr);
 		}
 	}
 
 	commands.push_back(cmd);
+	QueueFinishedChunks(false);
 
 	return cmd;
 }
@@ -561,24 +746,8 @@ static void EmitTextureData(int level, u32 texaddr) {
 	}
 
 	if (bytes > 0) {
-		FlushRegisters();
-
-		// Dumps are huge - let's try to find this already emitted.
-		for (u32 prevptr : lastTextures) {
-			if (pushbuf.size() < prevptr + bytes) {
-				continue;
-			}
-
-			if (memcmp(pushbuf.data() + prevptr, p, bytes) == 0) {
-				commands.push_back({type, bytes, prevptr});
-				// Okay, that was easy.  Bail out.
-				return;
-			}
-		}
-
-		// Not there, gotta emit anew.
-		Command cmd = EmitCommandWithRAM(type, p, bytes);
-		lastTextures.push_back(cmd.ptr);
+		// Dumps are huge - this will reuse the data if it was already emitted.
+		EmitCommandWithRAM(type, p, bytes);
 	}
 }
 
@@ -691,11 +860,17 @@ void SetCallback(const std::function<void(const std::string &)> callback) {
 	writeCallback = callback;
 }
 
+void SetReplayCallback(const std::function<void(double)> &callback) {
+	replayCallback = callback;
+}
+
 static void FinishRecording() {
 	// We're done - this was just to write the result out.
 	std::string filename = WriteRecording();
 	commands.clear();
 	pushbuf.clear();
+	pushbufIndex.clear();
+	pushbufQueued = 0;
 
 	NOTICE_LOG(SYSTEM, "Recording finished");
 	active = false;
@@ -1211,6 +1386,34 @@ static bool ReadCompressed(u32 fp, void *dest, size_t sz) {
 	return real_size == sz;
 }
 
+// Reads a sequence of compressed blocks until sz bytes have been filled.
+static bool ReadCompressedChunks(u32 fp, u8 *dest, size_t sz) {
+	std::vector<u8> compressed;
+	size_t pos = 0;
+	while (pos < sz) {
+		u32 compressed_size = 0;
+		if (pspFileSystem.ReadFile(fp, (u8 *)&compressed_size, sizeof(compressed_size)) != sizeof(compressed_size)) {
+			return false;
+		}
+
+		compressed.resize(compressed_size);
+		if (pspFileSystem.ReadFile(fp, compressed.data(), compressed_size) != compressed_size) {
+			return false;
+		}
+
+		size_t real_size = 0;
+		if (snappy_uncompressed_length((const char *)compressed.data(), compressed_size, &real_size) != SNAPPY_OK || real_size > sz - pos) {
+			return false;
+		}
+		if (snappy_uncompress((const char *)compressed.data(), compressed_size, (char *)dest + pos, &real_size) != SNAPPY_OK) {
+			return false;
+		}
+		pos += real_size;
+	}
+
+	return true;
+}
+
 bool RunMountedReplay(const std::string &filename) {
 	_assert_msg_(SYSTEM, !active && !nextFrame, "Cannot run replay while recording.");
 
@@ -1235,8 +1438,13 @@ bool RunMountedReplay(const std::string &filename) {
 	pushbuf.resize(bufsz);
 
 	bool truncated = false;
-	truncated = truncated || !ReadCompressed(fp, commands.data(), sizeof(Command) * sz);
-	truncated = truncated || !ReadCompressed(fp, pushbuf.data(), bufsz);
+	if (version >= 4) {
+		truncated = truncated || !ReadCompressedChunks(fp, pushbuf.data(), bufsz);
+		truncated = truncated || !ReadCompressed(fp, commands.data(), sizeof(Command) * sz);
+	} else {
+		truncated = truncated || !ReadCompressed(fp, commands.data(), sizeof(Command) * sz);
+		truncated = truncated || !ReadCompressed(fp, pushbuf.data(), bufsz);
+	}
 
 	pspFileSystem.CloseFile(fp);
 
@@ -1245,8 +1453,13 @@ bool RunMountedReplay(const std::string &filename) {
 		return false;
 	}
 
+	double start = real_time_now();
 	DumpExecute executor;
-	return executor.Run();
+	bool success = executor.Run();
+	if (success && replayCallback) {
+		replayCallback(real_time_now() - start);
+	}
+	return success;
 }
 
 };
@@ -37,5 +37,7 @@ void NotifyDisplay(u32 addr, int stride, int fmt);
 void NotifyFrame();
 
 bool RunMountedReplay(const std::string &filename);
+// Called after each replay finishes with the seconds it took, for benchmarking.
+void SetReplayCallback(const std::function<void(double)> &callback);
 
 };
@@ -109,10 +109,12 @@ bool GPU_Init(GraphicsContext *ctx, Draw::DrawContext *draw) {
 void GPU_Shutdown() {
 	// Wait for IsReady, since it might be running on a thread.
 	if (gpu) {
+		gpu->SyncThread();
 		gpu->CancelReady();
 		while (!gpu->IsReady()) {
 			sleep_ms(10);
 		}
+		gpu->SaveGameCaches();
 	}
 	delete gpu;
 	gpu = nullptr;
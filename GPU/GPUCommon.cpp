@@ -1,11 +1,15 @@
 #include <algorithm>
+#include <chrono>
 #include <type_traits>
 #include <mutex>
 
 #include "base/timeutil.h"
+#include "ext/xxhash.h"
 #include "profiler/profiler.h"
+#include "thread/threadutil.h"
 
 #include "Common/ColorConv.h"
+#include "Common/FileUtil.h"
 #include "Core/Reporting.h"
 #include "GPU/GeDisasm.h"
 #include "GPU/GPU.h"
@@ -17,6 +21,8 @@
 #include "Core/MemMap.h"
 #include "Core/Host.h"
 #include "Core/Reporting.h"
+#include "Core/System.h"
+#include "Core/ELF/ParamSFO.h"
 #include "Core/HLE/HLE.h"
 #include "Core/HLE/sceKernelMemory.h"
 #include "Core/HLE/sceKernelInterrupt.h"
@@ -408,9 +414,107 @@ GPUCommon::GPUCommon(GraphicsContext *gfxCtx, Draw::DrawContext *draw) :
 	}
 
 	UpdateCmdInfo();
+
+	if (g_Config.bGeThread) {
+		geThreadQuit_ = false;
+		geThread_ = std::thread([this] { GeThreadFunc(); });
+		geThreadID_ = geThread_.get_id();
+		threaded_ = true;
+	}
 }
 
 GPUCommon::~GPUCommon() {
+	StopGeThread();
+}
+
+void GPUCommon::GeThreadFunc() {
+	setCurrentThreadName("GeThread");
+
+	std::unique_lock<std::mutex> guard(geThreadLock_);
+	while (true) {
+		geThreadCond_.wait(guard, [this] { return geThreadQuit_ || geThreadBusy_; });
+		if (!geThreadBusy_) {
+			// Only quit once idle, so queued work is never dropped.
+			break;
+		}
+
+		guard.unlock();
+		ProcessDLQueueFrom(geThreadTicks_);
+		guard.lock();
+
+		geThreadBusy_ = false;
+		geThreadCond_.notify_all();
+		// Make sure the CPU thread picks up any deferred triggers soon.
+		__GeWakeFromThread();
+	}
+}
+
+void GPUCommon::StopGeThread() {
+	if (!geThread_.joinable())
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(geThreadLock_);
+		geThreadQuit_ = true;
+		geThreadCond_.notify_all();
+	}
+	geThread_.join();
+	geThread_ = std::thread();
+	deferredTriggers_.clear();
+}
+
+void GPUCommon::SyncThread() {
+	if (!geThread_.joinable() || OnGeThread())
+		return;
+
+	if (geThreadBusy_) {
+		std::unique_lock<std::mutex> guard(geThreadLock_);
+		geThreadCond_.wait(guard, [this] { return !geThreadBusy_; });
+	}
+
+	if (deferredTriggers_.empty())
+		return;
+
+	// The worker is idle now, so we own these.  Applying them may run CoreTiming events.
+	std::vector<DeferredTrigger> triggers;
+	triggers.swap(deferredTriggers_);
+	for (const DeferredTrigger &t : triggers) {
+		if (t.interrupt)
+			__GeTriggerInterrupt(t.id, t.pc, t.atTicks);
+		else
+			__GeTriggerSync(t.type, t.id, t.atTicks);
+	}
+}
+
+void GPUCommon::ScheduleProcessDLQueue() {
+	// Stepping and recording need to see each list as it runs, so stay on this thread then.
+	if (!geThread_.joinable() || GPUDebug::IsActive() || GPURecord::IsActive() || GPURecord::IsActivePending()) {
+		SyncThread();
+		ProcessDLQueue();
+		return;
+	}
+
+	SyncThread();
+	std::lock_guard<std::mutex> guard(geThreadLock_);
+	geThreadTicks_ = CoreTiming::GetTicks();
+	geThreadBusy_ = true;
+	geThreadCond_.notify_all();
+}
+
+bool GPUCommon::TriggerSync(GPUSyncType type, int id, u64 atTicks) {
+	if (OnGeThread()) {
+		deferredTriggers_.push_back({ false, type, id, 0, atTicks });
+		return true;
+	}
+	return __GeTriggerSync(type, id, atTicks);
+}
+
+bool GPUCommon::TriggerInterrupt(int listid, u32 pc, u64 atTicks) {
+	if (OnGeThread()) {
+		deferredTriggers_.push_back({ true, GPU_SYNC_DRAW, listid, pc, atTicks });
+		return true;
+	}
+	return __GeTriggerInterrupt(listid, pc, atTicks);
 }
 
 void GPUCommon::UpdateCmdInfo() {
@@ -429,9 +533,27 @@ void GPUCommon::UpdateCmdInfo() {
 		cmdInfo_[GE_CMD_JUMP].func = &GPUCommon::Execute_Jump;
 		cmdInfo_[GE_CMD_CALL].func = &GPUCommon::Execute_Call;
 	}
+
+	// Cached state runs depend on which commands execute.
+	ClearStateRuns();
+}
+
+void GPUCommon::SaveGameCaches() {
+	if (drawEngineCommon_)
+		drawEngineCommon_->SaveVertexDecoderCache();
 }
 
 void GPUCommon::BeginHostFrame() {
+	if (!vertexDecoderCacheLoaded_) {
+		// The draw engine's options are set up now, and we still haven't drawn anything.
+		vertexDecoderCacheLoaded_ = true;
+		std::string discID = g_paramSFO.GetDiscID();
+		if (drawEngineCommon_ && !discID.empty()) {
+			File::CreateFullPath(GetSysDirectory(DIRECTORY_APP_CACHE));
+			drawEngineCommon_->LoadVertexDecoderCache(GetSysDirectory(DIRECTORY_APP_CACHE) + "/" + discID + ".vtxdeccache");
+		}
+	}
+
 	ReapplyGfxState();
 
 	// TODO: Assume config may have changed - maybe move to resize.
@@ -456,6 +578,7 @@ void GPUCommon::Reinitialize() {
 	busyTicks = 0;
 	timeSpentStepping_ = 0.0;
 	interruptsEnabled_ = true;
+	ClearStateRuns();
 }
 
 int GPUCommon::EstimatePerVertexCost() {
@@ -520,6 +643,7 @@ void GPUCommon::DumpNextFrame() {
 }
 
 u32 GPUCommon::DrawSync(int mode) {
+	SyncThread();
 	if (mode < 0 || mode > 1)
 		return SCE_KERNEL_ERROR_INVALID_MODE;
 
@@ -568,6 +692,7 @@ void GPUCommon::CheckDrawSync() {
 }
 
 int GPUCommon::ListSync(int listid, int mode) {
+	SyncThread();
 	if (listid < 0 || listid >= DisplayListMaxCount)
 		return SCE_KERNEL_ERROR_INVALID_ID;
 
@@ -612,6 +737,7 @@ int GPUCommon::ListSync(int listid, int mode) {
 }
 
 int GPUCommon::GetStack(int index, u32 stackPtr) {
+	SyncThread();
 	if (!currentList) {
 		// Seems like it doesn't return an error code?
 		return 0;
@@ -637,6 +763,7 @@ int GPUCommon::GetStack(int index, u32 stackPtr) {
 }
 
 u32 GPUCommon::EnqueueList(u32 listpc, u32 stall, int subIntrBase, PSPPointer<PspGeListArgs> args, bool head) {
+	SyncThread();
 	// TODO Check the stack values in missing arg and ajust the stack depth
 
 	// Check alignment
@@ -737,13 +864,14 @@ u32 GPUCommon::EnqueueList(u32 listpc, u32 stall, int subIntrBase, PSPPointer<Ps
 		drawCompleteTicks = (u64)-1;
 
 		// TODO save context when starting the list if param is set
-		ProcessDLQueue();
+		ScheduleProcessDLQueue();
 	}
 
 	return id;
 }
 
 u32 GPUCommon::DequeueList(int listid) {
+	SyncThread();
 	if (listid < 0 || listid >= DisplayListMaxCount || dls[listid].state == PSP_GE_DL_STATE_NONE)
 		return SCE_KERNEL_ERROR_INVALID_ID;
 
@@ -767,6 +895,7 @@ u32 GPUCommon::DequeueList(int listid) {
 }
 
 u32 GPUCommon::UpdateStall(int listid, u32 newstall) {
+	SyncThread();
 	if (listid < 0 || listid >= DisplayListMaxCount || dls[listid].state == PSP_GE_DL_STATE_NONE)
 		return SCE_KERNEL_ERROR_INVALID_ID;
 	auto &dl = dls[listid];
@@ -775,12 +904,13 @@ u32 GPUCommon::UpdateStall(int listid, u32 newstall) {
 
 	dl.stall = newstall & 0x0FFFFFFF;
 	
-	ProcessDLQueue();
+	ScheduleProcessDLQueue();
 
 	return 0;
 }
 
 u32 GPUCommon::Continue() {
+	SyncThread();
 	if (!currentList)
 		return 0;
 
@@ -816,11 +946,12 @@ u32 GPUCommon::Continue() {
 		return -1;
 	}
 
-	ProcessDLQueue();
+	ScheduleProcessDLQueue();
 	return 0;
 }
 
 u32 GPUCommon::Break(int mode) {
+	SyncThread();
 	if (mode < 0 || mode > 1)
 		return SCE_KERNEL_ERROR_INVALID_MODE;
 
@@ -944,7 +1075,9 @@ bool GPUCommon::InterpretList(DisplayList &list) {
 			}
 		}
 
-		if (useFastRunLoop) {
+		if (useFastRunLoop && cmdProfile_) {
+			ProfiledRunLoop(list);
+		} else if (useFastRunLoop) {
 			FastRunLoop(list);
 		} else {
 			SlowRunLoop(list);
@@ -984,7 +1117,20 @@ void GPUCommon::FastRunLoop(DisplayList &list) {
 	PROFILE_THIS_SCOPE("gpuloop");
 	const CommandInfo *cmdInfo = cmdInfo_;
 	int dc = downcount;
+	// Whether list.pc may be the start of a run of state commands.
+	bool runStart = true;
 	for (; dc > 0; --dc) {
+		if (runStart) {
+			runStart = false;
+			int skipped = ReplayStateRun(list.pc, dc);
+			if (skipped != 0) {
+				list.pc += skipped * 4;
+				dc -= skipped;
+				if (dc == 0)
+					break;
+			}
+		}
+
 		// We know that display list PCs have the upper nibble == 0 - no need to mask the pointer
 		const u32 op = *(const u32 *)(Memory::base + list.pc);
 		const u32 cmd = op >> 24;
@@ -995,6 +1141,7 @@ void GPUCommon::FastRunLoop(DisplayList &list) {
 				downcount = dc;
 				(this->*info.func)(op, diff);
 				dc = downcount;
+				runStart = true;
 			}
 		} else {
 			uint64_t flags = info.flags;
@@ -1008,6 +1155,7 @@ void GPUCommon::FastRunLoop(DisplayList &list) {
 				downcount = dc;
 				(this->*info.func)(op, diff);
 				dc = downcount;
+				runStart = true;
 			} else {
 				uint64_t dirty = flags >> 8;
 				if (dirty)
@@ -1019,6 +1167,131 @@ void GPUCommon::FastRunLoop(DisplayList &list) {
 	downcount = 0;
 }
 
+enum {
+	STATE_RUN_MIN_COMMANDS = 8,
+	STATE_RUN_MAX_COMMANDS = 1024,
+	STATE_RUN_MAX_OPS = 65536,
+	STATE_RUN_MAX_RUNS = 8192,
+	// After this many rewrites, stop hashing the run on every visit.
+	STATE_RUN_MAX_MISSES = 4,
+};
+
+bool GPUCommon::BuildStateRun(StateRun &run, u32 pc, int dc) {
+	const u32 limit = std::min((u32)dc, Memory::ValidSize(pc, STATE_RUN_MAX_COMMANDS * 4) / 4);
+	const u32_le *words = (const u32_le *)(Memory::base + pc);
+	u32 count = 0;
+	while (count < limit && (cmdInfo_[words[count] >> 24].flags & (FLAG_EXECUTE | FLAG_EXECUTEONCHANGE)) == 0)
+		count++;
+
+	// If we hit the stall, the run probably continues - wait until it's all there.
+	if (count == (u32)dc)
+		return false;
+
+	run.count = 0;
+	run.opsStart = (u32)stateRunOps_.size();
+	run.opsCount = 0;
+	run.misses = 0;
+	run.hash = 0;
+	if (count < STATE_RUN_MIN_COMMANDS)
+		return true;
+
+	// Keep one op per command, noting whether its value changes within the run.
+	int *slot = stateRunSlot_;
+	for (u32 i = 0; i < count; ++i) {
+		const u32 op = words[i];
+		const u8 cmd = op >> 24;
+		if (slot[cmd] == -1) {
+			slot[cmd] = (int)stateRunOps_.size();
+			stateRunOps_.push_back({ cmd, false, op, op });
+		} else {
+			StateRunOp &runOp = stateRunOps_[slot[cmd]];
+			if (runOp.last != op)
+				runOp.changesWithin = true;
+			runOp.last = op;
+		}
+	}
+
+	run.count = count;
+	run.opsCount = (u32)stateRunOps_.size() - run.opsStart;
+	run.hash = XXH64(words, count * 4, 0);
+	for (u32 i = run.opsStart; i < (u32)stateRunOps_.size(); ++i)
+		slot[stateRunOps_[i].cmd] = -1;
+	return true;
+}
+
+// Applies a cached run of state commands at pc, if any.  Returns how many commands were consumed.
+int GPUCommon::ReplayStateRun(u32 pc, int dc) {
+	int index = stateRunIndex_.Get(pc);
+	if (index == -1) {
+		if (stateRunOps_.size() > STATE_RUN_MAX_OPS || stateRuns_.size() >= STATE_RUN_MAX_RUNS)
+			ClearStateRuns();
+		StateRun run;
+		if (!BuildStateRun(run, pc, dc))
+			return 0;
+		index = (int)stateRuns_.size();
+		stateRuns_.push_back(run);
+		stateRunIndex_.Insert(pc, index);
+	} else {
+		StateRun &run = stateRuns_[index];
+		if (run.count == 0 || run.count > (u32)dc)
+			return 0;
+		if (XXH64(Memory::base + pc, run.count * 4, 0) != run.hash) {
+			// The list was rewritten since.  If it keeps happening, it's not worth hashing each time.
+			if (++run.misses >= STATE_RUN_MAX_MISSES) {
+				run.count = 0;
+				return 0;
+			}
+			StateRun rebuilt;
+			if (!BuildStateRun(rebuilt, pc, dc))
+				return 0;
+			// Reuse the old ops when the new ones fit, so rewrites don't keep growing the list.
+			if (rebuilt.opsCount <= run.opsCount) {
+				std::copy(stateRunOps_.begin() + rebuilt.opsStart, stateRunOps_.end(), stateRunOps_.begin() + run.opsStart);
+				stateRunOps_.resize(rebuilt.opsStart);
+				rebuilt.opsStart = run.opsStart;
+			}
+			rebuilt.misses = run.misses;
+			run = rebuilt;
+		}
+	}
+
+	const StateRun &run = stateRuns_[index];
+	if (run.count == 0)
+		return 0;
+
+	// Same effect as running the commands one by one, except that the flush (if any)
+	// happens before all the writes, and dirty flags may be a superset.
+	const StateRunOp *ops = &stateRunOps_[run.opsStart];
+	bool flush = false;
+	uint64_t dirty = 0;
+	for (u32 i = 0; i < run.opsCount; ++i) {
+		const StateRunOp &runOp = ops[i];
+		if (runOp.changesWithin || gstate.cmdmem[runOp.cmd] != runOp.first) {
+			const uint64_t flags = cmdInfo_[runOp.cmd].flags;
+			if (flags & FLAG_FLUSHBEFOREONCHANGE)
+				flush = true;
+			dirty |= flags >> 8;
+		}
+	}
+
+	if (flush && drawEngineCommon_->GetNumDrawCalls()) {
+		drawEngineCommon_->DispatchFlush();
+	}
+	for (u32 i = 0; i < run.opsCount; ++i) {
+		gstate.cmdmem[ops[i].cmd] = ops[i].last;
+	}
+	if (dirty)
+		gstate_c.Dirty(dirty);
+	return (int)run.count;
+}
+
+void GPUCommon::ClearStateRuns() {
+	stateRunIndex_.Clear();
+	stateRuns_.clear();
+	stateRunOps_.clear();
+	memset(stateRunSlot_, -1, sizeof(stateRunSlot_));
+}
+
 void GPUCommon::BeginFrame() {
 	immCount_ = 0;
 	if (dumpNextFrame_) {
@@ -1063,6 +1336,27 @@ void GPUCommon::SlowRunLoop(DisplayList &list)
 	}
 }
 
+// Like SlowRunLoop without the debugger, but timing each command.
+void GPUCommon::ProfiledRunLoop(DisplayList &list) {
+	while (downcount > 0) {
+		u32 op = Memory::ReadUnchecked_U32(list.pc);
+		u32 cmd = op >> 24;
+
+		// real_time_now() only has microsecond resolution on some platforms, too coarse for one command.
+		auto start = std::chrono::steady_clock::now();
+		u32 diff = op ^ gstate.cmdmem[cmd];
+		PreExecuteOp(op, diff);
+		gstate.cmdmem[cmd] = op;
+		ExecuteOp(op, diff);
+
+		cmdProfile_->seconds[cmd] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		cmdProfile_->count[cmd]++;
+
+		list.pc += 4;
+		--downcount;
+	}
+}
+
 // The newPC parameter is used for jumps, we don't count cycles between.
 void GPUCommon::UpdatePC(u32 currentPC, u32 newPC) {
 	// Rough estimate, 2 CPU ticks (it's double the clock rate) per GPU instruction.
@@ -1123,7 +1417,11 @@ int GPUCommon::GetNextListIndex() {
 }
 
 void GPUCommon::ProcessDLQueue() {
-	startingTicks = CoreTiming::GetTicks();
+	ProcessDLQueueFrom(CoreTiming::GetTicks());
+}
+
+void GPUCommon::ProcessDLQueueFrom(u64 ticks) {
+	startingTicks = ticks;
 	cyclesExecuted = 0;
 
 	// Seems to be correct behaviour to process the list anyway?
@@ -1150,7 +1448,7 @@ void GPUCommon::ProcessDLQueue() {
 
 	drawCompleteTicks = startingTicks + cyclesExecuted;
 	busyTicks = std::max(busyTicks, drawCompleteTicks);
-	__GeTriggerSync(GPU_SYNC_DRAW, 1, drawCompleteTicks);
+	TriggerSync(GPU_SYNC_DRAW, 1, drawCompleteTicks);
 	// Since the event is in CoreTiming, we're in sync.  Just set 0 now.
 }
 
@@ -1385,7 +1683,7 @@ void GPUCommon::Execute_End(u32 op, u32 diff) {
 			}
 			// TODO: Technically, jump/call/ret should generate an interrupt, but before the pc change maybe?
 			if (currentList->interruptsEnabled && trigger) {
-				if (__GeTriggerInterrupt(currentList->id, currentList->pc, startingTicks + cyclesExecuted)) {
+				if (TriggerInterrupt(currentList->id, currentList->pc, startingTicks + cyclesExecuted)) {
 					currentList->pendingInterrupt = true;
 					UpdateState(GPUSTATE_INTERRUPT);
 				}
@@ -1397,7 +1695,7 @@ void GPUCommon::Execute_End(u32 op, u32 diff) {
 		case PSP_GE_SIGNAL_HANDLER_PAUSE:
 			currentList->state = PSP_GE_DL_STATE_PAUSED;
 			if (currentList->interruptsEnabled) {
-				if (__GeTriggerInterrupt(currentList->id, currentList->pc, startingTicks + cyclesExecuted)) {
+				if (TriggerInterrupt(currentList->id, currentList->pc, startingTicks + cyclesExecuted)) {
 					currentList->pendingInterrupt = true;
 					UpdateState(GPUSTATE_INTERRUPT);
 				}
@@ -1412,13 +1710,13 @@ void GPUCommon::Execute_End(u32 op, u32 diff) {
 		default:
 			currentList->subIntrToken = prev & 0xFFFF;
 			UpdateState(GPUSTATE_DONE);
-			if (currentList->interruptsEnabled && __GeTriggerInterrupt(currentList->id, currentList->pc, startingTicks + cyclesExecuted)) {
+			if (currentList->interruptsEnabled && TriggerInterrupt(currentList->id, currentList->pc, startingTicks + cyclesExecuted)) {
 				currentList->pendingInterrupt = true;
 			} else {
 				currentList->state = PSP_GE_DL_STATE_COMPLETED;
 				currentList->waitTicks = startingTicks + cyclesExecuted;
 				busyTicks = std::max(busyTicks, currentList->waitTicks);
-				__GeTriggerSync(GPU_SYNC_LIST, currentList->id, currentList->waitTicks);
+				TriggerSync(GPU_SYNC_LIST, currentList->id, currentList->waitTicks);
 				if (currentList->started && currentList->context.IsValid()) {
 					gstate.Restore(currentList->context);
 					ReapplyGfxState();
@@ -2355,6 +2653,7 @@ struct DisplayList_v2 {
 };
 
 void GPUCommon::DoState(PointerWrap &p) {
+	SyncThread();
 	auto s = p.Section("GPUCommon", 1, 4);
 	if (!s)
 		return;
@@ -2430,9 +2729,11 @@ void GPUCommon::DoState(PointerWrap &p) {
 }
 
 void GPUCommon::InterruptStart(int listid) {
+	SyncThread();
 	interruptRunning = true;
 }
 void GPUCommon::InterruptEnd(int listid) {
+	SyncThread();
 	interruptRunning = false;
 	isbreak = false;
 
@@ -2448,11 +2749,12 @@ void GPUCommon::InterruptEnd(int listid) {
 		__GeTriggerWait(GPU_SYNC_LIST, listid);
 	}
 
-	ProcessDLQueue();
+	ScheduleProcessDLQueue();
 }
 
 // TODO: Maybe cleaner to keep this in GE and trigger the clear directly?
 void GPUCommon::SyncEnd(GPUSyncType waitType, int listid, bool wokeThreads) {
+	SyncThread();
 	if (waitType == GPU_SYNC_DRAW && wokeThreads)
 	{
 		for (int i = 0; i < DisplayListMaxCount; ++i) {
@@ -2657,6 +2959,7 @@ void GPUCommon::DoBlockTransfer(u32 skipDrawReason) {
 }
 
 bool GPUCommon::PerformMemoryCopy(u32 dest, u32 src, int size) {
+	SyncThread();
 	// Track stray copies of a framebuffer in RAM. MotoGP does this.
 	if (framebufferManager_->MayIntersectFramebuffer(src) || framebufferManager_->MayIntersectFramebuffer(dest)) {
 		if (!framebufferManager_->NotifyFramebufferCopy(src, dest, size, false, gstate_c.skipDrawReason)) {
@@ -2676,6 +2979,7 @@ bool GPUCommon::PerformMemoryCopy(u32 dest, u32 src, int size) {
 }
 
 bool GPUCommon::PerformMemorySet(u32 dest, u8 v, int size) {
+	SyncThread();
 	// This may indicate a memset, usually to 0, of a framebuffer.
 	if (framebufferManager_->MayIntersectFramebuffer(dest)) {
 		Memory::Memset(dest, v, size);
@@ -2711,6 +3015,11 @@ bool GPUCommon::PerformMemoryUpload(u32 dest, int size) {
 }
 
 void GPUCommon::InvalidateCache(u32 addr, int size, GPUInvalidationType type) {
+	SyncThread();
+	// Cached state runs check their own contents, so only drop them on a full invalidate.
+	if (size <= 0 || type == GPU_INVALIDATE_ALL)
+		ClearStateRuns();
+
 	if (size > 0)
 		textureCache_->Invalidate(addr, size, type);
 	else
@@ -2725,6 +3034,7 @@ void GPUCommon::InvalidateCache(u32 addr, int size, GPUInvalidationType type) {
 }
 
 void GPUCommon::NotifyVideoUpload(u32 addr, int size, int width, int format) {
+	SyncThread();
 	if (Memory::IsVRAMAddress(addr)) {
 		framebufferManager_->NotifyVideoUpload(addr, size, width, (GEBufferFormat)format);
 	}
@@ -2733,6 +3043,7 @@ void GPUCommon::NotifyVideoUpload(u32 addr, int size, int width, int format) {
 }
 
 bool GPUCommon::PerformStencilUpload(u32 dest, int size) {
+	SyncThread();
 	if (framebufferManager_->MayIntersectFramebuffer(dest)) {
 		framebufferManager_->NotifyStencilUpload(dest, size);
 		return true;
@@ -1,15 +1,18 @@
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 #include "Common/Common.h"
+#include "Common/Hashmaps.h"
 #include "Common/MemoryUtil.h"
 #include "GPU/GPUInterface.h"
 #include "GPU/GPUState.h"
 #include "GPU/Common/GPUDebugInterface.h"
 
-#if defined(__ANDROID__)
-#include <atomic>
-#endif
-
 #if defined(_M_SSE)
 #include <emmintrin.h>
 #endif
@@ -98,7 +101,11 @@ class GPUCommon : public GPUInterface, public GPUDebugInterface {
 	void PreExecuteOp(u32 op, u32 diff) override;
 
 	bool InterpretList(DisplayList &list) override;
+	void SetCommandProfile(GPUCommandProfile *profile) override {
+		cmdProfile_ = profile;
+	}
 	void ProcessDLQueue();
+	void SyncThread() override;
 	u32  UpdateStall(int listid, u32 newstall) override;
 	u32  EnqueueList(u32 listpc, u32 stall, int subIntrBase, PSPPointer<PspGeListArgs> args, bool head) override;
 	u32  DequeueList(int listid) override;
@@ -241,6 +248,7 @@ class GPUCommon : public GPUInterface, public GPUDebugInterface {
 	std::vector<FramebufferInfo> GetFramebufferList() override;
 	void ClearShaderCache() override {}
 	void CleanupBeforeUI() override {}
+	void SaveGameCaches() override;
 
 	s64 GetListTicks(int listid) override {
 		if (listid >= 0 && listid < DisplayListMaxCount) {
@@ -280,10 +288,15 @@ class GPUCommon : public GPUInterface, public GPUDebugInterface {
 	virtual void FastRunLoop(DisplayList &list);
 
 	void SlowRunLoop(DisplayList &list);
+	void ProfiledRunLoop(DisplayList &list);
 	void UpdatePC(u32 currentPC, u32 newPC);
 	void UpdateState(GPURunState state);
 	void PopDLQueue();
 	void CheckDrawSync();
+	// Runs ProcessDLQueue() on the GE thread if enabled, otherwise right away.
+	void ScheduleProcessDLQueue();
+	bool TriggerSync(GPUSyncType type, int id, u64 atTicks);
+	bool TriggerInterrupt(int listid, u32 pc, u64 atTicks);
 	int  GetNextListIndex();
 	virtual void FastLoadBoneMatrix(u32 target);
 
@@ -338,6 +351,7 @@ class GPUCommon : public GPUInterface, public GPUDebugInterface {
 	bool dumpNextFrame_;
 	bool dumpThisFrame_;
 	bool debugRecording_;
+	GPUCommandProfile *cmdProfile_ = nullptr;
 	bool interruptsEnabled_;
 	bool resized_;
 	DrawType lastDraw_ = DRAW_UNKNOWN;
@@ -356,9 +370,60 @@ class GPUCommon : public GPUInterface, public GPUDebugInterface {
 
 	std::string reportingPrimaryInfo_;
 	std::string reportingFullInfo_;
+	bool vertexDecoderCacheLoaded_ = false;
 
 private:
 	void FlushImm();
+	void ProcessDLQueueFrom(u64 ticks);
+
+	// Runs of plain state commands (nothing to execute) seen before, keyed by list address.
+	// A run is only replayed while its command words still hash the same.
+	struct StateRunOp {
+		u8 cmd;
+		bool changesWithin;
+		u32 first;
+		u32 last;
+	};
+	struct StateRun {
+		u32 count;  // 0 if the run was too short to be worth caching, or kept changing.
+		u32 opsStart;
+		u32 opsCount;
+		u32 misses;
+		u64 hash;
+	};
+	int ReplayStateRun(u32 pc, int dc);
+	bool BuildStateRun(StateRun &run, u32 pc, int dc);
+	void ClearStateRuns();
+	bool OnGeThread() const {
+		return geThread_.joinable() && std::this_thread::get_id() == geThreadID_;
+	}
+	void GeThreadFunc();
+	void StopGeThread();
+
+	// Sync and interrupt events raised on the GE thread, applied on the CPU thread in SyncThread().
+	struct DeferredTrigger {
+		bool interrupt;
+		GPUSyncType type;
+		int id;
+		u32 pc;
+		u64 atTicks;
+	};
+
+	std::thread geThread_;
+	std::thread::id geThreadID_;
+	std::mutex geThreadLock_;
+	std::condition_variable geThreadCond_;
+	std::atomic<bool> geThreadBusy_{ false };
+	bool geThreadQuit_ = false;
+	u64 geThreadTicks_ = 0;
+	std::vector<DeferredTrigger> deferredTriggers_;
+
+	DenseHashMap<u32, int, -1> stateRunIndex_{ 256 };
+	std::vector<StateRun> stateRuns_;
+	std::vector<StateRunOp> stateRunOps_;
+	// Op index per command while building a run, -1 otherwise.
+	int stateRunSlot_[256];
+
 	// Debug stats.
 	double timeSteppingStarted_;
 	double timeSpentStepping_;
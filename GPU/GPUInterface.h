@@ -159,6 +159,12 @@ namespace Draw {
 class DrawContext;
 }
 
+// Time spent executing each GE command, collected only while profiling (slows things down.)
+struct GPUCommandProfile {
+	u64 count[256];
+	double seconds[256];
+};
+
 class GPUInterface {
 public:
 	virtual ~GPUInterface() {}
@@ -196,6 +202,14 @@ class GPUInterface {
 	virtual void PreExecuteOp(u32 op, u32 diff) = 0;
 	virtual void ExecuteOp(u32 op, u32 diff) = 0;
 	virtual bool InterpretList(DisplayList& list) = 0;
+	// Pass nullptr to stop profiling.  Counts are added to what's already in profile.
+	virtual void SetCommandProfile(GPUCommandProfile *profile) = 0;
+	// Waits for display list processing on the GE thread (if any) to finish.
+	virtual void SyncThread() = 0;
+	// Whether this GPU started a GE thread.  Doesn't change after the GPU is created.
+	bool IsThreaded() const {
+		return threaded_;
+	}
 
 	// Framebuffer management
 	virtual void SetDisplayFramebuffer(u32 framebuf, u32 stride, GEBufferFormat format) = 0;
@@ -231,6 +245,8 @@ class GPUInterface {
 	virtual void Resized() = 0;
 	virtual void ClearShaderCache() = 0;
 	virtual void CleanupBeforeUI() = 0;
+	// Called when the game is shutting down, to write out anything remembered for next time.
+	virtual void SaveGameCaches() = 0;
 	virtual bool FramebufferDirty() = 0;
 	virtual bool FramebufferReallyDirty() = 0;
 	virtual bool BusyDrawing() = 0;
@@ -249,4 +265,7 @@ class GPUInterface {
 	// For debugging. The IDs returned are opaque, do not poke in them or display them in any way.
 	virtual std::vector<std::string> DebugGetShaderIDs(DebugShaderType type) = 0;
 	virtual std::string DebugGetShaderString(std::string id, DebugShaderType type, DebugShaderStringType stringType) = 0;
+
+protected:
+	bool threaded_ = false;
 };
@@ -698,24 +698,28 @@ void NullGPU::NotifyVideoUpload(u32 addr, int size, int width, int format) {
 }
 
 bool NullGPU::PerformMemoryCopy(u32 dest, u32 src, int size) {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	return false;
 }
 
 bool NullGPU::PerformMemorySet(u32 dest, u8 v, int size) {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	return false;
 }
 
 bool NullGPU::PerformMemoryDownload(u32 dest, int size) {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	return false;
 }
 
 bool NullGPU::PerformMemoryUpload(u32 dest, int size) {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	return false;
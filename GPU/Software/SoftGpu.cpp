@@ -894,6 +894,7 @@ void SoftGPU::NotifyVideoUpload(u32 addr, int size, int width, int format)
 
 bool SoftGPU::PerformMemoryCopy(u32 dest, u32 src, int size)
 {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	GPURecord::NotifyMemcpy(dest, src, size);
@@ -904,6 +905,7 @@ bool SoftGPU::PerformMemoryCopy(u32 dest, u32 src, int size)
 
 bool SoftGPU::PerformMemorySet(u32 dest, u8 v, int size)
 {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	GPURecord::NotifyMemset(dest, v, size);
@@ -914,6 +916,7 @@ bool SoftGPU::PerformMemorySet(u32 dest, u8 v, int size)
 
 bool SoftGPU::PerformMemoryDownload(u32 dest, int size)
 {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	return false;
@@ -921,6 +924,7 @@ bool SoftGPU::PerformMemoryDownload(u32 dest, int size)
 
 bool SoftGPU::PerformMemoryUpload(u32 dest, int size)
 {
+	SyncThread();
 	// Nothing to update.
 	InvalidateCache(dest, size, GPU_INVALIDATE_HINT);
 	GPURecord::NotifyUpload(dest, size);
@@ -2,11 +2,13 @@
 // See headless.txt.
 // To build on non-windows systems, just run CMake in the SDL directory, it will build both a normal ppsspp and the headless version.
 
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <limits>
 
 #include "file/zip_read.h"
+#include "json/json_writer.h"
 #include "profiler/profiler.h"
 #include "Common/FileUtil.h"
 #include "Common/GraphicsContext.h"
@@ -14,11 +16,17 @@
 #include "Core/ConfigValues.h"
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
+#include "Core/Debugger/SymbolMap.h"
+#include "Core/MIPS/JitCommon/JitBlockCache.h"
+#include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/System.h"
 #include "Core/HLE/sceUtility.h"
 #include "Core/Host.h"
 #include "Core/SaveState.h"
 #include "GPU/Common/FramebufferCommon.h"
+#include "GPU/Debugger/Record.h"
+#include "GPU/GPU.h"
+#include "GPU/GPUInterface.h"
 #include "Log.h"
 #include "LogManager.h"
 #include "base/NativeApp.h"
@@ -108,6 +116,8 @@ int printUsage(const char *progname, const char *reason)
 	fprintf(stderr, "  --ir                  use ir interpreter\n");
 	fprintf(stderr, "  -j                    use jit (default)\n");
 	fprintf(stderr, "  -c, --compare         compare with output in file.expected\n");
+	fprintf(stderr, "  --bench-gedump[=N]    replay .ppdmp files N times (default 100), print JSON stats\n");
+	fprintf(stderr, "  --block-profile[=N]   print JSON of the N hottest jit blocks to stderr (default 50)\n");
 	fprintf(stderr, "\nSee headless.txt for details.\n");
 
 	return 1;
@@ -127,40 +137,46 @@ static HeadlessHost *getHost(GPUCore gpuCore) {
 	}
 }
 
-bool RunAutoTest(HeadlessHost *headlessHost, CoreParameter &coreParameter, bool autoCompare, bool verbose, double timeout)
-{
-	if (teamCityMode) {
-		// Kinda ugly, trying to guesstimate the test name from filename...
-		teamCityName = GetTestName(coreParameter.fileToStart);
-	}
-
-	std::string output;
-	if (autoCompare)
-		coreParameter.collectEmuLog = &output;
-
-	std::string error_string;
-	if (!PSP_Init(coreParameter, &error_string)) {
-		fprintf(stderr, "Failed to start %s. Error: %s\n", coreParameter.fileToStart.c_str(), error_string.c_str());
-		printf("TESTERROR\n");
-		TeamCityPrint("##teamcity[testIgnored name='%s' message='PRX/ELF missing']\n", teamCityName.c_str());
-		return false;
+static void WriteBlockProfileJson(const std::string &filename, int count) {
+	std::vector<JitBlockProfileInfo> profile;
+	MIPSComp::GetHotBlockProfile(profile, count);
+
+	json::JsonWriter j(json::JsonWriter::PRETTY);
+	j.begin();
+	j.writeString("file", filename);
+	j.pushArray("blocks");
+	for (const JitBlockProfileInfo &info : profile) {
+		j.pushDict();
+		j.writeUint("address", info.originalAddress);
+		j.writeUint("size", info.originalBytes);
+		j.writeRaw("entries", std::to_string(info.profile.entries));
+		j.writeRaw("cycles", std::to_string(info.profile.cycles));
+		// Only the IR interpreter samples host time.
+		if (info.profile.sampledSeconds > 0.0)
+			j.writeFloat("hostMs", info.profile.EstimatedSeconds() * 1000.0);
+		u32 funcStart = g_symbolMap->GetFunctionStart(info.originalAddress);
+		if (funcStart != SymbolMap::INVALID_ADDRESS) {
+			j.writeUint("function", funcStart);
+			j.writeString("functionName", g_symbolMap->GetLabelString(funcStart));
+		}
+		j.pop();
 	}
+	j.pop();
+	j.end();
 
-	TeamCityPrint("##teamcity[testStarted name='%s' captureStandardOutput='true']\n", teamCityName.c_str());
-
-	host->BootDone();
-
-	if (autoCompare)
-		headlessHost->SetComparisonScreenshot(ExpectedScreenshotFromFilename(coreParameter.fileToStart));
+	// Test output goes to stdout, keep the profile out of it.
+	fprintf(stderr, "%s", j.str().c_str());
+}
 
+// Runs the emulator until it stops or the timeout passes.  Returns false on timeout.
+static bool RunUntilStopped(HeadlessHost *headlessHost, CoreParameter &coreParameter, double timeout)
+{
 	time_update();
-	bool passed = true;
+	bool timedOut = false;
 	// TODO: We must have some kind of stack overflow or we're not following the ABI right.
 	// This gets trashed if it's not static.
 	static double deadline;
-	deadline = time_now() + timeout;
-
-	Core_UpdateDebugStats(g_Config.bShowDebugStats || g_Config.bLogFrameDrops);
+	deadline = time_now_d() + timeout;
 
 	PSP_BeginHostFrame();
 	if (coreParameter.thin3d)
@@ -179,12 +195,7 @@ bool RunAutoTest(HeadlessHost *headlessHost, CoreParameter &coreParameter, bool
 		}
 		time_update();
 		if (time_now_d() > deadline) {
-			// Don't compare, print the output at least up to this point, and bail.
-			printf("%s", output.c_str());
-			passed = false;
-
-			host->SendDebugOutput("TIMEOUT\n");
-			TeamCityPrint("##teamcity[testFailed name='%s' message='Test timeout']\n", teamCityName.c_str());
+			timedOut = true;
 			Core_Stop();
 		}
 	}
@@ -193,6 +204,49 @@ bool RunAutoTest(HeadlessHost *headlessHost, CoreParameter &coreParameter, bool
 	if (coreParameter.thin3d)
 		coreParameter.thin3d->EndFrame();
 
+	return !timedOut;
+}
+
+bool RunAutoTest(HeadlessHost *headlessHost, CoreParameter &coreParameter, bool autoCompare, bool verbose, double timeout, int blockProfileCount)
+{
+	if (teamCityMode) {
+		// Kinda ugly, trying to guesstimate the test name from filename...
+		teamCityName = GetTestName(coreParameter.fileToStart);
+	}
+
+	std::string output;
+	if (autoCompare)
+		coreParameter.collectEmuLog = &output;
+
+	std::string error_string;
+	if (!PSP_Init(coreParameter, &error_string)) {
+		fprintf(stderr, "Failed to start %s. Error: %s\n", coreParameter.fileToStart.c_str(), error_string.c_str());
+		printf("TESTERROR\n");
+		TeamCityPrint("##teamcity[testIgnored name='%s' message='PRX/ELF missing']\n", teamCityName.c_str());
+		return false;
+	}
+
+	TeamCityPrint("##teamcity[testStarted name='%s' captureStandardOutput='true']\n", teamCityName.c_str());
+
+	host->BootDone();
+
+	if (autoCompare)
+		headlessHost->SetComparisonScreenshot(ExpectedScreenshotFromFilename(coreParameter.fileToStart));
+
+	Core_UpdateDebugStats(g_Config.bShowDebugStats || g_Config.bLogFrameDrops);
+
+	bool passed = RunUntilStopped(headlessHost, coreParameter, timeout);
+	if (!passed) {
+		// Don't compare, print the output at least up to this point, and bail.
+		printf("%s", output.c_str());
+
+		host->SendDebugOutput("TIMEOUT\n");
+		TeamCityPrint("##teamcity[testFailed name='%s' message='Test timeout']\n", teamCityName.c_str());
+	}
+
+	if (blockProfileCount != 0)
+		WriteBlockProfileJson(coreParameter.fileToStart, blockProfileCount);
+
 	PSP_Shutdown();
 
 	headlessHost->FlushDebugOutput();
@@ -205,6 +259,132 @@ bool RunAutoTest(HeadlessHost *headlessHost, CoreParameter &coreParameter, bool
 	return passed;
 }
 
+struct GEDumpBenchStats {
+	std::vector<double> frameSeconds;
+	GPUCommandProfile commands{};
+	// Summed from gpuStats after each replay.
+	u64 drawCalls = 0;
+	u64 cachedDrawCalls = 0;
+	u64 flushes = 0;
+	u64 vertsSubmitted = 0;
+	u64 texturesDecoded = 0;
+	u64 textureInvalidations = 0;
+	u64 textureSwitches = 0;
+	u64 shaderSwitches = 0;
+	u64 readbacks = 0;
+	u64 uploads = 0;
+
+	void AddFrame(double seconds) {
+		frameSeconds.push_back(seconds);
+		drawCalls += gpuStats.numDrawCalls;
+		cachedDrawCalls += gpuStats.numCachedDrawCalls;
+		flushes += gpuStats.numFlushes;
+		vertsSubmitted += gpuStats.numVertsSubmitted;
+		texturesDecoded += gpuStats.numTexturesDecoded;
+		textureInvalidations += gpuStats.numTextureInvalidations;
+		textureSwitches += gpuStats.numTextureSwitches;
+		shaderSwitches += gpuStats.numShaderSwitches;
+		readbacks += gpuStats.numReadbacks;
+		uploads += gpuStats.numUploads;
+		gpuStats.ResetFrame();
+	}
+};
+
+static void WriteGEDumpBenchJson(const std::string &filename, GPUCore gpuCore, const GEDumpBenchStats &stats) {
+	json::JsonWriter j(json::JsonWriter::PRETTY);
+	j.begin();
+	j.writeString("file", filename);
+	j.writeString("gpu", gpuCore == GPUCORE_SOFTWARE ? "software" : (gpuCore == GPUCORE_NULL ? "null" : "hardware"));
+
+	std::vector<double> sorted = stats.frameSeconds;
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0.0;
+	for (double s : sorted)
+		total += s;
+
+	j.pushDict("frames");
+	j.writeInt("count", (int)sorted.size());
+	j.writeFloat("totalMs", total * 1000.0);
+	if (!sorted.empty()) {
+		j.writeFloat("avgMs", total * 1000.0 / sorted.size());
+		j.writeFloat("minMs", sorted.front() * 1000.0);
+		j.writeFloat("medianMs", sorted[sorted.size() / 2] * 1000.0);
+		j.writeFloat("maxMs", sorted.back() * 1000.0);
+	}
+	j.pushArray("ms");
+	for (double s : stats.frameSeconds)
+		j.writeFloat(s * 1000.0);
+	j.pop();
+	j.pop();
+
+	// Slowest command types first.
+	std::vector<int> cmds;
+	for (int cmd = 0; cmd < 256; ++cmd) {
+		if (stats.commands.count[cmd] != 0)
+			cmds.push_back(cmd);
+	}
+	std::sort(cmds.begin(), cmds.end(), [&](int a, int b) {
+		return stats.commands.seconds[a] > stats.commands.seconds[b];
+	});
+	j.pushArray("commands");
+	for (int cmd : cmds) {
+		j.pushDict();
+		j.writeInt("cmd", cmd);
+		j.writeRaw("count", std::to_string(stats.commands.count[cmd]));
+		j.writeFloat("totalMs", stats.commands.seconds[cmd] * 1000.0);
+		j.pop();
+	}
+	j.pop();
+
+	j.pushDict("stats");
+	j.writeRaw("drawCalls", std::to_string(stats.drawCalls));
+	j.writeRaw("cachedDrawCalls", std::to_string(stats.cachedDrawCalls));
+	j.writeRaw("flushes", std::to_string(stats.flushes));
+	j.writeRaw("vertsSubmitted", std::to_string(stats.vertsSubmitted));
+	j.writeRaw("texturesDecoded", std::to_string(stats.texturesDecoded));
+	j.writeRaw("textureInvalidations", std::to_string(stats.textureInvalidations));
+	j.writeRaw("textureSwitches", std::to_string(stats.textureSwitches));
+	j.writeRaw("shaderSwitches", std::to_string(stats.shaderSwitches));
+	j.writeRaw("readbacks", std::to_string(stats.readbacks));
+	j.writeRaw("uploads", std::to_string(stats.uploads));
+	j.pop();
+	j.end();
+
+	printf("%s", j.str().c_str());
+}
+
+bool RunGEDumpBenchmark(HeadlessHost *headlessHost, CoreParameter &coreParameter, int replays, double timeout)
+{
+	std::string error_string;
+	if (!PSP_Init(coreParameter, &error_string)) {
+		fprintf(stderr, "Failed to start %s. Error: %s\n", coreParameter.fileToStart.c_str(), error_string.c_str());
+		return false;
+	}
+
+	host->BootDone();
+
+	GEDumpBenchStats stats;
+	Core_UpdateDebugStats(true);
+	GPURecord::SetReplayCallback([&](double seconds) {
+		stats.AddFrame(seconds);
+		if ((int)stats.frameSeconds.size() >= replays)
+			Core_Stop();
+	});
+	gpu->SetCommandProfile(&stats.commands);
+
+	if (!RunUntilStopped(headlessHost, coreParameter, timeout))
+		fprintf(stderr, "Benchmark timed out after %d replays\n", (int)stats.frameSeconds.size());
+
+	gpu->SetCommandProfile(nullptr);
+	GPURecord::SetReplayCallback(nullptr);
+	PSP_Shutdown();
+
+	headlessHost->FlushDebugOutput();
+
+	WriteGEDumpBenchJson(coreParameter.fileToStart, coreParameter.gpuCore, stats);
+	return (int)stats.frameSeconds.size() >= replays;
+}
+
 int main(int argc, const char* argv[])
 {
 	PROFILE_INIT();
@@ -222,6 +402,8 @@ int main(int argc, const char* argv[])
 	bool fullLog = false;
 	bool autoCompare = false;
 	bool verbose = false;
+	int benchReplays = 0;
+	int blockProfileCount = 0;
 	const char *stateToLoad = 0;
 	GPUCore gpuCore = GPUCORE_NULL;
 	CPUCore cpuCore = CPUCore::JIT;
@@ -283,6 +465,22 @@ int main(int argc, const char* argv[])
 			screenshotFilename = argv[i] + strlen("--screenshot=");
 		else if (!strncmp(argv[i], "--timeout=", strlen("--timeout=")) && strlen(argv[i]) > strlen("--timeout="))
 			timeout = strtod(argv[i] + strlen("--timeout="), NULL);
+		else if (!strcmp(argv[i], "--bench-gedump"))
+			benchReplays = 100;
+		else if (!strncmp(argv[i], "--bench-gedump=", strlen("--bench-gedump=")) && strlen(argv[i]) > strlen("--bench-gedump="))
+		{
+			benchReplays = atoi(argv[i] + strlen("--bench-gedump="));
+			if (benchReplays <= 0)
+				return printUsage(argv[0], "Invalid replay count after --bench-gedump=");
+		}
+		else if (!strcmp(argv[i], "--block-profile"))
+			blockProfileCount = 50;
+		else if (!strncmp(argv[i], "--block-profile=", strlen("--block-profile=")) && strlen(argv[i]) > strlen("--block-profile="))
+		{
+			blockProfileCount = atoi(argv[i] + strlen("--block-profile="));
+			if (blockProfileCount <= 0)
+				return printUsage(argv[0], "Invalid block count after --block-profile=");
+		}
 		else if (!strcmp(argv[i], "--teamcity"))
 			teamCityMode = true;
 		else if (!strncmp(argv[i], "--state=", strlen("--state=")) && strlen(argv[i]) > strlen("--state="))
@@ -373,6 +571,7 @@ int main(int argc, const char* argv[])
 	g_Config.bHighQualityDepth = true;
 	g_Config.bMemStickInserted = true;
 	g_Config.bFragmentTestCache = true;
+	g_Config.bJitBlockProfile = blockProfileCount != 0;
 
 #ifdef _WIN32
 	InitSysDirectories();
@@ -410,12 +609,18 @@ int main(int argc, const char* argv[])
 
 	std::vector<std::string> failedTests;
 	std::vector<std::string> passedTests;
-	for (size_t i = 0; i < testFilenames.size(); ++i)
+	for (size_t i = 0; benchReplays != 0 && i < testFilenames.size(); ++i)
+	{
+		coreParameter.fileToStart = testFilenames[i];
+		if (!RunGEDumpBenchmark(headlessHost, coreParameter, benchReplays, timeout))
+			failedTests.push_back(testFilenames[i]);
+	}
+	for (size_t i = 0; benchReplays == 0 && i < testFilenames.size(); ++i)
 	{
 		coreParameter.fileToStart = testFilenames[i];
 		if (autoCompare)
 			printf("%s:\n", coreParameter.fileToStart.c_str());
-		bool passed = RunAutoTest(headlessHost, coreParameter, autoCompare, verbose, timeout);
+		bool passed = RunAutoTest(headlessHost, coreParameter, autoCompare, verbose, timeout, blockProfileCount);
 		if (autoCompare)
 		{
 			std::string testName = GetTestName(coreParameter.fileToStart);
@@ -454,5 +659,8 @@ int main(int argc, const char* argv[])
 	moncleanup();
 #endif
 
+	// Let scripts notice a benchmark that couldn't finish.
+	if (benchReplays != 0 && !failedTests.empty())
+		return 1;
 	return 0;
 }
@@ -16,9 +16,14 @@
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
 
 #include "base/timeutil.h"
 #include "base/NativeApp.h"
+#include "Common/CPUDetect.h"
+#include "Common/StringUtils.h"
 #include "Core/ConfigValues.h"
 #include "Core/MIPS/JitCommon/JitCommon.h"
 #include "Core/MIPS/JitCommon/JitBlockCache.h"
@@ -27,6 +32,7 @@
 #include "Core/MIPS/MIPSAsm.h"
 #include "Core/MIPS/MIPSTables.h"
 #include "Core/MemMap.h"
+#include "Core/MemMapHelpers.h"
 #include "Core/Core.h"
 #include "Core/CoreTiming.h"
 #include "Core/HLE/HLE.h"
@@ -195,3 +201,232 @@ bool TestJit() {
 
 	return jit_speed >= interp_speed;
 }
+
+static const u32 JIT_COMPARE_OUT = 0x08900000;
+static const u32 JIT_COMPARE_OUT_SIZE = 256;
+static const u32 JIT_COMPARE_IN = 0x08910000;
+
+struct JitCompareState {
+	u32 r[32];
+	u32 hi, lo;
+	u8 out[JIT_COMPARE_OUT_SIZE];
+};
+
+static void RunToTerminator(JitCompareState &state) {
+	for (int i = 0; i < 32; ++i)
+		currentMIPS->r[i] = i == 0 ? 0 : 0x1000 * i + i;
+	currentMIPS->r[MIPS_REG_S0] = JIT_COMPARE_OUT;
+	currentMIPS->hi = 0;
+	currentMIPS->lo = 0;
+	Memory::Memset(JIT_COMPARE_OUT, 0, JIT_COMPARE_OUT_SIZE);
+
+	currentMIPS->pc = PSP_GetUserMemoryBase();
+	coreState = CORE_RUNNING;
+	while (coreState == CORE_RUNNING)
+		mipsr4k.RunLoopUntil(1000000);
+
+	memcpy(state.r, currentMIPS->r, sizeof(state.r));
+	state.hi = currentMIPS->hi;
+	state.lo = currentMIPS->lo;
+	Memory::Memcpy(state.out, JIT_COMPARE_OUT, JIT_COMPARE_OUT_SIZE);
+}
+
+// Branch targets are written as @N, meaning line N. The code ends by calling the terminator.
+static bool AssembleCompareTest(const char *const *lines, size_t count) {
+	const u32 base = PSP_GetUserMemoryBase();
+	bool success = true;
+	u32 addr = base;
+	for (size_t i = 0; i < count; ++i) {
+		std::string line = lines[i];
+		size_t at = line.find('@');
+		if (at != std::string::npos) {
+			int target = atoi(line.c_str() + at + 1);
+			line = line.substr(0, at) + StringFromFormat("0x%08x", base + target * 4);
+		}
+		if (!MIPSAsm::MipsAssembleOpcode(line.c_str(), currentDebugMIPS, addr)) {
+			printf("ERROR: %ls\n", MIPSAsm::GetAssembleError().c_str());
+			success = false;
+		}
+		addr += 4;
+	}
+	Memory::Write_U32(MIPS_MAKE_SYSCALL("UnitTestFakeSyscalls", "UnitTestTerminator"), addr);
+	Memory::Write_U32(MIPS_MAKE_BREAK(1), addr + 4);
+	return success;
+}
+
+static bool CompareStates(const JitCompareState &interp, const JitCompareState &jit) {
+	bool success = true;
+	for (int i = 0; i < 32; ++i) {
+		if (interp.r[i] != jit.r[i]) {
+			printf("%s: interp %08x, jit %08x\n", currentDebugMIPS->GetRegName(0, i), interp.r[i], jit.r[i]);
+			success = false;
+		}
+	}
+	if (interp.hi != jit.hi || interp.lo != jit.lo) {
+		printf("hi/lo: interp %08x/%08x, jit %08x/%08x\n", interp.hi, interp.lo, jit.hi, jit.lo);
+		success = false;
+	}
+	for (u32 i = 0; i < JIT_COMPARE_OUT_SIZE; i += 4) {
+		u32 a, b;
+		memcpy(&a, interp.out + i, 4);
+		memcpy(&b, jit.out + i, 4);
+		if (a != b) {
+			printf("out+%d: interp %08x, jit %08x\n", i, a, b);
+			success = false;
+		}
+	}
+	return success;
+}
+
+// Checks that the jit leaves the same registers and memory as the interpreter, for code where
+// flushes at exits may be skipped (FlushAllForExits.)
+bool TestJitDeadFlush() {
+	SetupJitHarness();
+
+	static const char *lines[] = {
+		// Loop temporaries, t9 is overwritten on every path out of the loop.
+		"addiu a0, zero, 0",
+		"addiu a1, zero, 10",
+		"addiu t9, a0, 3",  // 2
+		"addu v1, v1, t9",
+		"addiu t0, a0, 5",
+		"sll t1, t0, 2",
+		"addu v0, v0, t1",
+		"addiu a0, a0, 1",
+		"bne a0, a1, @2",
+		"nop",
+		"lui t9, 0x1234",
+		"sw t0, 0(s0)",
+		"sw t1, 4(s0)",
+		"sw v0, 8(s0)",
+		// Likely branches, with the delay slot skipped and then run.
+		"addiu t2, zero, 7",
+		"addiu t3, zero, 3",
+		"beql t2, zero, @33",
+		"addiu t2, zero, 99",
+		"sw t2, 12(s0)",
+		"addiu t4, t2, 1",
+		"bnel t4, zero, @22",
+		"addiu t5, zero, 42",
+		"sw t4, 16(s0)",  // 22
+		"sw t5, 20(s0)",
+		// A conditional move that doesn't move still reads its destination.
+		"addiu t6, zero, 5",
+		"addiu t7, zero, 0",
+		"addiu t8, zero, 9",
+		"beq zero, zero, @29",
+		"addiu t6, zero, 6",
+		"movn t6, t8, t7",  // 29
+		"movz t7, t8, t7",
+		"sw t6, 24(s0)",
+		"sw t7, 28(s0)",
+		"nop",  // 33
+	};
+
+	bool compileSuccess = AssembleCompareTest(lines, ARRAY_SIZE(lines));
+
+	bool success = compileSuccess;
+	if (compileSuccess) {
+		JitCompareState interp, jit;
+		RunToTerminator(interp);
+		mipsr4k.UpdateCore(CPUCore::JIT);
+		RunToTerminator(jit);
+		success = CompareStates(interp, jit);
+
+		// Make sure the interesting paths were actually taken.
+		u32 likelySkipped, likelyRan, notMoved;
+		memcpy(&likelySkipped, interp.out + 12, 4);
+		memcpy(&likelyRan, interp.out + 20, 4);
+		memcpy(&notMoved, interp.out + 24, 4);
+		if (interp.r[MIPS_REG_T9] != 0x12340000 || likelySkipped != 7 || likelyRan != 42 || notMoved != 6) {
+			printf("Unexpected interpreter results\n");
+			success = false;
+		}
+	}
+
+	DestroyJitHarness();
+	return success;
+}
+
+// Checks back-to-back matrix ops, where the jit keeps S transposed in regs between vmmuls and
+// broadcasts T from register lanes. Run with and without AVX, since they take different paths.
+bool TestJitMatrixOps() {
+	SetupJitHarness();
+
+	static const char *lines[] = {
+		// t0 = JIT_COMPARE_IN.
+		"lui t0, 0x0891",
+		"lv.q C100, 0(t0)",
+		"lv.q C110, 16(t0)",
+		"lv.q C120, 32(t0)",
+		"lv.q C130, 48(t0)",
+		"lv.q C200, 64(t0)",
+		"lv.q C210, 80(t0)",
+		"lv.q C220, 96(t0)",
+		"lv.q C230, 112(t0)",
+		"lv.q C500, 128(t0)",
+		"lv.q C510, 144(t0)",
+		"lv.q C520, 160(t0)",
+		"lv.q C530, 176(t0)",
+		"lv.q C400, 192(t0)",
+		// The second vmmul can reuse the transposed S from the first.
+		"vmmul.q M000, E100, M200",
+		"vmmul.q M300, E100, M500",
+		// Then S is used untransposed, and transposed again.
+		"vtfm4.q C600, M100, C400",
+		"vtfm4.q C610, E100, C400",
+		"sv.q C000, 0(s0)",
+		"sv.q C010, 16(s0)",
+		"sv.q C020, 32(s0)",
+		"sv.q C030, 48(s0)",
+		"sv.q C300, 64(s0)",
+		"sv.q C310, 80(s0)",
+		"sv.q C320, 96(s0)",
+		"sv.q C330, 112(s0)",
+		"sv.q C600, 128(s0)",
+		"sv.q C610, 144(s0)",
+	};
+
+	// Small values with few mantissa bits, so every sum is exact whatever order the adds happen in.
+	for (u32 i = 0; i < 52; ++i)
+		Memory::Write_Float((float)((int)(i * 7 % 13) - 6) * 0.5f, JIT_COMPARE_IN + i * 4);
+
+	bool compileSuccess = AssembleCompareTest(lines, ARRAY_SIZE(lines));
+
+	bool success = compileSuccess;
+	if (compileSuccess) {
+		JitCompareState interp, jit;
+		RunToTerminator(interp);
+
+		const bool hasAVX = cpu_info.bAVX;
+		mipsr4k.UpdateCore(CPUCore::JIT);
+		RunToTerminator(jit);
+		if (!CompareStates(interp, jit)) {
+			printf("Mismatch with AVX %s\n", hasAVX ? "on" : "off");
+			success = false;
+		}
+
+		if (hasAVX) {
+			cpu_info.bAVX = false;
+			mipsr4k.ClearJitCache();
+			RunToTerminator(jit);
+			if (!CompareStates(interp, jit)) {
+				printf("Mismatch with AVX off\n");
+				success = false;
+			}
+			cpu_info.bAVX = true;
+		}
+
+		// Make sure the results aren't all zero, which would match trivially.
+		bool anyNonZero = false;
+		for (u32 i = 0; i < 160; ++i)
+			anyNonZero = anyNonZero || interp.out[i] != 0;
+		if (!anyNonZero) {
+			printf("Unexpected interpreter results\n");
+			success = false;
+		}
+	}
+
+	DestroyJitHarness();
+	return success;
+}
@@ -18,3 +18,5 @@
 #pragma once
 
 bool TestJit();
+bool TestJitDeadFlush();
+bool TestJitMatrixOps();
@@ -0,0 +1,278 @@
+// Copyright (c) 2018- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <vector>
+
+#include "Common/Common.h"
+#include "Core/Util/BlockAllocator.h"
+
+#include "UnitTest.h"
+
+// The original linear first-fit allocator, which BlockAllocator must match exactly
+// (allocation addresses end up in savestates and game memory layouts.)
+class ReferenceBlockAllocator {
+public:
+	explicit ReferenceBlockAllocator(u32 grain) : grain_(grain) {}
+
+	void Init(u32 rangeStart, u32 rangeSize) {
+		rangeStart_ = rangeStart;
+		rangeSize_ = rangeSize;
+		blocks_.clear();
+		blocks_.push_back({ rangeStart, rangeSize, false });
+	}
+
+	u32 AllocAligned(u32 &size, u32 sizeGrain, u32 grain, bool fromTop) {
+		if (size == 0 || size > rangeSize_)
+			return -1;
+		if (grain < grain_)
+			grain = grain_;
+		if (sizeGrain < grain_)
+			sizeGrain = grain_;
+		size = (size + sizeGrain - 1) & ~(sizeGrain - 1);
+
+		if (!fromTop) {
+			for (size_t i = 0; i < blocks_.size(); ++i) {
+				u32 offset = blocks_[i].start % grain;
+				if (offset != 0)
+					offset = grain - offset;
+				u32 needed = offset + size;
+				if (!blocks_[i].taken && blocks_[i].size >= needed) {
+					if (blocks_[i].size != needed)
+						InsertFreeAfter(i, blocks_[i].size - needed);
+					if (offset >= grain_)
+						i = InsertFreeBefore(i, offset);
+					blocks_[i].taken = true;
+					return blocks_[i].start;
+				}
+			}
+		} else {
+			for (size_t j = blocks_.size(); j > 0; --j) {
+				size_t i = j - 1;
+				u32 offset = (blocks_[i].start + blocks_[i].size - size) % grain;
+				u32 needed = offset + size;
+				if (!blocks_[i].taken && blocks_[i].size >= needed) {
+					if (blocks_[i].size != needed)
+						i = InsertFreeBefore(i, blocks_[i].size - needed);
+					if (offset >= grain_)
+						InsertFreeAfter(i, offset);
+					blocks_[i].taken = true;
+					return blocks_[i].start;
+				}
+			}
+		}
+		return -1;
+	}
+
+	u32 AllocAt(u32 position, u32 size) {
+		if (size > rangeSize_)
+			return -1;
+		u32 alignedPosition = position;
+		u32 alignedSize = size;
+		if (position & (grain_ - 1)) {
+			alignedPosition &= ~(grain_ - 1);
+			alignedSize += alignedPosition - position;
+		}
+		alignedSize = (alignedSize + grain_ - 1) & ~(grain_ - 1);
+		size = alignedSize - (alignedPosition - position);
+
+		int i = Find(alignedPosition);
+		if (i < 0 || blocks_[i].taken || blocks_[i].start + blocks_[i].size < alignedPosition + alignedSize)
+			return -1;
+		if (blocks_[i].start != alignedPosition)
+			i = (int)InsertFreeBefore(i, alignedPosition - blocks_[i].start);
+		if (blocks_[i].size > alignedSize)
+			InsertFreeAfter(i, blocks_[i].size - alignedSize);
+		blocks_[i].taken = true;
+		return position;
+	}
+
+	bool Free(u32 position, bool exact) {
+		int i = Find(position);
+		if (i < 0 || !blocks_[i].taken || (exact && blocks_[i].start != position))
+			return false;
+		blocks_[i].taken = false;
+		if (i + 1 < (int)blocks_.size() && !blocks_[i + 1].taken) {
+			blocks_[i].size += blocks_[i + 1].size;
+			blocks_.erase(blocks_.begin() + i + 1);
+		}
+		if (i > 0 && !blocks_[i - 1].taken) {
+			blocks_[i - 1].size += blocks_[i].size;
+			blocks_.erase(blocks_.begin() + i);
+		}
+		return true;
+	}
+
+	u32 GetBlockStartFromAddress(u32 addr) const {
+		int i = Find(addr);
+		return i < 0 ? (u32)-1 : blocks_[i].start;
+	}
+
+	u32 GetBlockSizeFromAddress(u32 addr) const {
+		int i = Find(addr);
+		return i < 0 ? (u32)-1 : blocks_[i].size;
+	}
+
+	bool IsBlockFree(u32 addr) const {
+		int i = Find(addr);
+		return i >= 0 && !blocks_[i].taken;
+	}
+
+	u32 GetLargestFreeBlockSize() const {
+		u32 largest = 0;
+		for (const RefBlock &b : blocks_) {
+			if (!b.taken && b.size > largest)
+				largest = b.size;
+		}
+		return largest;
+	}
+
+	u32 GetTotalFreeBytes() const {
+		u32 sum = 0;
+		for (const RefBlock &b : blocks_) {
+			if (!b.taken)
+				sum += b.size;
+		}
+		return sum;
+	}
+
+private:
+	struct RefBlock {
+		u32 start;
+		u32 size;
+		bool taken;
+	};
+
+	int Find(u32 addr) const {
+		for (size_t i = 0; i < blocks_.size(); ++i) {
+			if (blocks_[i].start <= addr && blocks_[i].start + blocks_[i].size > addr)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	// Returns the new index of the original block.
+	size_t InsertFreeBefore(size_t i, u32 size) {
+		RefBlock inserted = { blocks_[i].start, size, false };
+		blocks_[i].start += size;
+		blocks_[i].size -= size;
+		blocks_.insert(blocks_.begin() + i, inserted);
+		return i + 1;
+	}
+
+	void InsertFreeAfter(size_t i, u32 size) {
+		RefBlock inserted = { blocks_[i].start + blocks_[i].size - size, size, false };
+		blocks_[i].size -= size;
+		blocks_.insert(blocks_.begin() + i + 1, inserted);
+	}
+
+	std::vector<RefBlock> blocks_;
+	u32 rangeStart_ = 0;
+	u32 rangeSize_ = 0;
+	u32 grain_;
+};
+
+// Deterministic across platforms, unlike rand().
+static u32 fuzzState;
+static u32 FuzzRand() {
+	fuzzState ^= fuzzState << 13;
+	fuzzState ^= fuzzState >> 17;
+	fuzzState ^= fuzzState << 5;
+	return fuzzState;
+}
+
+static u32 FuzzSize() {
+	// Mostly small, sometimes large.
+	switch (FuzzRand() % 4) {
+	case 0: return 1 + FuzzRand() % 0x100;
+	case 1: return 1 + FuzzRand() % 0x4000;
+	case 2: return 1 + FuzzRand() % 0x40000;
+	default: return 1 + FuzzRand() % 0x400000;
+	}
+}
+
+static bool FuzzBlockAllocator(u32 seed, u32 grain, int ops) {
+	const u32 rangeStart = 0x08800000;
+	const u32 rangeSize = 0x01800000;
+	static const u32 alignments[] = { 0x10, 0x40, 0x100, 0x1000, 0x10000 };
+
+	fuzzState = seed;
+	BlockAllocator alloc(grain);
+	ReferenceBlockAllocator ref(grain);
+	alloc.Init(rangeStart, rangeSize);
+	ref.Init(rangeStart, rangeSize);
+
+	std::vector<u32> allocated;
+	for (int i = 0; i < ops; ++i) {
+		u32 op = FuzzRand() % 100;
+		if (op < 45) {
+			u32 size = FuzzSize();
+			u32 refSize = size;
+			u32 sizeGrain = alignments[FuzzRand() % 3];
+			u32 align = alignments[FuzzRand() % ARRAY_SIZE(alignments)];
+			bool fromTop = (FuzzRand() & 1) != 0;
+			u32 addr = alloc.AllocAligned(size, sizeGrain, align, fromTop, "fuzz");
+			u32 refAddr = ref.AllocAligned(refSize, sizeGrain, align, fromTop);
+			EXPECT_EQ_HEX(addr, refAddr);
+			EXPECT_EQ_HEX(size, refSize);
+			if (addr != (u32)-1)
+				allocated.push_back(addr);
+		} else if (op < 55) {
+			u32 pos = rangeStart + FuzzRand() % rangeSize;
+			u32 size = FuzzSize();
+			u32 addr = alloc.AllocAt(pos, size, "fuzz");
+			u32 refAddr = ref.AllocAt(pos, size);
+			EXPECT_EQ_HEX(addr, refAddr);
+			if (addr != (u32)-1)
+				allocated.push_back(addr);
+		} else if (op < 95 && !allocated.empty()) {
+			size_t index = FuzzRand() % allocated.size();
+			u32 addr = allocated[index];
+			allocated[index] = allocated.back();
+			allocated.pop_back();
+			// Sometimes free by an address inside the block.
+			bool exact = (FuzzRand() & 3) != 0;
+			if (!exact)
+				addr += FuzzRand() % 0x10;
+			EXPECT_EQ_INT(alloc.Free(addr), ref.Free(addr, false));
+		} else {
+			u32 addr = rangeStart + FuzzRand() % rangeSize;
+			EXPECT_EQ_INT(alloc.FreeExact(addr), ref.Free(addr, true));
+		}
+
+		EXPECT_EQ_HEX(alloc.GetTotalFreeBytes(), ref.GetTotalFreeBytes());
+		EXPECT_EQ_HEX(alloc.GetLargestFreeBlockSize(), ref.GetLargestFreeBlockSize());
+		for (int j = 0; j < 4; ++j) {
+			u32 addr = rangeStart - 0x100 + FuzzRand() % (rangeSize + 0x200);
+			EXPECT_EQ_HEX(alloc.GetBlockStartFromAddress(addr), ref.GetBlockStartFromAddress(addr));
+			EXPECT_EQ_HEX(alloc.GetBlockSizeFromAddress(addr), ref.GetBlockSizeFromAddress(addr));
+			EXPECT_EQ_INT(alloc.IsBlockFree(addr), ref.IsBlockFree(addr));
+		}
+	}
+	return true;
+}
+
+bool TestBlockAllocator() {
+	static const u32 seeds[] = { 0x1234567, 0xDEADBEEF, 0x0BADF00D, 0x7331 };
+	for (u32 seed : seeds) {
+		if (!FuzzBlockAllocator(seed, 0x10, 20000))
+			return false;
+		if (!FuzzBlockAllocator(seed, 0x100, 20000))
+			return false;
+	}
+	return true;
+}
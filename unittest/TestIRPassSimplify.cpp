@@ -0,0 +1,175 @@
+// Copyright (c) 2018- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <cstdio>
+#include <cstring>
+
+#include "Common/Common.h"
+#include "Core/MemMap.h"
+#include "Core/MemMapHelpers.h"
+#include "Core/MIPS/MIPS.h"
+#include "Core/MIPS/IR/IRInst.h"
+#include "Core/MIPS/IR/IRInterpreter.h"
+#include "Core/MIPS/IR/IRPassSimplify.h"
+
+#include "UnitTest.h"
+
+static const u32 TEST_MEM_BASE = 0x08800000;
+
+// Like IRFrontend::Comp_ReplacementFunc(), with constant arguments.
+static void WriteMemOp(IRWriter &ir, IROp op, u32 dest, u32 src, u32 size, bool memChecks) {
+	ir.WriteSetConstant(MIPS_REG_A0, dest);
+	ir.WriteSetConstant(MIPS_REG_A1, src);
+	ir.WriteSetConstant(MIPS_REG_A2, size);
+	ir.AddConstant(memChecks ? 0 : 1);
+	ir.Write(op, MIPS_REG_A0, MIPS_REG_A1, MIPS_REG_A2);
+	ir.Write(IROp::ExitToConst, 0, ir.AddConstant(TEST_MEM_BASE));
+}
+
+static int CountOps(const IRWriter &ir, IROp op) {
+	int count = 0;
+	for (const IRInst &inst : ir.GetInstructions()) {
+		if (inst.op == op)
+			++count;
+	}
+	return count;
+}
+
+static void Simplify(const IRWriter &in, IRWriter &out) {
+	IROptions opts{};
+	out.Clear();
+	PropagateConstants(in, out, opts);
+}
+
+// How many of op are left after simplifying.
+static int CountSimplifiedOps(const IRWriter &in, IROp op) {
+	IRWriter out;
+	Simplify(in, out);
+	return CountOps(out, op);
+}
+
+// Runs the block on fresh memory, returning the cycles it took.
+static int RunBlock(const IRWriter &ir, u8 *result, u32 size) {
+	Memory::Memset(TEST_MEM_BASE, 0x11, size);
+	currentMIPS->downcount = 0;
+	IRInterpret(currentMIPS, &ir.GetInstructions()[0], (int)ir.GetInstructions().size());
+	memcpy(result, Memory::GetPointer(TEST_MEM_BASE), size);
+	return -currentMIPS->downcount;
+}
+
+static bool TestMemSetExpansion() {
+	IRWriter in;
+	// Misaligned both ways, so all three store sizes are needed.
+	WriteMemOp(in, IROp::MemSet, TEST_MEM_BASE + 3, 0x1AB, 12, false);
+	IRWriter out;
+	Simplify(in, out);
+	EXPECT_EQ_INT(CountOps(out, IROp::MemSet), 0);
+	EXPECT_EQ_INT(CountOps(out, IROp::Store32), 2);
+	EXPECT_EQ_INT(CountOps(out, IROp::Store16), 1);
+	EXPECT_EQ_INT(CountOps(out, IROp::Store8), 2);
+
+	u8 expected[32], actual[32];
+	int expectedCycles = RunBlock(in, expected, sizeof(expected));
+	int actualCycles = RunBlock(out, actual, sizeof(actual));
+	EXPECT_EQ_INT(actualCycles, expectedCycles);
+	EXPECT_TRUE(memcmp(expected, actual, sizeof(expected)) == 0);
+	EXPECT_EQ_HEX(actual[3], 0xAB);
+	EXPECT_EQ_HEX(actual[15], 0x11);
+
+	// Zero should just store the zero register.
+	in.Clear();
+	WriteMemOp(in, IROp::MemSet, TEST_MEM_BASE, 0, 16, false);
+	Simplify(in, out);
+	EXPECT_EQ_INT(CountOps(out, IROp::Store32), 4);
+	for (const IRInst &inst : out.GetInstructions()) {
+		if (inst.op == IROp::Store32)
+			EXPECT_EQ_INT((int)inst.src3, (int)MIPS_REG_ZERO);
+	}
+	expectedCycles = RunBlock(in, expected, sizeof(expected));
+	actualCycles = RunBlock(out, actual, sizeof(actual));
+	EXPECT_EQ_INT(actualCycles, expectedCycles);
+	EXPECT_TRUE(memcmp(expected, actual, sizeof(expected)) == 0);
+
+	return true;
+}
+
+static bool TestMemSetKept() {
+	// Memchecks need the real call.
+	IRWriter in;
+	WriteMemOp(in, IROp::MemSet, TEST_MEM_BASE, 0, 16, true);
+	EXPECT_EQ_INT(CountSimplifiedOps(in, IROp::MemSet), 1);
+
+	// VRAM goes through the GPU.
+	in.Clear();
+	WriteMemOp(in, IROp::MemSet, 0x04000000, 0, 16, false);
+	EXPECT_EQ_INT(CountSimplifiedOps(in, IROp::MemSet), 1);
+
+	// Too large, or an invalid pointer that the replacement would skip.
+	in.Clear();
+	WriteMemOp(in, IROp::MemSet, TEST_MEM_BASE, 0, 17, false);
+	EXPECT_EQ_INT(CountSimplifiedOps(in, IROp::MemSet), 1);
+	in.Clear();
+	WriteMemOp(in, IROp::MemSet, 0, 0, 16, false);
+	EXPECT_EQ_INT(CountSimplifiedOps(in, IROp::MemSet), 1);
+
+	// Unknown base.
+	in.Clear();
+	in.WriteSetConstant(MIPS_REG_A1, 0);
+	in.WriteSetConstant(MIPS_REG_A2, 16);
+	in.AddConstant(1);
+	in.Write(IROp::MemSet, MIPS_REG_A0, MIPS_REG_A1, MIPS_REG_A2);
+	EXPECT_EQ_INT(CountSimplifiedOps(in, IROp::MemSet), 1);
+
+	return true;
+}
+
+static bool TestMemCpy() {
+	IRWriter in;
+	WriteMemOp(in, IROp::MemCpy, TEST_MEM_BASE, TEST_MEM_BASE + 16, 0, false);
+	IRWriter out;
+	Simplify(in, out);
+	EXPECT_EQ_INT(CountOps(out, IROp::MemCpy), 0);
+
+	u8 expected[32], actual[32];
+	int expectedCycles = RunBlock(in, expected, sizeof(expected));
+	int actualCycles = RunBlock(out, actual, sizeof(actual));
+	EXPECT_EQ_INT(actualCycles, expectedCycles);
+
+	in.Clear();
+	WriteMemOp(in, IROp::MemCpy, TEST_MEM_BASE, TEST_MEM_BASE + 16, 8, false);
+	Simplify(in, out);
+	EXPECT_EQ_INT(CountOps(out, IROp::MemCpy), 1);
+	Memory::Write_U32(0x12345678, TEST_MEM_BASE + 16);
+	IRInterpret(currentMIPS, &out.GetInstructions()[0], (int)out.GetInstructions().size());
+	EXPECT_EQ_HEX(Memory::Read_U32(TEST_MEM_BASE), 0x12345678);
+
+	return true;
+}
+
+bool TestIRPassSimplify() {
+	currentMIPS = &mipsr4k;
+	Memory::g_MemorySize = Memory::RAM_NORMAL_SIZE;
+	Memory::Init();
+	mipsr4k.Reset();
+
+	bool success = TestMemSetExpansion() && TestMemSetKept() && TestMemCpy();
+
+	mipsr4k.Shutdown();
+	Memory::Shutdown();
+	currentMIPS = nullptr;
+	return success;
+}
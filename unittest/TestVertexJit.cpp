@@ -15,10 +15,14 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <cstdlib>
+#include <vector>
+
 #include "base/timeutil.h"
 #include "Common/Common.h"
 #include "Core/Config.h"
 #include "Core/ConfigValues.h"
+#include "GPU/Common/DrawEngineCommon.h"
 #include "GPU/Common/VertexDecoderCommon.h"
 #include "GPU/ge_constants.h"
 #include "GPU/GPUState.h"
@@ -82,7 +86,7 @@ class VertexDecoderTestHarness {
 		dec_->DecodeVerts(dst_, src_, indexLowerBound_, indexUpperBound);
 	}
 
-	double ExecuteTimed(int vtype, int indexUpperBound, bool useJit) {
+	double ExecuteTimed(int vtype, int indexUpperBound, bool useJit, double duration = 0.5) {
 		SetupExecute(vtype, useJit);
 
 		int total = 0;
@@ -92,7 +96,7 @@ class VertexDecoderTestHarness {
 				dec_->DecodeVerts(dst_, src_, indexLowerBound_, indexUpperBound);
 				++total;
 			}
-		} while (real_time_now() - st < 0.5);
+		} while (real_time_now() - st < duration);
 		double elapsed = real_time_now() - st;
 
 		return total / elapsed;
@@ -121,6 +125,15 @@ class VertexDecoderTestHarness {
 		Add8(w);
 	}
 
+	// Fills the source with a byte pattern that's also a sane float (0x3F3F3F3F ~ 0.75.)
+	void FillSource(size_t bytes) {
+		if (needsReset_) {
+			Reset();
+		}
+		memset(src_ + srcPos_, 0x3F, bytes);
+		srcPos_ += bytes;
+	}
+
 	void Add16(u16_le x) {
 		if (needsReset_) {
 			Reset();
@@ -654,6 +667,46 @@ static VertexTestFunc vertdecTestFuncs[] = {
 	&TestVertexFloatSkin,
 };
 
+// Decodes each vertex type with and without the jit, and prints throughput.  Only with --bench.
+// Set PPSSPP_VTXDEC_CACHE to a .vtxdeccache file to benchmark the types a game recorded.
+static void BenchmarkVertexTypes() {
+	static const u32 defaultTypes[] = {
+		GE_VTYPE_POS_FLOAT,
+		GE_VTYPE_POS_8BIT | GE_VTYPE_NRM_8BIT | GE_VTYPE_TC_8BIT,
+		GE_VTYPE_POS_16BIT | GE_VTYPE_NRM_16BIT | GE_VTYPE_TC_16BIT,
+		GE_VTYPE_POS_FLOAT | GE_VTYPE_TC_FLOAT | GE_VTYPE_COL_8888,
+		GE_VTYPE_POS_16BIT | GE_VTYPE_TC_16BIT | GE_VTYPE_COL_565 | GE_VTYPE_THROUGH,
+		GE_VTYPE_POS_FLOAT | GE_VTYPE_NRM_FLOAT | GE_VTYPE_TC_FLOAT | GE_VTYPE_WEIGHT_FLOAT | (3 << GE_VTYPE_WEIGHTCOUNT_SHIFT),
+		GE_VTYPE_POS_16BIT | GE_VTYPE_NRM_16BIT | GE_VTYPE_WEIGHT_8BIT | (7 << GE_VTYPE_WEIGHTCOUNT_SHIFT),
+		GE_VTYPE_POS_FLOAT | GE_VTYPE_NRM_FLOAT | (1 << GE_VTYPE_MORPHCOUNT_SHIFT),
+	};
+
+	std::vector<u32> vtypes(defaultTypes, defaultTypes + ARRAY_SIZE(defaultTypes));
+	const char *cacheFile = getenv("PPSSPP_VTXDEC_CACHE");
+	std::vector<u32> recorded;
+	if (cacheFile && DrawEngineCommon::ReadVertexDecoderCache(cacheFile, recorded)) {
+		printf("Benchmarking %d vertex types from %s\n", (int)recorded.size(), cacheFile);
+		vtypes = recorded;
+	}
+
+	const int VERTS = 100;
+	double totalJit = 0.0;
+	double totalSteps = 0.0;
+	for (u32 vtype : vtypes) {
+		VertexDecoderTestHarness dec;
+		// Generous: big enough for the largest morphed and weighted vertex.
+		dec.FillSource(VERTS * 8 * 64);
+		double yesJit = dec.ExecuteTimed(vtype, VERTS - 1, true, 0.05);
+		double noJit = dec.ExecuteTimed(vtype, VERTS - 1, false, 0.05);
+		totalJit += yesJit;
+		totalSteps += noJit;
+		printf("%08x: %.0f (jit) vs %.0f (steps) decodes/sec, %.2fx\n", vtype, yesJit, noJit, yesJit / noJit);
+	}
+	if (!vtypes.empty()) {
+		printf("Average jit speedup: %.2fx over %d vertex types\n\n", totalJit / totalSteps, (int)vtypes.size());
+	}
+}
+
 bool TestVertexJit() {
 	VertexDecoderTestHarness dec;
 	/*for (int i = 0; i < 100; ++i) {
@@ -677,6 +730,9 @@ bool TestVertexJit() {
 	printf("Result: %f, %f, %f\n", x, y, z);
 	printf("Jit was %fx faster than steps.\n\n", yesJit / noJit);
 
+	if (g_runBenchmarks)
+		BenchmarkVertexTypes();
+
 	bool pass = true;
 	for (size_t i = 0; i < ARRAY_SIZE(vertdecTestFuncs); ++i) {
 		if (!vertdecTestFuncs[i]()) {
@@ -1,3 +1,4 @@
+#include "Common/x64Analyzer.h"
 #include "Common/x64Emitter.h"
 #include "Core/MIPS/x86/RegCacheFPU.h"
 #include "Core/MIPS/x86/Jit.h"
@@ -37,7 +38,124 @@ bool TestX64Emitter() {
 	emitter.VMULSD(XMM0, XMM1, R(XMM7));
 	RET(CheckLast(emitter, "vmulsd xmm0, xmm1, xmm7"));
 
+	prevStart = emitter.GetCodePointer();
+	emitter.VPERMILPS(XMM0, R(XMM7), 0x1B);
+	RET(CheckLast(emitter, "vpermilps xmm0, xmm7, 0x1b"));
+
+	// Only the memory form, the register form needs AVX2.
+	prevStart = emitter.GetCodePointer();
+	emitter.VBROADCASTSS(XMM0, MDisp(RSI, 0x10));
+	RET(CheckLast(emitter, "vbroadcastss xmm0, dword [rsi+0x10]"));
+
 	// Just for checking.
 	PrintLast(emitter);
 	return true;
 }
+
+bool TestX64Analyzer() {
+	using namespace Gen;
+
+	u8 code[256];
+	XEmitter emitter(code);
+	InstructionInfo info;
+
+	// Base + index * scale + disp8, as the jit emits for fast memory.
+	const u8 *start = emitter.GetCodePointer();
+	emitter.MOV(32, R(EDX), MComplex(RBX, RCX, SCALE_4, 0x10));
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_READ));
+	EXPECT_EQ_INT(info.operandSize, 4);
+	EXPECT_EQ_INT(info.regOperandReg, (int)EDX);
+	EXPECT_EQ_INT(info.otherReg, (int)RBX);
+	EXPECT_EQ_INT(info.scaledReg, (int)RCX);
+	EXPECT_EQ_INT(info.scale, 4);
+	EXPECT_EQ_INT(info.displacement, 0x10);
+	EXPECT_EQ_INT(info.instructionSize, (int)(emitter.GetCodePointer() - start));
+
+	// Extended registers and a negative disp32.
+	start = emitter.GetCodePointer();
+	emitter.MOVSX(32, 16, R9, MComplex(R13, R12, SCALE_1, -0x1000));
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_READ));
+	EXPECT_TRUE(info.signExtend);
+	EXPECT_EQ_INT(info.operandSize, 2);
+	EXPECT_EQ_INT(info.regOperandSize, 4);
+	EXPECT_EQ_INT(info.regOperandReg, (int)R9);
+	EXPECT_EQ_INT(info.otherReg, (int)R13);
+	EXPECT_EQ_INT(info.scaledReg, (int)R12);
+	EXPECT_EQ_INT(info.displacement, -0x1000);
+	EXPECT_EQ_INT(info.instructionSize, (int)(emitter.GetCodePointer() - start));
+
+	// No displacement at all, which must not be read.
+	start = emitter.GetCodePointer();
+	emitter.MOVZX(32, 8, EAX, MatR(RSI));
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_READ));
+	EXPECT_TRUE(info.zeroExtend);
+	EXPECT_EQ_INT(info.operandSize, 1);
+	EXPECT_EQ_INT(info.otherReg, (int)RSI);
+	EXPECT_EQ_INT(info.scaledReg, -1);
+	EXPECT_EQ_INT(info.displacement, 0);
+	EXPECT_EQ_INT(info.instructionSize, (int)(emitter.GetCodePointer() - start));
+
+	// Immediate stores.
+	start = emitter.GetCodePointer();
+	emitter.MOV(16, MDisp(RBX, 0x20), Imm16(0xBEEF));
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_WRITE));
+	EXPECT_TRUE(info.hasImmediate);
+	EXPECT_EQ_INT(info.operandSize, 2);
+	EXPECT_EQ_HEX((u32)info.immediate, 0xBEEF);
+	EXPECT_EQ_INT(info.instructionSize, (int)(emitter.GetCodePointer() - start));
+
+	start = emitter.GetCodePointer();
+	emitter.MOV(64, MatR(RBX), Imm32(-2));
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_WRITE));
+	EXPECT_EQ_INT(info.operandSize, 8);
+	EXPECT_TRUE(info.immediate == (u64)-2);
+	EXPECT_EQ_INT(info.instructionSize, (int)(emitter.GetCodePointer() - start));
+
+	// 8-bit register stores: with a REX prefix, 4-7 are spl-dil, without it ah-bh.
+	start = emitter.GetCodePointer();
+	emitter.MOV(8, MatR(RBX), R(SIL));
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_WRITE));
+	EXPECT_EQ_INT(info.operandSize, 1);
+	EXPECT_EQ_INT(info.regOperandReg, (int)RSI);
+	EXPECT_FALSE(info.isHighByteReg);
+
+	// mov [rbx+0x10], ah
+	static const u8 movFromAH[] = { 0x88, 0x63, 0x10 };
+	EXPECT_TRUE(DisassembleMov(movFromAH, info, OP_ACCESS_WRITE));
+	EXPECT_TRUE(info.isHighByteReg);
+	EXPECT_EQ_INT(info.regOperandReg, (int)RAX);
+	EXPECT_EQ_INT(info.instructionSize, 3);
+
+	// SSE loads and stores.
+	start = emitter.GetCodePointer();
+	emitter.MOVSS(XMM3, MDisp(RBX, 0x40));
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_READ));
+	EXPECT_TRUE(info.isXmmOperand);
+	EXPECT_TRUE(info.zeroExtend);
+	EXPECT_EQ_INT(info.operandSize, 4);
+	EXPECT_EQ_INT(info.regOperandReg, 3);
+	EXPECT_EQ_INT(info.instructionSize, (int)(emitter.GetCodePointer() - start));
+
+	start = emitter.GetCodePointer();
+	emitter.MOVUPS(MComplex(RBX, RAX, SCALE_1, 0), XMM10);
+	EXPECT_TRUE(DisassembleMov(start, info, OP_ACCESS_WRITE));
+	EXPECT_TRUE(info.isXmmOperand);
+	EXPECT_EQ_INT(info.operandSize, 16);
+	EXPECT_EQ_INT(info.regOperandReg, 10);
+	EXPECT_EQ_INT(info.instructionSize, (int)(emitter.GetCodePointer() - start));
+
+	// Loads aren't writes, and unknown or RIP relative accesses are rejected.
+	start = emitter.GetCodePointer();
+	emitter.MOV(32, R(EAX), MatR(RBX));
+	EXPECT_FALSE(DisassembleMov(start, info, OP_ACCESS_WRITE));
+
+	start = emitter.GetCodePointer();
+	emitter.ADD(32, R(EAX), MatR(RBX));
+	EXPECT_FALSE(DisassembleMov(start, info, OP_ACCESS_READ));
+
+	// mov eax, [rip+0x100]
+	static const u8 movRipRelative[] = { 0x8B, 0x05, 0x00, 0x01, 0x00, 0x00 };
+	EXPECT_FALSE(DisassembleMov(movRipRelative, info, OP_ACCESS_READ));
+
+	return true;
+}
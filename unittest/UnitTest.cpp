@@ -459,6 +459,8 @@ bool TestQuickTexHash() {
 	return false;
 }
 
+bool g_runBenchmarks = false;
+
 typedef bool (*TestFunc)();
 struct TestItem {
 	const char *name;
@@ -470,6 +472,9 @@ struct TestItem {
 bool TestArmEmitter();
 bool TestArm64Emitter();
 bool TestX64Emitter();
+bool TestX64Analyzer();
+bool TestBlockAllocator();
+bool TestIRPassSimplify();
 
 TestItem availableTests[] = {
 #if defined(ARM64) || defined(_M_X64) || defined(_M_IX86)
@@ -480,6 +485,7 @@ TestItem availableTests[] = {
 #endif
 #if defined(_M_X64) || defined(_M_IX86)
 	TEST_ITEM(X64Emitter),
+	TEST_ITEM(X64Analyzer),
 #endif
 	TEST_ITEM(VertexJit),
 	TEST_ITEM(Asin),
@@ -488,9 +494,13 @@ TestItem availableTests[] = {
 	TEST_ITEM(MathUtil),
 	TEST_ITEM(Parsers),
 	TEST_ITEM(Jit),
+	TEST_ITEM(JitDeadFlush),
+	TEST_ITEM(JitMatrixOps),
 	TEST_ITEM(MatrixTranspose),
 	TEST_ITEM(ParseLBN),
 	TEST_ITEM(QuickTexHash),
+	TEST_ITEM(BlockAllocator),
+	TEST_ITEM(IRPassSimplify),
 };
 
 int main(int argc, const char *argv[]) {
@@ -502,12 +512,19 @@ int main(int argc, const char *argv[]) {
 
 	bool allTests = false;
 	TestFunc testFunc = nullptr;
-	if (argc >= 2) {
-		if (!strcasecmp(argv[1], "all")) {
+	const char *testName = nullptr;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcasecmp(argv[i], "--bench"))
+			g_runBenchmarks = true;
+		else if (!testName)
+			testName = argv[i];
+	}
+	if (testName) {
+		if (!strcasecmp(testName, "all")) {
 			allTests = true;
 		}
 		for (auto f : availableTests) {
-			if (!strcasecmp(argv[1], f.name)) {
+			if (!strcasecmp(testName, f.name)) {
 				testFunc = f.func;
 				break;
 			}
@@ -533,6 +550,7 @@ int main(int argc, const char *argv[]) {
 		}
 	} else if (testFunc == nullptr) {
 		fprintf(stderr, "You may select a test to run by passing an argument.\n");
+		fprintf(stderr, "Add --bench to also run benchmarks.\n");
 		fprintf(stderr, "\n");
 		fprintf(stderr, "Available tests:\n");
 		for (auto f : availableTests) {
@@ -9,3 +9,6 @@
 #define EXPECT_EQ_STR(a, b) if (a != b) { printf("%s: Test Fail\n%s\nvs\n%s\n", __FUNCTION__, a.c_str(), b.c_str()); return false; }
 
 #define RET(a) if (!(a)) { return false; }
+
+// Set by passing --bench, tests only run their (slow) benchmarks when it's set.
+extern bool g_runBenchmarks;